@@ -85,6 +85,7 @@ int parseAndExecute(SdrLib *sdr, char *buf)
     if (!cmd)
         return TRUE;
     char *p0 = strtok_r(NULL, delim, &ctx);
+    char *p1 = (p0) ? strtok_r(NULL, delim, &ctx) : NULL;
     
     if (equ(cmd, "exit")||equ(cmd, "quit")||equ(cmd, "q"))
         {
@@ -92,11 +93,32 @@ int parseAndExecute(SdrLib *sdr, char *buf)
         }
     else if (equ(cmd, "start"))
         {
-        sdrStart(sdr);
+        //start [device [cpu]]
+        if (!p0)
+            sdrStart(sdr);
+        else
+            sdrStartDevice(sdr, atoi(p0), (p1) ? atoi(p1) : -1);
         }
     else if (equ(cmd, "stop"))
         {
-        sdrStop(sdr);
+        if (!p0)
+            sdrStop(sdr);
+        else
+            sdrStopDevice(sdr, atoi(p0));
+        }
+    else if (equ(cmd, "devices"))
+        {
+        int count = sdrGetDeviceCount(sdr);
+        for (i = 0 ; i < count ; i++)
+            trace("%c%d: %s", (i == sdrGetSelectedDevice(sdr)) ? '*' : ' ',
+                i, sdrGetDeviceName(sdr, i));
+        }
+    else if (equ(cmd, "device") || equ(cmd, "d"))
+        {
+        if (!p0)
+            trace("device: %d", sdrGetSelectedDevice(sdr));
+        else
+            sdrSelectDevice(sdr, atoi(p0));
         }
     else if (equ(cmd, "freq")||equ(cmd, "f"))
         {
@@ -183,6 +205,180 @@ int parseAndExecute(SdrLib *sdr, char *buf)
                 }
             }
         }
+    else if (equ(cmd, "mode") || equ(cmd, "m"))
+        {
+        //mode [null|am|fm|wfm|lsb|usb|sam|cw|fsk]
+        static char *modeNames[] = { "null", "am", "fm", "lsb", "usb", "wfm", "sam", "cw", "fsk" };
+        int nrModes = sizeof(modeNames) / sizeof(char *);
+        if (!p0)
+            {
+            int mode = sdrGetMode(sdr);
+            trace("mode: %s%s", modeNames[mode], sdrGetStereo(sdr) ? " (stereo)" : "");
+            }
+        else
+            {
+            for (i = 0 ; i < nrModes ; i++)
+                if (equ(p0, modeNames[i]))
+                    break;
+            if (i < nrModes)
+                sdrSetMode(sdr, (Mode)i);
+            else
+                error("Unknown mode:'%s'", p0);
+            }
+        }
+    else if (equ(cmd, "deemph"))
+        {
+        //deemph <microseconds>: 75 in the Americas, 50 elsewhere, 0 for none
+        float us;
+        if (p0 && getFloat(p0, &us))
+            sdrSetDeemphasis(sdr, us * 1.0e-6);
+        }
+    else if (equ(cmd, "sideband"))
+        {
+        //sideband [both|lower|upper], of mode sam
+        static char *sidebandNames[] = { "both", "lower", "upper" };
+        int nrSidebands = sizeof(sidebandNames) / sizeof(char *);
+        for (i = 0 ; p0 && i < nrSidebands ; i++)
+            if (equ(p0, sidebandNames[i]))
+                break;
+        if (p0 && i < nrSidebands)
+            sdrSetSamSideband(sdr, (Sideband)i);
+        else
+            error("sideband must be both, lower or upper");
+        }
+    else if (equ(cmd, "cw"))
+        {
+        //cw <bfo Hz> [width Hz], of mode cw
+        float bfo, width;
+        if (p0 && getFloat(p0, &bfo))
+            {
+            if (!p1 || !getFloat(p1, &width))
+                width = 500.0; //the default
+            sdrSetCw(sdr, bfo, width);
+            }
+        else
+            error("cw needs a bfo tone, and optionally a width");
+        }
+    else if (equ(cmd, "fsk"))
+        {
+        //fsk <shift Hz> <baud>, of mode fsk
+        float shift, baud;
+        if (p0 && p1 && getFloat(p0, &shift) && getFloat(p1, &baud))
+            sdrSetFsk(sdr, shift, baud);
+        else
+            error("fsk needs a shift and a baud rate");
+        }
+    else if (equ(cmd, "squelch") || equ(cmd, "sq"))
+        {
+        //squelch on|off, or squelch <power dB> [quieting dB] to set the levels and turn it on
+        float power, quieting;
+        if (!p0)
+            trace("squelch: %s", sdrGetSquelchOpen(sdr) ? "open" : "closed");
+        else if (equ(p0, "on"))
+            sdrSetSquelch(sdr, TRUE);
+        else if (equ(p0, "off"))
+            sdrSetSquelch(sdr, FALSE);
+        else if (getFloat(p0, &power))
+            {
+            if (!p1 || !getFloat(p1, &quieting))
+                quieting = 10.0; //the default
+            sdrSetSquelchLevels(sdr, power, quieting);
+            sdrSetSquelch(sdr, TRUE);
+            }
+        else
+            error("squelch must be on, off, or a level");
+        }
+    else if (equ(cmd, "latency"))
+        {
+        //latency [ms]: the longest block out of each stage.  0 for whole blocks
+        float ms;
+        if (!p0)
+            trace("latency: %.1f ms", sdrGetLatency(sdr) * 1000.0);
+        else if (getFloat(p0, &ms))
+            sdrSetLatency(sdr, ms * 0.001);
+        }
+    else if (equ(cmd, "agc"))
+        {
+        //agc on|off|fast|slow.  Fast and slow set the times, and turn it on
+        if (p0 && equ(p0, "on"))
+            sdrSetAgc(sdr, TRUE);
+        else if (p0 && equ(p0, "off"))
+            sdrSetAgc(sdr, FALSE);
+        else if (p0 && equ(p0, "fast"))
+            {
+            sdrSetAgcTimes(sdr, 0.002, 0.1, 0.1);
+            sdrSetAgc(sdr, TRUE);
+            }
+        else if (p0 && equ(p0, "slow"))
+            {
+            sdrSetAgcTimes(sdr, 0.002, 1.0, 0.5);
+            sdrSetAgc(sdr, TRUE);
+            }
+        else
+            error("agc must be on, off, fast or slow");
+        }
+    else if (equ(cmd, "lookahead"))
+        {
+        //lookahead <milliseconds> of the agc, 0 for none
+        float ms;
+        if (p0 && getFloat(p0, &ms))
+            sdrSetAgcLookahead(sdr, ms * 0.001);
+        }
+    else if (equ(cmd, "rds"))
+        {
+        RdsInfo info;
+        if (!sdrGetRds(sdr, &info))
+            error("RDS needs mode wfm");
+        else if (info.pi < 0)
+            trace("rds: nothing yet");
+        else
+            trace("rds: pi %04X ps '%s' rt '%s'", info.pi, info.ps, info.rt);
+        }
+    else if (equ(cmd, "sweep"))
+        {
+        //sweep <lo> <hi>, or sweep alone to stop
+        double lo, hi;
+        if (!p0 || !p1)
+            sdrStopSweep(sdr);
+        else if (getDouble(p0, &lo) && getDouble(p1, &hi))
+            sdrStartSweep(sdr, lo, hi);
+        }
+    else if (equ(cmd, "stats"))
+        {
+        //stats, stats json, or stats reset
+        SdrStats st;
+        if (p0 && equ(p0, "reset"))
+            sdrResetStats(sdr);
+        else if (p0 && equ(p0, "json"))
+            {
+            char json[8192];
+            if (sdrGetStatsJson(sdr, json, sizeof(json)) > 0)
+                trace("%s", json);
+            }
+        else if (sdrGetStats(sdr, &st))
+            {
+            DeviceStats *d = &(st.deviceStats);
+            trace("transfers:%llu samples:%llu drops:%llu (%llu samples) ring:%d/%d gaps:%llu",
+                d->transfers, d->samples, d->drops, d->droppedSamples,
+                d->maxFill, d->ringSize, d->gaps);
+            trace("audio queue:%d/%d overflows:%llu underflows:%llu  blocks in use:%d/%d",
+                st.audioQueued, st.audioQueueSize, st.audioOverflows, st.audioUnderflows,
+                st.blocksInUse, st.blocksTotal);
+            trace("latency ms  audio: p50 %.1f p99 %.1f max %.1f   codec: p50 %.1f p99 %.1f max %.1f",
+                st.audioLatency.p50, st.audioLatency.p99, st.audioLatency.max,
+                st.codecLatency.p50, st.codecLatency.p99, st.codecLatency.max);
+            for (i = 0 ; i < st.stageCount ; i++)
+                {
+                StageStats *s = &(st.stages[i]);
+                if (!s->samplesIn)
+                    continue;
+                double load = (st.elapsed > 0.0) ? s->nanos * 1.0e-7 / st.elapsed : 0.0;
+                trace("%-10s in:%llu out:%llu dropped:%llu  %.2f ns/sample  %.2f%%",
+                    s->name, s->samplesIn, s->samplesOut, s->dropped,
+                    (double)s->nanos / (double)s->samplesIn, load);
+                }
+            }
+        }
     else
         {
         error("Unimplemented command:'%s'", cmd);
@@ -192,11 +388,30 @@ int parseAndExecute(SdrLib *sdr, char *buf)
 }
 
 
+static void rdsOutput(RdsInfo *info, int changed, void *context)
+{
+    if (changed & RDS_PI)
+        trace("rds pi: %04X", info->pi);
+    if (changed & RDS_PS)
+        trace("rds ps: '%s'", info->ps);
+    if (changed & RDS_RT)
+        trace("rds rt: '%s'", info->rt);
+}
+
+
+static void keyOutput(int down, float seconds, void *context)
+{
+    trace("key %s after %.3f s", down ? "down" : "up", seconds);
+}
+
+
 int cmdloop()
 {
     SdrLib *sdr = sdrCreate(NULL, NULL, NULL);
     if (!sdr)
         return FALSE;
+    sdrSetRdsOutput(sdr, NULL, rdsOutput);
+    sdrSetKeyOutput(sdr, NULL, keyOutput);
     char *inbuf = (char *)malloc(BUFLEN+1);
     while (1)
         {
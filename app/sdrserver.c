@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 #include <unistd.h> //for getopt()
 #include <ctype.h>
 
@@ -59,9 +60,36 @@ struct SdrServer
 {
     SdrLib *sdr;
     WsServer *wsServer;
+    double statsInterval; //seconds between stats messages.  0 for none
+    double statsLast;
 };
 
 
+static double svrNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Send the stats as a text message, every statsInterval seconds
+ */
+static void svrSendStats(SdrServer *svr, WsHandler *ws)
+{
+    if (svr->statsInterval <= 0.0)
+        return;
+    double now = svrNow();
+    if (now - svr->statsLast < svr->statsInterval)
+        return;
+    svr->statsLast = now;
+    char json[8192];
+    if (sdrGetStatsJson(svr->sdr, json, sizeof(json)) > 0)
+        wsSend(ws, json);
+}
+
+
 static void codecOutput(unsigned char *dat, int len, void *context)
 {
     SdrServer *svr = (SdrServer *)context; 
@@ -69,23 +97,86 @@ static void codecOutput(unsigned char *dat, int len, void *context)
     if (ws)
         {
         wsSendBinary(ws, dat, len);
+        svrSendStats(svr, ws);
         } 
 }
 
 
-SdrServer *svrCreate()
+/**
+ * Append a string to a JSON message, quoted and escaped
+ */
+static int svrJsonString(char *buf, int len, int pos, char *str)
+{
+    if (pos < len)
+        buf[pos++] = '"';
+    for ( ; *str && pos < len - 2 ; str++)
+        {
+        if (*str == '"' || *str == '\\')
+            buf[pos++] = '\\';
+        buf[pos++] = *str;
+        }
+    if (pos < len)
+        buf[pos++] = '"';
+    return pos;
+}
+
+
+/**
+ * Send RDS to the client as a text message, as it changes:
+ *   {"rds":{"pi":"1234","ps":"...","rt":"..."}}
+ */
+static void rdsOutput(RdsInfo *info, int changed, void *context)
+{
+    SdrServer *svr = (SdrServer *)context; 
+    WsHandler *ws = wsGetClientWs(svr->wsServer);
+    if (!ws)
+        return;
+    char json[256];
+    int len = sizeof(json) - 4;
+    int pos = snprintf(json, len, "{\"rds\":{\"pi\":\"%04X\",\"ps\":", info->pi & 0xffff);
+    pos = svrJsonString(json, len, pos, info->ps);
+    pos += snprintf(json + pos, len - pos, ",\"rt\":");
+    pos = svrJsonString(json, len, pos, info->rt);
+    strcpy(json + pos, "}}");
+    wsSend(ws, json);
+}
+
+
+/**
+ * Send the Morse key to the client as it changes, with how long it was
+ * in the state it has left:
+ *   {"key":{"down":1,"seconds":0.120}}
+ */
+static void keyOutput(int down, float seconds, void *context)
+{
+    SdrServer *svr = (SdrServer *)context; 
+    WsHandler *ws = wsGetClientWs(svr->wsServer);
+    if (!ws)
+        return;
+    char json[64];
+    snprintf(json, sizeof(json), "{\"key\":{\"down\":%d,\"seconds\":%.3f}}", down ? 1 : 0, seconds);
+    wsSend(ws, json);
+}
+
+
+SdrServer *svrCreate(double statsInterval)
 {
     SdrServer *svr = (SdrServer *)malloc(sizeof(SdrServer));
     if (!svr)
         {
         return NULL;
         }
+    svr->wsServer      = NULL;
+    svr->statsInterval = statsInterval;
+    svr->statsLast     = 0.0;
     svr->sdr = sdrCreate(svr, NULL, codecOutput);  //TODO: important to supply these values
     if (!svr->sdr)
         {
         free(svr);
         return NULL;
         }
+    sdrSetRdsOutput(svr->sdr, svr, rdsOutput);
+    sdrSetKeyOutput(svr->sdr, svr, keyOutput);
     return svr;
 }
 
@@ -149,6 +240,7 @@ int parseAndExecute(SdrLib *sdr, char *buf)
     if (!cmd)
         return TRUE;
     char *p0 = strtok_r(NULL, delim, &ctx);
+    char *p1 = (p0) ? strtok_r(NULL, delim, &ctx) : NULL;
     
     if (equ(cmd, "exit")||equ(cmd, "quit")||equ(cmd, "q"))
         {
@@ -156,11 +248,32 @@ int parseAndExecute(SdrLib *sdr, char *buf)
         }
     else if (equ(cmd, "start"))
         {
-        sdrStart(sdr);
+        //start [device [cpu]]
+        if (!p0)
+            sdrStart(sdr);
+        else
+            sdrStartDevice(sdr, atoi(p0), (p1) ? atoi(p1) : -1);
         }
     else if (equ(cmd, "stop"))
         {
-        sdrStop(sdr);
+        if (!p0)
+            sdrStop(sdr);
+        else
+            sdrStopDevice(sdr, atoi(p0));
+        }
+    else if (equ(cmd, "devices"))
+        {
+        int count = sdrGetDeviceCount(sdr);
+        for (i = 0 ; i < count ; i++)
+            trace("%c%d: %s", (i == sdrGetSelectedDevice(sdr)) ? '*' : ' ',
+                i, sdrGetDeviceName(sdr, i));
+        }
+    else if (equ(cmd, "device") || equ(cmd, "d"))
+        {
+        if (!p0)
+            trace("device: %d", sdrGetSelectedDevice(sdr));
+        else
+            sdrSelectDevice(sdr, atoi(p0));
         }
     else if (equ(cmd, "freq")||equ(cmd, "f"))
         {
@@ -247,6 +360,180 @@ int parseAndExecute(SdrLib *sdr, char *buf)
                 }
             }
         }
+    else if (equ(cmd, "mode") || equ(cmd, "m"))
+        {
+        //mode [null|am|fm|wfm|lsb|usb|sam|cw|fsk]
+        static char *modeNames[] = { "null", "am", "fm", "lsb", "usb", "wfm", "sam", "cw", "fsk" };
+        int nrModes = sizeof(modeNames) / sizeof(char *);
+        if (!p0)
+            {
+            int mode = sdrGetMode(sdr);
+            trace("mode: %s%s", modeNames[mode], sdrGetStereo(sdr) ? " (stereo)" : "");
+            }
+        else
+            {
+            for (i = 0 ; i < nrModes ; i++)
+                if (equ(p0, modeNames[i]))
+                    break;
+            if (i < nrModes)
+                sdrSetMode(sdr, (Mode)i);
+            else
+                error("Unknown mode:'%s'", p0);
+            }
+        }
+    else if (equ(cmd, "deemph"))
+        {
+        //deemph <microseconds>: 75 in the Americas, 50 elsewhere, 0 for none
+        float us;
+        if (p0 && getFloat(p0, &us))
+            sdrSetDeemphasis(sdr, us * 1.0e-6);
+        }
+    else if (equ(cmd, "sideband"))
+        {
+        //sideband [both|lower|upper], of mode sam
+        static char *sidebandNames[] = { "both", "lower", "upper" };
+        int nrSidebands = sizeof(sidebandNames) / sizeof(char *);
+        for (i = 0 ; p0 && i < nrSidebands ; i++)
+            if (equ(p0, sidebandNames[i]))
+                break;
+        if (p0 && i < nrSidebands)
+            sdrSetSamSideband(sdr, (Sideband)i);
+        else
+            error("sideband must be both, lower or upper");
+        }
+    else if (equ(cmd, "cw"))
+        {
+        //cw <bfo Hz> [width Hz], of mode cw
+        float bfo, width;
+        if (p0 && getFloat(p0, &bfo))
+            {
+            if (!p1 || !getFloat(p1, &width))
+                width = 500.0; //the default
+            sdrSetCw(sdr, bfo, width);
+            }
+        else
+            error("cw needs a bfo tone, and optionally a width");
+        }
+    else if (equ(cmd, "fsk"))
+        {
+        //fsk <shift Hz> <baud>, of mode fsk
+        float shift, baud;
+        if (p0 && p1 && getFloat(p0, &shift) && getFloat(p1, &baud))
+            sdrSetFsk(sdr, shift, baud);
+        else
+            error("fsk needs a shift and a baud rate");
+        }
+    else if (equ(cmd, "squelch") || equ(cmd, "sq"))
+        {
+        //squelch on|off, or squelch <power dB> [quieting dB] to set the levels and turn it on
+        float power, quieting;
+        if (!p0)
+            trace("squelch: %s", sdrGetSquelchOpen(sdr) ? "open" : "closed");
+        else if (equ(p0, "on"))
+            sdrSetSquelch(sdr, TRUE);
+        else if (equ(p0, "off"))
+            sdrSetSquelch(sdr, FALSE);
+        else if (getFloat(p0, &power))
+            {
+            if (!p1 || !getFloat(p1, &quieting))
+                quieting = 10.0; //the default
+            sdrSetSquelchLevels(sdr, power, quieting);
+            sdrSetSquelch(sdr, TRUE);
+            }
+        else
+            error("squelch must be on, off, or a level");
+        }
+    else if (equ(cmd, "latency"))
+        {
+        //latency [ms]: the longest block out of each stage.  0 for whole blocks
+        float ms;
+        if (!p0)
+            trace("latency: %.1f ms", sdrGetLatency(sdr) * 1000.0);
+        else if (getFloat(p0, &ms))
+            sdrSetLatency(sdr, ms * 0.001);
+        }
+    else if (equ(cmd, "agc"))
+        {
+        //agc on|off|fast|slow.  Fast and slow set the times, and turn it on
+        if (p0 && equ(p0, "on"))
+            sdrSetAgc(sdr, TRUE);
+        else if (p0 && equ(p0, "off"))
+            sdrSetAgc(sdr, FALSE);
+        else if (p0 && equ(p0, "fast"))
+            {
+            sdrSetAgcTimes(sdr, 0.002, 0.1, 0.1);
+            sdrSetAgc(sdr, TRUE);
+            }
+        else if (p0 && equ(p0, "slow"))
+            {
+            sdrSetAgcTimes(sdr, 0.002, 1.0, 0.5);
+            sdrSetAgc(sdr, TRUE);
+            }
+        else
+            error("agc must be on, off, fast or slow");
+        }
+    else if (equ(cmd, "lookahead"))
+        {
+        //lookahead <milliseconds> of the agc, 0 for none
+        float ms;
+        if (p0 && getFloat(p0, &ms))
+            sdrSetAgcLookahead(sdr, ms * 0.001);
+        }
+    else if (equ(cmd, "rds"))
+        {
+        RdsInfo info;
+        if (!sdrGetRds(sdr, &info))
+            error("RDS needs mode wfm");
+        else if (info.pi < 0)
+            trace("rds: nothing yet");
+        else
+            trace("rds: pi %04X ps '%s' rt '%s'", info.pi, info.ps, info.rt);
+        }
+    else if (equ(cmd, "sweep"))
+        {
+        //sweep <lo> <hi>, or sweep alone to stop
+        double lo, hi;
+        if (!p0 || !p1)
+            sdrStopSweep(sdr);
+        else if (getDouble(p0, &lo) && getDouble(p1, &hi))
+            sdrStartSweep(sdr, lo, hi);
+        }
+    else if (equ(cmd, "stats"))
+        {
+        //stats, stats json, or stats reset
+        SdrStats st;
+        if (p0 && equ(p0, "reset"))
+            sdrResetStats(sdr);
+        else if (p0 && equ(p0, "json"))
+            {
+            char json[8192];
+            if (sdrGetStatsJson(sdr, json, sizeof(json)) > 0)
+                trace("%s", json);
+            }
+        else if (sdrGetStats(sdr, &st))
+            {
+            DeviceStats *d = &(st.deviceStats);
+            trace("transfers:%llu samples:%llu drops:%llu (%llu samples) ring:%d/%d gaps:%llu",
+                d->transfers, d->samples, d->drops, d->droppedSamples,
+                d->maxFill, d->ringSize, d->gaps);
+            trace("audio queue:%d/%d overflows:%llu underflows:%llu  blocks in use:%d/%d",
+                st.audioQueued, st.audioQueueSize, st.audioOverflows, st.audioUnderflows,
+                st.blocksInUse, st.blocksTotal);
+            trace("latency ms  audio: p50 %.1f p99 %.1f max %.1f   codec: p50 %.1f p99 %.1f max %.1f",
+                st.audioLatency.p50, st.audioLatency.p99, st.audioLatency.max,
+                st.codecLatency.p50, st.codecLatency.p99, st.codecLatency.max);
+            for (i = 0 ; i < st.stageCount ; i++)
+                {
+                StageStats *s = &(st.stages[i]);
+                if (!s->samplesIn)
+                    continue;
+                double load = (st.elapsed > 0.0) ? s->nanos * 1.0e-7 / st.elapsed : 0.0;
+                trace("%-10s in:%llu out:%llu dropped:%llu  %.2f ns/sample  %.2f%%",
+                    s->name, s->samplesIn, s->samplesOut, s->dropped,
+                    (double)s->nanos / (double)s->samplesIn, load);
+                }
+            }
+        }
     else
         {
         error("Unimplemented command:'%s'", cmd);
@@ -293,9 +580,9 @@ static void onError(WsHandler *ws, char *msg)
 
 
 
-static int doRun(char *dir, int port)
+static int doRun(char *dir, int port, double statsInterval)
 {
-    SdrServer *ctx = svrCreate();
+    SdrServer *ctx = svrCreate(statsInterval);
     if (!ctx)
         {
         return FALSE;
@@ -324,7 +611,8 @@ static void usage(char *progname)
         "Usage: %s { options }\n"
         "    where options are:\n"
         "-d <root_directory>\n"
-        "-p <port_number>\n";
+        "-p <port_number>\n"
+        "-s <seconds between stats messages to the client>\n";
 
     fprintf(stderr, msg, progname);
 }
@@ -334,8 +622,9 @@ int main(int argc, char **argv)
 {
     char *dir = ".";
     int port = 8888;
+    double statsInterval = 0.0;
     int c;
-    while ((c = getopt (argc, argv, "d:p:")) != -1)
+    while ((c = getopt (argc, argv, "d:p:s:")) != -1)
         {
         switch (c)
             {
@@ -345,12 +634,15 @@ int main(int argc, char **argv)
             case 'p':
                 port = atoi(optarg);
                 break;
+            case 's':
+                statsInterval = atof(optarg);
+                break;
             default:
                 usage(argv[0]);
                 return -1;
             }
         }
-    if (doRun(dir, port))
+    if (doRun(dir, port, statsInterval))
         return 0;
     else
         return -1;
@@ -0,0 +1,687 @@
+/**
+ * Microbenchmarks for the speedy parts.  Each DSP kernel is timed over
+ * blocks of several sizes, giving ns/sample, Msps and cycles/sample.
+ * With -j the results are printed as JSON, to be kept and compared
+ * from one commit to the next.
+ * 
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <complex.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HAVE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "agc.h"
+#include "codec.h"
+#include "demod.h"
+#include "fft.h"
+#include "filter.h"
+#include "frontend.h"
+#include "rds.h"
+#include "samplerate.h"
+#include "squelch.h"
+#include "stereo.h"
+#include "private.h"
+
+
+/**
+ * One rtl-sdr USB transfer: 262144 bytes, 131072 complex samples
+ */
+#define TRANSFER_SAMPLES (16 * 32 * 512 / 2)
+
+/**
+ * Block sizes each kernel is run at.  The largest is one transfer.
+ */
+static int sizes[] = { 512, 16384, TRANSFER_SAMPLES, 0 };
+
+/**
+ * Each measurement is repeated until it takes at least this long
+ */
+#define MIN_SECONDS 0.25
+
+
+static double minSeconds = MIN_SECONDS;
+static char   *only      = NULL;  //run only kernels whose names contain this
+static int    json       = FALSE;
+static int    results    = 0;
+
+//inputs, filled once
+static float complex *cpxIn;
+static float         *floatIn;
+static unsigned char *byteIn;
+static float complex *cpxOut;
+static float         *floatOut;
+
+//outputs are summed here, so that the work cannot be optimized away
+static volatile float sink;
+
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * Reference cycles from the time stamp counter.  These tick at a constant
+ * rate, the nominal clock, whatever the core is actually running at.
+ */
+static unsigned long long cycles()
+{
+#if HAVE_TSC
+    return (unsigned long long)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static void reportStart()
+{
+    if (json)
+        {
+        printf("{\n");
+        printf("  \"minSeconds\": %g,\n", minSeconds);
+        printf("  \"cycles\": \"%s\",\n", HAVE_TSC ? "tsc" : "none");
+        printf("  \"results\": [");
+        }
+    else
+        {
+        printf("%-24s %8s %12s %10s %10s %14s\n",
+            "kernel", "size", "us/block", "ns/sample", "Msps", "cycles/sample");
+        }
+}
+
+
+static void reportEnd()
+{
+    if (json)
+        printf("\n  ]\n}\n");
+}
+
+
+static void report(char *name, int size, double seconds, unsigned long long cyc, long iterations)
+{
+    double perIter  = seconds / (double)iterations;
+    double nanos    = perIter * 1.0e9 / size;
+    double msps     = (double)size / perIter / 1.0e6;
+    double perSample = (double)cyc / (double)iterations / size;
+    if (json)
+        {
+        printf("%s\n    { \"name\": \"%s\", \"size\": %d, \"iterations\": %ld, "
+               "\"nsPerSample\": %.4f, \"msps\": %.3f, \"cyclesPerSample\": ",
+               results ? "," : "", name, size, iterations, nanos, msps);
+        if (HAVE_TSC)
+            printf("%.3f }", perSample);
+        else
+            printf("null }");
+        }
+    else
+        {
+        printf("%-24s %8d %12.1f %10.2f %10.1f ", name, size, perIter * 1.0e6, nanos, msps);
+        if (HAVE_TSC)
+            printf("%14.2f\n", perSample);
+        else
+            printf("%14s\n", "-");
+        }
+    fflush(stdout);
+    results++;
+}
+
+
+
+/*############################################################################
+## H A R N E S S
+############################################################################*/
+
+/**
+ * Process 'size' samples of the inputs with the object
+ */
+typedef void KernelFunc(void *obj, int size);
+
+
+static int selected(char *name)
+{
+    return !only || strstr(name, only);
+}
+
+
+/**
+ * Time the kernel at one size, doubling the iterations until the
+ * run is long enough to trust
+ */
+static void measure(char *name, KernelFunc *func, void *obj, int size)
+{
+    func(obj, size); //warm up the caches and the object's state
+    long iterations = 1;
+    while (1)
+        {
+        double start = now();
+        unsigned long long c0 = cycles();
+        for (long i = 0 ; i < iterations ; i++)
+            func(obj, size);
+        unsigned long long cyc = cycles() - c0;
+        double seconds = now() - start;
+        if (seconds >= minSeconds || iterations >= (1L << 30))
+            {
+            report(name, size, seconds, cyc, iterations);
+            return;
+            }
+        iterations *= 2;
+        }
+}
+
+
+static void run(char *name, KernelFunc *func, void *obj)
+{
+    if (!selected(name))
+        return;
+    for (int *sz = sizes ; *sz ; sz++)
+        measure(name, func, obj, *sz);
+}
+
+
+static void complexSink(float complex *data, int size, void *ctx)
+{
+    sink += crealf(data[0]) + crealf(data[size-1]);
+}
+
+static void floatSink(float *data, int size, void *ctx)
+{
+    sink += data[0] + data[size-1];
+}
+
+static void uintSink(unsigned int *data, int size, void *ctx)
+{
+    sink += (float)(data[0] + data[size-1]);
+}
+
+static void byteSink(unsigned char *data, int size, void *ctx)
+{
+    sink += (float)(data[0] + data[size-1]);
+}
+
+static void silenceSink(int size, void *ctx)
+{
+    sink += (float)size;
+}
+
+
+static int inputsCreate()
+{
+    cpxIn    = (float complex *)smalloc(TRANSFER_SAMPLES * sizeof(float complex));
+    floatIn  = (float *)smalloc(TRANSFER_SAMPLES * sizeof(float));
+    byteIn   = (unsigned char *)smalloc(TRANSFER_SAMPLES * 2);
+    cpxOut   = (float complex *)smalloc(TRANSFER_SAMPLES * sizeof(float complex));
+    floatOut = (float *)smalloc(TRANSFER_SAMPLES * sizeof(float));
+    if (!cpxIn || !floatIn || !byteIn || !cpxOut || !floatOut)
+        return FALSE;
+    srand(1);
+    for (int i = 0 ; i < TRANSFER_SAMPLES * 2 ; i++)
+        byteIn[i] = (unsigned char)(rand() & 0xff);
+    //a tone in noise, so the demodulators see something like a signal
+    for (int i = 0 ; i < TRANSFER_SAMPLES ; i++)
+        {
+        float noise = (float)rand() / (float)RAND_MAX - 0.5f;
+        float complex v = 0.5f * cexpf(I * 0.01f * (float)i) + 0.1f * noise;
+        cpxIn[i]   = v;
+        floatIn[i] = crealf(v);
+        }
+    return TRUE;
+}
+
+
+static void inputsDelete()
+{
+    free(cpxIn);
+    free(floatIn);
+    free(byteIn);
+    free(cpxOut);
+    free(floatOut);
+}
+
+
+
+/*############################################################################
+## F I L T E R S
+############################################################################*/
+
+
+static void k_firUpdate(void *obj, int size)
+{
+    Fir *fir = (Fir *)obj;
+    for (int i = 0 ; i < size ; i++)
+        floatOut[i] = firUpdate(fir, floatIn[i]);
+    sink += floatOut[size-1];
+}
+
+
+static void k_firUpdateC(void *obj, int size)
+{
+    Fir *fir = (Fir *)obj;
+    for (int i = 0 ; i < size ; i++)
+        cpxOut[i] = firUpdateC(fir, cpxIn[i]);
+    sink += crealf(cpxOut[size-1]);
+}
+
+
+static void k_biquadUpdate(void *obj, int size)
+{
+    Biquad *bq = (Biquad *)obj;
+    for (int i = 0 ; i < size ; i++)
+        floatOut[i] = biquadUpdate(bq, floatIn[i]);
+    sink += floatOut[size-1];
+}
+
+
+static void k_biquadUpdateC(void *obj, int size)
+{
+    Biquad *bq = (Biquad *)obj;
+    for (int i = 0 ; i < size ; i++)
+        cpxOut[i] = biquadUpdateC(bq, cpxIn[i]);
+    sink += crealf(cpxOut[size-1]);
+}
+
+
+static int bench_filters()
+{
+    int taps[] = { 21, 127, 0 };
+    for (int *t = taps ; *t ; t++)
+        {
+        char name[32];
+        Fir *fir = firLP(*t, 5000.0, 48000.0, W_HAMMING);
+        if (!fir)
+            return FALSE;
+        snprintf(name, sizeof(name), "firUpdate/%d", *t);
+        run(name, k_firUpdate, fir);
+        snprintf(name, sizeof(name), "firUpdateC/%d", *t);
+        run(name, k_firUpdateC, fir);
+        firDelete(fir);
+        }
+
+    Biquad *bq = biquadLP(5000.0, 48000.0, 0.707);
+    if (!bq)
+        return FALSE;
+    run("biquadUpdate", k_biquadUpdate, bq);
+    run("biquadUpdateC", k_biquadUpdateC, bq);
+    biquadDelete(bq);
+    return TRUE;
+}
+
+
+
+/*############################################################################
+## S A M P L E    R A T E
+############################################################################*/
+
+
+static void k_decimatorUpdate(void *obj, int size)
+{
+    decimatorUpdate((Decimator *)obj, cpxIn, size, complexSink, NULL);
+}
+
+
+static void k_ddcUpdate(void *obj, int size)
+{
+    ddcUpdate((Ddc *)obj, cpxIn, size, complexSink, NULL);
+}
+
+
+static void k_resamplerUpdate(void *obj, int size)
+{
+    resamplerUpdate((Resampler *)obj, floatIn, size, floatSink, NULL);
+}
+
+
+static void k_resamplerUpdateC(void *obj, int size)
+{
+    resamplerUpdateC((Resampler *)obj, cpxIn, size, complexSink, NULL);
+}
+
+
+static int bench_samplerate()
+{
+    //the rates are those of the receiver
+    Decimator *dec = decimatorCreate(21, 2048000.0, 256000.0);
+    Ddc *ddc = ddcCreate(21, 100000.0, -5000.0, 5000.0, 2048000.0);
+    Resampler *res = resamplerCreate(21, 48000.0, 44100.0);
+    int ret = (dec && ddc && res);
+    if (ret)
+        {
+        run("decimatorUpdate", k_decimatorUpdate, dec);
+        run("ddcUpdate", k_ddcUpdate, ddc);
+        run("resamplerUpdate", k_resamplerUpdate, res);
+        run("resamplerUpdateC", k_resamplerUpdateC, res);
+        }
+    if (dec)
+        decimatorDelete(dec);
+    if (ddc)
+        ddcDelete(ddc);
+    if (res)
+        resamplerDelete(res);
+    return ret;
+}
+
+
+
+/*############################################################################
+## D E M O D U L A T O R S
+############################################################################*/
+
+
+static void k_demod(void *obj, int size)
+{
+    Demodulator *dem = (Demodulator *)obj;
+    dem->update(dem, cpxIn, size, floatSink, NULL);
+}
+
+
+static void k_agcUpdate(void *obj, int size)
+{
+    agcUpdate((Agc *)obj, floatIn, size, floatSink, NULL);
+}
+
+
+static void k_squelchUpdate(void *obj, int size)
+{
+    squelchUpdate((Squelch *)obj, floatIn, size, floatSink, silenceSink, NULL);
+}
+
+
+static void k_stereoUpdate(void *obj, int size)
+{
+    stereoUpdate((Stereo *)obj, floatIn, size, complexSink, NULL);
+}
+
+
+static void k_rdsUpdate(void *obj, int size)
+{
+    rdsUpdate((Rds *)obj, floatIn, size, NULL, NULL);
+}
+
+
+static int bench_demod()
+{
+    struct
+    {
+        char *name;
+        Demodulator *(*create)();
+    } demods[] =
+    {
+        { "demodAm",  demodAmCreate  },
+        { "demodFm",  demodFmCreate  },
+        { "demodLsb", demodLsbCreate },
+        { "demodUsb", demodUsbCreate },
+        { "demodSam", demodSamCreate },
+        { "demodCw",  demodCwCreate  },
+        { "demodFsk", demodFskCreate },
+        { NULL,       NULL           }
+    };
+    for (int i = 0 ; demods[i].name ; i++)
+        {
+        if (!selected(demods[i].name))
+            continue;
+        Demodulator *dem = demods[i].create();
+        if (!dem)
+            return FALSE;
+        run(demods[i].name, k_demod, dem);
+        demodDelete(dem);
+        }
+    if (selected("agcUpdate"))
+        {
+        Agc *agc = agcCreate(48000.0);
+        if (!agc)
+            return FALSE;
+        run("agcUpdate", k_agcUpdate, agc);
+        agcDelete(agc);
+        }
+    if (selected("squelchUpdate"))
+        {
+        Squelch *sq = squelchCreate(48000.0);
+        if (!sq)
+            return FALSE;
+        run("squelchUpdate", k_squelchUpdate, sq);
+        squelchSetType(sq, SQUELCH_NOISE);
+        run("squelchUpdateNoise", k_squelchUpdate, sq);
+        squelchDelete(sq);
+        }
+    if (selected("stereoUpdate"))
+        {
+        Stereo *st = stereoCreate(256000.0);
+        if (!st)
+            return FALSE;
+        run("stereoUpdate", k_stereoUpdate, st);
+        stereoDelete(st);
+        }
+    if (selected("rdsUpdate"))
+        {
+        Rds *rds = rdsCreate(256000.0);
+        if (!rds)
+            return FALSE;
+        run("rdsUpdate", k_rdsUpdate, rds);
+        rdsDelete(rds);
+        }
+    return TRUE;
+}
+
+
+
+/*############################################################################
+## F F T    A N D    C O D E C
+############################################################################*/
+
+
+static void k_fftUpdate(void *obj, int size)
+{
+    fftUpdate((Fft *)obj, cpxIn, size, uintSink, NULL);
+}
+
+
+static void k_fftUpdateBytes(void *obj, int size)
+{
+    fftUpdateBytes((Fft *)obj, byteIn, size, uintSink, NULL);
+}
+
+
+static void k_codecEncode(void *obj, int size)
+{
+    codecEncode((Codec *)obj, floatIn, size, byteSink, NULL);
+}
+
+
+static int bench_fft()
+{
+    if (!selected("fftUpdate"))
+        return TRUE;
+    Fft *fft = fftCreate(16384); //as in the receiver
+    if (!fft)
+        return FALSE;
+    run("fftUpdate", k_fftUpdate, fft);
+    run("fftUpdateBytes", k_fftUpdateBytes, fft);
+    fftDelete(fft);
+    return TRUE;
+}
+
+
+static int bench_codec()
+{
+    if (!selected("codecEncode"))
+        return TRUE;
+    Codec *codec = codecCreate();
+    if (!codec)
+        return FALSE;
+    run("codecEncode", k_codecEncode, codec);
+    codecDelete(codec);
+    return TRUE;
+}
+
+
+
+/*############################################################################
+## C O N V E R S I O N
+############################################################################*/
+
+
+static float complex *lut;
+
+/**
+ * The old way, for comparison: a 64k-entry table indexed by both bytes
+ */
+static void convertLut(float complex *lut, unsigned char *b, float complex *cpx, int count)
+{
+    while (count--)
+        {
+        int hi = (int)*b++;
+        int lo = (int)*b++;
+        *cpx++ = lut[(hi<<8) + lo];
+        }
+}
+
+
+static void k_convertLut(void *obj, int size)
+{
+    convertLut(lut, byteIn, cpxOut, size);
+    sink += crealf(cpxOut[size-1]);
+}
+
+
+static void k_frontendConvert(void *obj, int size)
+{
+    frontendConvert(byteIn, cpxOut, size);
+    sink += crealf(cpxOut[size-1]);
+}
+
+
+static void k_frontendUpdate(void *obj, int size)
+{
+    frontendUpdate((Frontend *)obj, byteIn, size, complexSink, NULL);
+}
+
+
+static int bench_convert()
+{
+    lut = (float complex *)smalloc(256 * 256 * sizeof(float complex));
+    if (!lut)
+        return FALSE;
+    for (int hi = 0 ; hi < 256 ; hi++)
+        for (int lo = 0 ; lo < 256 ; lo++)
+            lut[(hi<<8) + lo] = (hi - 127.5) / 128.0 + (lo - 127.5) / 128.0 * I;
+
+    run("convert/lut64k", k_convertLut, NULL);
+    run("frontendConvert", k_frontendConvert, NULL);
+
+    Frontend *fe = frontendCreate(3);
+    if (!fe)
+        {
+        free(lut);
+        return FALSE;
+        }
+    run("frontendUpdate/3", k_frontendUpdate, fe);
+    frontendDelete(fe);
+
+    //make sure both conversions agree
+    float complex *check = (float complex *)smalloc(TRANSFER_SAMPLES * sizeof(float complex));
+    int ret = (check != NULL);
+    if (ret)
+        {
+        convertLut(lut, byteIn, check, TRANSFER_SAMPLES);
+        frontendConvert(byteIn, cpxOut, TRANSFER_SAMPLES);
+        ret = (memcmp(check, cpxOut, TRANSFER_SAMPLES * sizeof(float complex)) == 0);
+        if (!ret)
+            error("convert: results differ");
+        }
+
+    free(check);
+    free(lut);
+    return ret;
+}
+
+
+
+/*############################################################################
+## M A I N
+############################################################################*/
+
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-j] [-t seconds] [-k kernel]\n", prog);
+    fprintf(stderr, "    -j          print the results as JSON\n");
+    fprintf(stderr, "    -t seconds  minimum time of each measurement (%g)\n", MIN_SECONDS);
+    fprintf(stderr, "    -k kernel   run only kernels whose names contain this\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    for (int i = 1 ; i < argc ; i++)
+        {
+        char *arg = argv[i];
+        if (strcmp(arg, "-j") == 0)
+            json = TRUE;
+        else if (strcmp(arg, "-t") == 0 && i + 1 < argc)
+            minSeconds = atof(argv[++i]);
+        else if (strcmp(arg, "-k") == 0 && i + 1 < argc)
+            only = argv[++i];
+        else
+            {
+            usage(argv[0]);
+            return 1;
+            }
+        }
+
+    if (!inputsCreate())
+        {
+        error("cannot allocate inputs");
+        return 1;
+        }
+
+    int ret = TRUE;
+    reportStart();
+    ret &= bench_filters();
+    ret &= bench_samplerate();
+    ret &= bench_demod();
+    ret &= bench_fft();
+    ret &= bench_codec();
+    ret &= bench_convert();
+    reportEnd();
+
+    inputsDelete();
+    return ret ? 0 : 1;
+}
+
@@ -0,0 +1,657 @@
+/**
+ * Replays recorded IQ files, so that the rest of the library can
+ * be run and measured without any hardware.
+ *
+ * Since plugins are created without arguments, it is configured
+ * from the environment.  If SDRLIB_FILE is not set, no device is
+ * created.
+ *
+ *   SDRLIB_FILE           file to play.  Either raw samples, or a SigMF
+ *                         .sigmf-meta / .sigmf-data file
+ *   SDRLIB_FILE_FORMAT    cu8, cs8 or cf32.  Default is from SigMF metadata
+ *                         or the file extension, else cu8 (as from rtl_sdr)
+ *   SDRLIB_FILE_RATE      sample rate.  Default from SigMF, else 2048000
+ *   SDRLIB_FILE_REALTIME  1 to play at the sample rate (default), 0 to
+ *                         deliver samples as fast as they are consumed
+ *   SDRLIB_FILE_LOOP      1 to start over at the end, 0 (default) to close
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <complex.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "device.h"
+#include "frontend.h"
+#include "json.h"
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+
+/**
+ * Same block size as the rtl-sdr plugin, so results are comparable
+ */
+#define BUFSIZE (16 * 32 * 512 / 2)
+
+#define DEFAULT_RATE 2048000.0
+
+
+typedef enum
+{
+    FILE_NONE,
+    FILE_CU8,  //unsigned 8-bit I,Q
+    FILE_CS8,  //signed 8-bit I,Q
+    FILE_CF32  //little-endian float I,Q
+} FileFormat;
+
+
+typedef struct
+{
+    Parent *par;
+    char   *fileName;      //the samples
+    int    fileFormat;
+    int    bytesPerSample; //per complex sample
+    int    realtime;
+    int    loop;
+    float  rate;
+    double freq;
+    float  gain;
+    int    format;         //SampleFormat requested by the reader
+    int    isOpen;
+    int    atEnd;
+    unsigned char *map;    //the whole file
+    long long mapSize;
+    long long nrSamples;
+    long long pos;         //next sample in the file
+    unsigned long long seq;
+    int    peekSize;       //size of the block lent out by readPeek
+    int    blockSize;      //requested with setBlockSize(), 0 for BUFSIZE
+    double startTime;
+    void   *scratch;       //for formats that need converting
+    DeviceStats stats;
+} Context;
+
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+static void sleepFor(double seconds)
+{
+    if (seconds <= 0.0)
+        return;
+    struct timespec ts;
+    ts.tv_sec  = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1.0e9);
+    nanosleep(&ts, NULL);
+}
+
+
+static int envInt(char *name, int defaultValue)
+{
+    char *val = getenv(name);
+    return (val && *val) ? atoi(val) : defaultValue;
+}
+
+
+static int endsWith(char *str, char *suffix)
+{
+    int len  = strlen(str);
+    int slen = strlen(suffix);
+    return (len >= slen && strcmp(str + len - slen, suffix) == 0);
+}
+
+
+static int parseFormat(char *name)
+{
+    if (strcmp(name, "cu8") == 0 || strcmp(name, "u8") == 0)
+        return FILE_CU8;
+    else if (strcmp(name, "cs8") == 0 || strcmp(name, "ci8") == 0 || strcmp(name, "s8") == 0)
+        return FILE_CS8;
+    else if (strcmp(name, "cf32") == 0 || strcmp(name, "cf32_le") == 0 || strcmp(name, "fc32") == 0)
+        return FILE_CF32;
+    return FILE_NONE;
+}
+
+
+
+/*############################################################################
+## F I L E S
+############################################################################*/
+
+
+#ifdef _WIN32
+
+static unsigned char *mapFile(char *fileName, long long *size)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = (unsigned char *)malloc(len + 1);
+    if (buf && fread(buf, 1, len, f) != (size_t)len)
+        {
+        free(buf);
+        buf = NULL;
+        }
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+static void unmapFile(unsigned char *map, long long size)
+{
+    free(map);
+}
+
+#else
+
+static unsigned char *mapFile(char *fileName, long long *size)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0)
+        {
+        close(fd);
+        return NULL;
+        }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+#ifdef MADV_SEQUENTIAL
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+    *size = st.st_size;
+    return (unsigned char *)map;
+}
+
+static void unmapFile(unsigned char *map, long long size)
+{
+    munmap(map, size);
+}
+
+#endif
+
+
+/**
+ * Read the parts of a SigMF metadata file that we need
+ */
+static int readSigmf(Context *ctx, char *metaName)
+{
+    long long len;
+    unsigned char *buf = mapFile(metaName, &len);
+    if (!buf)
+        {
+        ctx->par->error("Cannot read SigMF metadata '%s'", metaName);
+        return FALSE;
+        }
+    JsonVal *js = jsonParse((char *)buf, (int)len);
+    unmapFile(buf, len);
+    if (!js)
+        {
+        ctx->par->error("Cannot parse SigMF metadata '%s'", metaName);
+        return FALSE;
+        }
+    int ret = FALSE;
+    JsonVal *global = jsonObjGet(js, "global");
+    JsonVal *type   = (global) ? jsonObjGet(global, "core:datatype") : NULL;
+    if (!type || type->type != JsonStr)
+        ctx->par->error("SigMF metadata has no core:datatype");
+    else if (!(ctx->fileFormat = parseFormat(type->value.s)))
+        ctx->par->error("Unsupported SigMF datatype '%s'", type->value.s);
+    else
+        {
+        JsonVal *rate = jsonObjGet(global, "core:sample_rate");
+        if (rate && rate->type == JsonInt)
+            ctx->rate = (float)rate->value.i;
+        else if (rate && rate->type == JsonFloat)
+            ctx->rate = rate->value.f;
+        JsonVal *captures = jsonObjGet(js, "captures");
+        if (captures && captures->type == JsonArr && captures->value.a)
+            {
+            JsonVal *freq = jsonObjGet(captures->value.a->value, "core:frequency");
+            if (freq && freq->type == JsonInt)
+                ctx->freq = (double)freq->value.i;
+            else if (freq && freq->type == JsonFloat)
+                ctx->freq = freq->value.f;
+            }
+        ret = TRUE;
+        }
+    jsonDelete(js);
+    return ret;
+}
+
+
+
+/*############################################################################
+## D E V I C E
+############################################################################*/
+
+
+static int setGain(void *context, float gain)
+{
+    Context *ctx = (Context *)context;
+    ctx->gain = gain;
+    return TRUE;
+}
+
+static float getGain(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->gain;
+}
+
+/**
+ * Changing the rate only changes the playback speed in realtime mode
+ */
+static int setSampleRate(void *context, float rate)
+{
+    Context *ctx = (Context *)context;
+    if (rate <= 0.0)
+        return FALSE;
+    ctx->startTime += (double)ctx->seq / ctx->rate - (double)ctx->seq / rate;
+    ctx->rate = rate;
+    return TRUE;
+}
+
+static float getSampleRate(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->rate;
+}
+
+static int setCenterFrequency(void *context, double freq)
+{
+    Context *ctx = (Context *)context;
+    ctx->freq = freq;
+    return TRUE;
+}
+
+static double getCenterFrequency(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->freq;
+}
+
+
+/**
+ * Size of the next block, before the end of the file cuts it short
+ */
+static int nextSize(Context *ctx)
+{
+    int size = ctx->blockSize;
+    return (size <= 0 || size > BUFSIZE) ? BUFSIZE : size;
+}
+
+
+/**
+ * Seconds until the next block is due, in realtime mode
+ */
+static double timeToNext(Context *ctx)
+{
+    if (!ctx->realtime)
+        return 0.0;
+    double due = ctx->startTime + (double)(ctx->seq + nextSize(ctx)) / ctx->rate;
+    return due - now();
+}
+
+
+/**
+ * In realtime mode, when the first sample of the next block would have
+ * been captured.  Otherwise, now.
+ */
+static unsigned long long captureTime(Context *ctx)
+{
+    double t = (ctx->realtime) ? ctx->startTime + (double)ctx->seq / ctx->rate : now();
+    return (unsigned long long)(t * 1.0e9);
+}
+
+
+static int readPeek(void *context, DeviceBlock *block)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen || ctx->atEnd)
+        return FALSE;
+    if (ctx->pos >= ctx->nrSamples)
+        {
+        if (!ctx->loop)
+            {
+            ctx->par->trace("End of file '%s'", ctx->fileName);
+            ctx->atEnd = TRUE;
+            return FALSE;
+            }
+        ctx->pos = 0;
+        }
+    if (timeToNext(ctx) > 0.0)
+        return FALSE;
+    long long avail = ctx->nrSamples - ctx->pos;
+    int size = nextSize(ctx);
+    if (avail < size)
+        size = (int)avail;
+    unsigned char *src = ctx->map + ctx->pos * ctx->bytesPerSample;
+    block->data  = NULL;
+    block->bytes = NULL;
+    if (ctx->fileFormat == FILE_CF32)
+        {
+        block->data = (float complex *)src;
+        }
+    else if (ctx->fileFormat == FILE_CU8 && ctx->format == SAMPLE_U8)
+        {
+        block->bytes = src;
+        }
+    else if (ctx->fileFormat == FILE_CU8)
+        {
+        block->data = (float complex *)ctx->scratch;
+        frontendConvert(src, block->data, size);
+        }
+    else
+        {
+        //signed samples are centered on 0, not 127.5 as the frontend's are
+        float *out = (float *)ctx->scratch;
+        signed char *in = (signed char *)src;
+        int n = size * 2;
+        while (n--)
+            *out++ = (float)(*in++) / 128.0;
+        block->data = (float complex *)ctx->scratch;
+        }
+    block->size = size;
+    block->seq  = ctx->seq;
+    block->time = captureTime(ctx);
+    ctx->peekSize = size;
+    return TRUE;
+}
+
+
+static int readRelease(void *context)
+{
+    Context *ctx = (Context *)context;
+    int size = ctx->peekSize;
+    ctx->pos += size;
+    ctx->seq += size;
+    ctx->stats.transfers++;
+    ctx->stats.samples += size;
+    ctx->peekSize = 0;
+    return TRUE;
+}
+
+
+static int readWait(void *context, int timeoutMs)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen || ctx->atEnd)
+        return FALSE;
+    double wait = timeToNext(ctx);
+    double timeout = (double)timeoutMs / 1000.0;
+    if (wait > timeout)
+        {
+        sleepFor(timeout);
+        return FALSE;
+        }
+    sleepFor(wait);
+    return TRUE;
+}
+
+
+/**
+ * The vtable functions that share names with POSIX calls are prefixed,
+ * since this file needs the real ones for mapping.
+ */
+static int devRead(void *context, float complex *buf, int buflen)
+{
+    Context *ctx = (Context *)context;
+    if (buflen < BUFSIZE)
+        {
+        ctx->par->error("buflen param is too small");
+        return 0;
+        }
+    DeviceBlock block;
+    if (!readPeek(ctx, &block))
+        return 0;
+    if (block.data)
+        memcpy(buf, block.data, block.size * sizeof(float complex));
+    else
+        frontendConvert(block.bytes, buf, block.size);
+    readRelease(ctx);
+    return block.size;
+}
+
+
+static int getStats(void *context, DeviceStats *stats)
+{
+    Context *ctx = (Context *)context;
+    *stats = ctx->stats;
+    return TRUE;
+}
+
+
+static int setBlockSize(void *context, int size)
+{
+    Context *ctx = (Context *)context;
+    ctx->blockSize = size;
+    return TRUE;
+}
+
+
+static int setFormat(void *context, int format)
+{
+    Context *ctx = (Context *)context;
+    if (ctx->isOpen)
+        {
+        ctx->par->error("Cannot change sample format while open");
+        return FALSE;
+        }
+    if (format == SAMPLE_FLOAT)
+        ctx->format = format;
+    else if (format == SAMPLE_U8 && ctx->fileFormat == FILE_CU8)
+        ctx->format = format;
+    else
+        return FALSE;
+    return TRUE;
+}
+
+static int devWrite(void *context, float complex *cbuf, int datalen)
+{
+    return 0;
+}
+
+static int transmit(void *context, int truefalse)
+{
+    return 0;
+}
+
+
+static int devOpen(void *context)
+{
+    Context *ctx = (Context *)context;
+    if (ctx->isOpen)
+        return 0;
+    ctx->map = mapFile(ctx->fileName, &(ctx->mapSize));
+    if (!ctx->map)
+        {
+        ctx->par->error("Could not map '%s'", ctx->fileName);
+        return FALSE;
+        }
+    ctx->nrSamples = ctx->mapSize / ctx->bytesPerSample;
+    ctx->scratch = malloc(BUFSIZE * sizeof(float complex));
+    if (!ctx->scratch)
+        {
+        unmapFile(ctx->map, ctx->mapSize);
+        return FALSE;
+        }
+    ctx->pos       = 0;
+    ctx->seq       = 0;
+    ctx->peekSize  = 0;
+    ctx->atEnd     = FALSE;
+    ctx->startTime = now();
+    memset(&(ctx->stats), 0, sizeof(DeviceStats));
+    ctx->par->trace("Playing '%s': %lld samples at %f samples/sec",
+         ctx->fileName, ctx->nrSamples, ctx->rate);
+    ctx->isOpen = TRUE;
+    return TRUE;
+}
+
+/**
+ * Reaching the end of the file closes the device, unless looping,
+ * which ends the reader thread
+ */
+static int isOpen(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->isOpen && !ctx->atEnd;
+}
+
+
+static int devClose(void *context)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen)
+        return TRUE;
+    ctx->isOpen = FALSE;
+    unmapFile(ctx->map, ctx->mapSize);
+    ctx->map = NULL;
+    free(ctx->scratch);
+    ctx->scratch = NULL;
+    return TRUE;
+}
+
+static int delete(void *context)
+{
+    Context *ctx = (Context *)context;
+    devClose(ctx);
+    free(ctx->fileName);
+    free(ctx);
+    return TRUE;
+}
+
+
+int deviceCreate(Device *dv, Parent *parent)
+{
+    char *fileName = getenv("SDRLIB_FILE");
+    if (!fileName || !*fileName)
+        return 0;
+    Context *ctx = (Context *)malloc(sizeof(Context));
+    if (!ctx)
+        {
+        return 0;
+        }
+    memset(ctx, 0, sizeof(Context));
+    ctx->par      = parent;
+    ctx->rate     = DEFAULT_RATE;
+    ctx->gain     = 1.0;
+    ctx->realtime = envInt("SDRLIB_FILE_REALTIME", 1);
+    ctx->loop     = envInt("SDRLIB_FILE_LOOP", 0);
+
+    //for SigMF, the samples are in .sigmf-data, described by .sigmf-meta
+    int len = strlen(fileName);
+    ctx->fileName = (char *)malloc(len + 16);
+    if (!ctx->fileName)
+        {
+        free(ctx);
+        return 0;
+        }
+    strcpy(ctx->fileName, fileName);
+    if (endsWith(fileName, ".sigmf-meta") || endsWith(fileName, ".sigmf-data"))
+        {
+        char *meta = ctx->fileName;
+        strcpy(meta + len - 4, "meta");
+        int ok = readSigmf(ctx, meta);
+        strcpy(ctx->fileName + len - 4, "data");
+        if (!ok)
+            {
+            delete(ctx);
+            return 0;
+            }
+        }
+    else if (endsWith(fileName, ".cs8"))
+        ctx->fileFormat = FILE_CS8;
+    else if (endsWith(fileName, ".cf32") || endsWith(fileName, ".cfile") ||
+             endsWith(fileName, ".fc32"))
+        ctx->fileFormat = FILE_CF32;
+    else
+        ctx->fileFormat = FILE_CU8;
+
+    char *fmt = getenv("SDRLIB_FILE_FORMAT");
+    if (fmt && *fmt && !(ctx->fileFormat = parseFormat(fmt)))
+        {
+        parent->error("Unknown SDRLIB_FILE_FORMAT '%s'", fmt);
+        delete(ctx);
+        return 0;
+        }
+    char *rate = getenv("SDRLIB_FILE_RATE");
+    if (rate && *rate)
+        ctx->rate = atof(rate);
+    ctx->bytesPerSample = (ctx->fileFormat == FILE_CF32) ? 8 : 2;
+
+    dv->type               = DEVICE_SDR,
+    dv->name               = "File Replay Device";
+    dv->ctx                = (void *)ctx;
+    dv->open               = devOpen;
+    dv->isOpen             = isOpen;
+    dv->close              = devClose;
+    dv->delete             = delete;
+    dv->setGain            = setGain;
+    dv->getGain            = getGain;
+    dv->setSampleRate      = setSampleRate;
+    dv->getSampleRate      = getSampleRate;
+    dv->setCenterFrequency = setCenterFrequency;
+    dv->getCenterFrequency = getCenterFrequency;
+    dv->setFormat          = setFormat;
+    dv->read               = devRead;
+    dv->readPeek           = readPeek;
+    dv->readRelease        = readRelease;
+    dv->readWait           = readWait;
+    dv->getStats           = getStats;
+    dv->setBlockSize       = setBlockSize;
+    dv->write              = devWrite;
+    dv->transmit           = transmit;
+    return 1;
+}
+
@@ -28,9 +28,11 @@
 #include <string.h>
 #include <complex.h>
 #include <pthread.h>
+#include <time.h>
 #include <rtl-sdr.h>
 
 #include "device.h"
+#include "frontend.h"
 #include "ringbuffer.h"
 
 #ifndef TRUE
@@ -49,15 +51,41 @@
  */
 #define BUFSIZE (16 * 32 * 512 / 2)
 
+#define RING_SLOTS 100
+
+/**
+ * rtl-sdr's transfers are a whole number of USB requests of this many bytes
+ */
+#define URB_BYTES (16384)
+
+/**
+ * Each ring buffer slot starts with one of these, followed by the samples.
+ * It is 32 bytes long to keep the samples aligned for SIMD.
+ */
+typedef struct
+{
+    unsigned long long seq;
+    unsigned long long time; //capture of the first sample.  See DeviceBlock
+    int size;
+    int reserved[3];
+} SlotHeader;
+
 typedef struct
 {
     rtlsdr_dev_t *dev;
-    float complex lut[256 * 256 * sizeof(float complex)];
     float gainscale;
     pthread_t asyncThread;
     ringbuffer *ringBuffer;
+    pthread_mutex_t dataLock; //held while signalling/waiting for new data
+    pthread_cond_t  dataCond;
     Parent *par;
+    int index;    //which of the attached dongles
+    char name[128];
     int isOpen;
+    int format;   //SampleFormat of the ring buffer slots
+    int bufLen;   //bytes per transfer, 0 for rtl-sdr's default
+    unsigned long long nextSeq; //seq of the next sample from the hardware
+    DeviceStats stats;
 } Context;
 
 
@@ -126,29 +154,108 @@ static double getCenterFrequency(void *context)
 
 
 
-static int read(void *context, float complex *buf, int buflen)
+static int readPeek(void *context, DeviceBlock *block)
 {
     Context *ctx = (Context *)context;
     if (!ctx->isOpen)
-        return 0;
-    ringbuffer *rb = ctx->ringBuffer;
+        return FALSE;
+    SlotHeader *hdr = (SlotHeader *)ringbuffer_rpeek(ctx->ringBuffer);
+    if (!hdr)
+        return FALSE;
+    void *samples = (void *)(hdr + 1);
+    if (ctx->format == SAMPLE_U8)
+        {
+        block->data  = NULL;
+        block->bytes = (unsigned char *)samples;
+        }
+    else
+        {
+        block->data  = (float complex *)samples;
+        block->bytes = NULL;
+        }
+    block->size = hdr->size;
+    block->seq  = hdr->seq;
+    block->time = hdr->time;
+    return TRUE;
+}
+
+
+static int readRelease(void *context)
+{
+    Context *ctx = (Context *)context;
+    ringbuffer_radvance(ctx->ringBuffer);
+    return TRUE;
+}
+
+
+static int read(void *context, float complex *buf, int buflen)
+{
+    Context *ctx = (Context *)context;
     if (buflen < BUFSIZE)
         {
         ctx->par->error("buflen param is too small");
         return 0;
         }
-    if (!ringbuffer_read(rb, buf))
-        return 0; 
-    return BUFSIZE;
+    DeviceBlock block;
+    if (!readPeek(ctx, &block))
+        return 0;
+    if (block.data)
+        memcpy(buf, block.data, block.size * sizeof(float complex));
+    else
+        frontendConvert(block.bytes, buf, block.size);
+    readRelease(ctx);
+    return block.size;
+}
+
+
+static int readWait(void *context, int timeoutMs)
+{
+    Context *ctx = (Context *)context;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+        {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+        }
+    int ready = FALSE;
+    pthread_mutex_lock(&(ctx->dataLock));
+    while (ctx->isOpen)
+        {
+        if (!ringbuffer_is_empty(ctx->ringBuffer))
+            {
+            ready = TRUE;
+            break;
+            }
+        if (pthread_cond_timedwait(&(ctx->dataCond), &(ctx->dataLock), &deadline))
+            break;
+        }
+    pthread_mutex_unlock(&(ctx->dataLock));
+    return ready;
 }
 
 
 
+/**
+ * The transfer completes when its last sample arrives, so the first one
+ * was captured the length of the transfer before now
+ */
+static unsigned long long captureTime(Context *ctx, int count)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned long long now = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    unsigned int rate = rtlsdr_get_sample_rate(ctx->dev);
+    unsigned long long span = (rate) ? (unsigned long long)count * 1000000000ULL / rate : 0;
+    return (span < now) ? now - span : now;
+}
+
+
 static void async_read_callback(unsigned char *buf, uint32_t len, void *context)
 {
     Context *ctx = (Context *)context;
-    float complex *lut = ctx->lut;
-    unsigned char *b = buf;
     int count = len>>1;
     if (count > BUFSIZE)
         {
@@ -156,21 +263,77 @@ static void async_read_callback(unsigned char *buf, uint32_t len, void *context)
         return;
         }
     ringbuffer *rb = ctx->ringBuffer;
-    float complex *cpx = (float complex *)ringbuffer_wpeek(rb);
-    if (cpx)
+    DeviceStats *stats = &(ctx->stats);
+    unsigned long long seq = ctx->nextSeq;
+    ctx->nextSeq += count;
+    stats->transfers++;
+    stats->samples += count;
+    SlotHeader *hdr = (SlotHeader *)ringbuffer_wpeek(rb);
+    if (!hdr)
         {
-        int i = count;
-        while (i--)
-            {
-            int hi = (int)*b++;
-            int lo = (int)*b++;
-            *cpx++ = lut[(hi<<8) + lo];
-            }
-        ringbuffer_wadvance(rb);
+        //the reader will see the jump in seq
+        stats->drops++;
+        stats->droppedSamples += count;
+        return;
         }
+    hdr->seq  = seq;
+    hdr->time = captureTime(ctx, count);
+    hdr->size = count;
+    if (ctx->format == SAMPLE_U8)
+        memcpy((void *)(hdr + 1), buf, count * 2);
+    else
+        frontendConvert(buf, (float complex *)(hdr + 1), count);
+    ringbuffer_wadvance(rb);
+    int fill = ringbuffer_count(rb);
+    if (fill > stats->maxFill)
+        stats->maxFill = fill;
+    //wake up the reader, if it is waiting
+    pthread_mutex_lock(&(ctx->dataLock));
+    pthread_cond_signal(&(ctx->dataCond));
+    pthread_mutex_unlock(&(ctx->dataLock));
     //ctx->par->trace("len:%d", len);
 }
 
+static int getStats(void *context, DeviceStats *stats)
+{
+    Context *ctx = (Context *)context;
+    *stats = ctx->stats;
+    return TRUE;
+}
+
+/**
+ * The transfer size is fixed while rtl-sdr reads, so it is restarted
+ * with the new one.  Samples in flight are lost, and the reader sees
+ * nothing amiss, since seq counts the transfers received.
+ */
+static int setBlockSize(void *context, int size)
+{
+    Context *ctx = (Context *)context;
+    int len = 0;
+    if (size > 0 && size < BUFSIZE)
+        len = (size * 2 + URB_BYTES - 1) / URB_BYTES * URB_BYTES;
+    if (len == ctx->bufLen)
+        return TRUE;
+    ctx->bufLen = len;
+    if (ctx->isOpen)
+        rtlsdr_cancel_async(ctx->dev);
+    return TRUE;
+}
+
+static int setFormat(void *context, int format)
+{
+    Context *ctx = (Context *)context;
+    if (ctx->isOpen)
+        {
+        ctx->par->error("Cannot change sample format while open");
+        return FALSE;
+        }
+    if (format != SAMPLE_FLOAT && format != SAMPLE_U8)
+        return FALSE;
+    ctx->format = format;
+    return TRUE;
+}
+
 static int write(void *context, float complex *cbuf, int datalen)
 {
     //Context *ctx = (Context *)context;
@@ -183,10 +346,14 @@ static int transmit(void *context, int truefalse)
     return 0;
 }
 
+/**
+ * rtl-sdr returns when cancelled, either to close or for a new transfer size
+ */
 static void *asyncLoop(void *context)
 {
     Context *ctx = (Context *)context;
-    rtlsdr_read_async(ctx->dev, async_read_callback, ctx, 0, 0);
+    while (ctx->isOpen)
+        rtlsdr_read_async(ctx->dev, async_read_callback, ctx, 0, ctx->bufLen);
     return NULL;
 }
 
@@ -196,12 +363,10 @@ static int open(void *context)
     if (ctx->isOpen)
         return 0;
     rtlsdr_dev_t *dev = NULL;
-    int devCount = rtlsdr_get_device_count();
-    ctx->par->trace("devices:%d", devCount);
-    int ret = rtlsdr_open(&dev, 0);
+    int ret = rtlsdr_open(&dev, ctx->index);
     if (!dev)
         {
-        ctx->par->error("Could not open device");
+        ctx->par->error("Could not open device %d", ctx->index);
         return 0;
         }
 
@@ -221,7 +386,12 @@ static int open(void *context)
     
     ret = rtlsdr_reset_buffer(dev);
     ctx->isOpen = 1;
-    ctx->ringBuffer = ringbuffer_create(100, BUFSIZE * sizeof (float complex));
+    int slotSize = (ctx->format == SAMPLE_U8) ? BUFSIZE * 2 : BUFSIZE * sizeof(float complex);
+    ctx->ringBuffer = ringbuffer_create(RING_SLOTS, sizeof(SlotHeader) + slotSize);
+    ctx->nextSeq = 0;
+    memset(&(ctx->stats), 0, sizeof(DeviceStats));
+    //one slot is always left empty to tell full from empty
+    ctx->stats.ringSize = RING_SLOTS - 1;
     int rc = pthread_create(&(ctx->asyncThread), NULL, asyncLoop, ctx);
     if (rc)
         {
@@ -243,7 +413,10 @@ static int close(void *context)
 {
     Context *ctx = (Context *)context;
     //do shutdowny things here
+    pthread_mutex_lock(&(ctx->dataLock));
     ctx->isOpen = 0;
+    pthread_cond_broadcast(&(ctx->dataCond));
+    pthread_mutex_unlock(&(ctx->dataLock));
     rtlsdr_cancel_async(ctx->dev);
     rtlsdr_close(ctx->dev);
     ringbuffer_delete(ctx->ringBuffer);
@@ -253,12 +426,20 @@ static int close(void *context)
 static int delete(void *context)
 {
     Context *ctx = (Context *)context;
+    pthread_cond_destroy(&(ctx->dataCond));
+    pthread_mutex_destroy(&(ctx->dataLock));
     free(ctx);   
     return 1;
 }
 
 
-int deviceCreate(Device *dv, Parent *parent)
+int deviceCount(void)
+{
+    return rtlsdr_get_device_count();
+}
+
+
+int deviceCreateIndexed(Device *dv, Parent *parent, int index)
 {
     Context *ctx = (Context *)malloc(sizeof(Context));
     if (!ctx)
@@ -267,20 +448,18 @@ int deviceCreate(Device *dv, Parent *parent)
         }
     memset(ctx, 0, sizeof(Context));
     ctx->par = parent;
-    int idx = 0;
-    int hi,lo;
-    for (hi = 0 ; hi < 256 ; hi++)
-        {
-        float hival = ((float)(hi - 127)) / 128.0; 
-        for (lo = 0; lo < 256 ; lo++)
-            {
-            float loval = ((float)(lo - 127)) / 128.0;
-            ctx->lut[idx++] = hival+loval*I; 
-            }    
-        }
+    ctx->index = index;
+    //the serial number tells apart dongles of the same make
+    char manufacturer[256], product[256], serial[256];
+    if (rtlsdr_get_device_usb_strings(index, manufacturer, product, serial) == 0)
+        snprintf(ctx->name, sizeof(ctx->name), "RTL - SDR Device %d: %.64s", index, serial);
+    else
+        snprintf(ctx->name, sizeof(ctx->name), "RTL - SDR Device %d", index);
+    pthread_mutex_init(&(ctx->dataLock), NULL);
+    pthread_cond_init(&(ctx->dataCond), NULL);
     
     dv->type               = DEVICE_SDR,
-    dv->name               = "RTL - SDR Device";
+    dv->name               = ctx->name;
     dv->ctx                = (void *)ctx;
     dv->open               = open;
     dv->isOpen             = isOpen;
@@ -292,9 +471,21 @@ int deviceCreate(Device *dv, Parent *parent)
     dv->getSampleRate      = getSampleRate;
     dv->setCenterFrequency = setCenterFrequency;
     dv->getCenterFrequency = getCenterFrequency;
+    dv->setFormat          = setFormat;
     dv->read               = read;
+    dv->readPeek           = readPeek;
+    dv->readRelease        = readRelease;
+    dv->readWait           = readWait;
     dv->write              = write;
+    dv->getStats           = getStats;
+    dv->setBlockSize       = setBlockSize;
     dv->transmit           = transmit;
     return 1;
 }
 
+
+int deviceCreate(Device *dv, Parent *parent)
+{
+    return deviceCreateIndexed(dv, parent, 0);
+}
+
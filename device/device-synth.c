@@ -0,0 +1,1069 @@
+/**
+ * Synthetic signal generator, for load testing without hardware.
+ *
+ * Since plugins are created without arguments, it is configured
+ * from the environment.  If SDRLIB_SYNTH is not set, no device is
+ * created.
+ *
+ *   SDRLIB_SYNTH           the scene: signals separated by ';', each a type
+ *                          followed by optional name=value parameters:
+ *                            "fm:freq=200e3,level=-20,dev=75e3,tone=1000;noise:level=-60"
+ *   SDRLIB_SYNTH_RATE      sample rate.  Default 2048000
+ *   SDRLIB_SYNTH_REALTIME  1 to play at the sample rate (default), 0 to
+ *                          deliver samples as fast as they are consumed
+ *   SDRLIB_SYNTH_DURATION  seconds of signal before closing.  Default 0, forever
+ *   SDRLIB_SYNTH_CACHE     if > 0, generate this many blocks when opened and
+ *                          replay them in a loop, so that generation
+ *                          does not count against the pipeline
+ *
+ * Signal types, with their parameters.  freq is the offset from the
+ * center in Hz, level is in dBFS:
+ *   tone   freq level
+ *   am     freq level depth tone
+ *   fm     freq level dev tone
+ *   usb    freq level tone
+ *   lsb    freq level tone
+ *   burst  freq level on period      (on and period in seconds)
+ *   fsk    freq level shift baud     (continuous phase, the mark shift/2
+ *                                     above freq and the space below.  The
+ *                                     bits are a 7-bit pseudorandom sequence)
+ *   wfm    freq level dev tone tone2 rds pi
+ *                                    (broadcast stereo: tone on the left,
+ *                                     tone2 on the right.  dev defaults to 75e3.
+ *                                     rds is the share of the deviation taken
+ *                                     by RDS, 0 for none.  It sends the PI
+ *                                     code pi, with SYNTH_PS and SYNTH_RT)
+ *   noise  level
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <complex.h>
+#include <time.h>
+
+#include "device.h"
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/**
+ * Same block size as the rtl-sdr plugin, so results are comparable
+ */
+#define BUFSIZE (16 * 32 * 512 / 2)
+
+#define DEFAULT_RATE 2048000.0
+
+#define MAX_SIGNALS 16
+
+/**
+ * The phasor NCO runs this many samples side by side, so that the
+ * inner loop has no carried dependency and can be vectorized
+ */
+#define NCO_LANES 4
+
+/**
+ * Size of the sine table used for FM, as a power of 2
+ */
+#define TABLE_BITS 12
+#define TABLE_SIZE (1 << TABLE_BITS)
+
+/**
+ * What the wfm signal sends by RDS: the station name in four 0A groups,
+ * then the radiotext in sixteen 2A groups, over and over
+ */
+#define SYNTH_PS "SDRLIB  "
+#define SYNTH_RT "SdrLib synthetic broadcast"
+#define RDS_GROUPS 20
+#define RDS_BITS   (RDS_GROUPS * 104)
+
+
+typedef enum
+{
+    SIG_TONE,
+    SIG_AM,
+    SIG_FM,
+    SIG_USB,
+    SIG_LSB,
+    SIG_BURST,
+    SIG_FSK,
+    SIG_WFM,
+    SIG_NOISE
+} SignalType;
+
+
+/**
+ * Complex oscillator by repeated rotation of a phasor.  Each lane
+ * starts one sample apart and advances by NCO_LANES samples.
+ */
+typedef struct
+{
+    float re[NCO_LANES];
+    float im[NCO_LANES];
+    float stepRe;
+    float stepIm;
+} Nco;
+
+
+typedef struct
+{
+    int    type;
+    double freq;
+    float  level;   //dBFS
+    float  depth;   //am
+    double dev;     //fm
+    double tone;    //modulating tone
+    double tone2;   //wfm, on the right
+    double on;      //burst
+    double period;  //burst
+    double shift;   //fsk, mark to space in Hz
+    double baud;    //fsk
+    float  amp;
+    Nco    carrier;
+    Nco    mod;
+    Nco    mod2;        //wfm, the right
+    Nco    pilot;       //wfm
+    uint32_t phase;       //fm
+    uint32_t phaseInc;    //fm
+    float    devInc;      //fm
+    long long burstPos;   //burst, samples into the period
+    long long burstOn;
+    long long burstPeriod;
+    uint32_t bitClock;    //fsk, phase of the bit clock
+    uint32_t bitClockInc;
+    int      prbs;        //fsk, the bit sequence's register
+    float    rds;         //wfm
+    int      pi;          //wfm
+    unsigned char rdsBits[RDS_BITS]; //wfm, before differential coding
+    int      rdsPos;
+    int      rdsLast;     //last bit sent, after differential coding
+    float    rdsSymbol;
+    uint32_t rdsClock;    //phase of the bit clock
+    uint32_t rdsClockInc;
+} Signal;
+
+
+typedef struct
+{
+    Parent *par;
+    Signal signals[MAX_SIGNALS];
+    int    nrSignals;
+    float  rate;
+    double freq;
+    float  gain;
+    int    realtime;
+    double duration;
+    int    cacheBlocks;
+    int    format;
+    int    isOpen;
+    int    atEnd;
+    unsigned long long seq;
+    int    peekSize;
+    int    blockSize;  //requested with setBlockSize(), 0 for BUFSIZE
+    double startTime;
+    uint32_t noiseState;
+    float  accRe[BUFSIZE];
+    float  accIm[BUFSIZE];
+    float  modRe[BUFSIZE];
+    float  modIm[BUFSIZE];
+    float  carRe[BUFSIZE];
+    float  carIm[BUFSIZE];
+    float  mod2Re[BUFSIZE];
+    float  mod2Im[BUFSIZE];
+    float complex table[TABLE_SIZE];
+    void   *out;       //one block, or the cache
+    int    cachePos;
+    DeviceStats stats;
+} Context;
+
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+static void sleepFor(double seconds)
+{
+    if (seconds <= 0.0)
+        return;
+    struct timespec ts;
+    ts.tv_sec  = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1.0e9);
+    nanosleep(&ts, NULL);
+}
+
+
+static double envFloat(char *name, double defaultValue)
+{
+    char *val = getenv(name);
+    return (val && *val) ? atof(val) : defaultValue;
+}
+
+
+
+/*############################################################################
+## O S C I L L A T O R S
+############################################################################*/
+
+
+static void ncoSet(Nco *nco, double freq, double rate)
+{
+    double w = 2.0 * M_PI * freq / rate;
+    for (int k = 0 ; k < NCO_LANES ; k++)
+        {
+        nco->re[k] = cos(w * k);
+        nco->im[k] = sin(w * k);
+        }
+    nco->stepRe = cos(w * NCO_LANES);
+    nco->stepIm = sin(w * NCO_LANES);
+}
+
+
+/**
+ * Write 'size' unit phasors, a multiple of NCO_LANES
+ */
+static void ncoGenerate(Nco *nco, float *re, float *im, int size)
+{
+    float zr[NCO_LANES], zi[NCO_LANES];
+    float sr = nco->stepRe;
+    float si = nco->stepIm;
+    memcpy(zr, nco->re, sizeof(zr));
+    memcpy(zi, nco->im, sizeof(zi));
+    for (int n = 0 ; n < size ; n += NCO_LANES)
+        {
+        for (int k = 0 ; k < NCO_LANES ; k++)
+            {
+            re[n + k] = zr[k];
+            im[n + k] = zi[k];
+            float r = zr[k] * sr - zi[k] * si;
+            float i = zr[k] * si + zi[k] * sr;
+            zr[k] = r;
+            zi[k] = i;
+            }
+        }
+    //the rounding errors make the magnitude drift, so pull it back to 1
+    for (int k = 0 ; k < NCO_LANES ; k++)
+        {
+        float g = 1.5f - 0.5f * (zr[k] * zr[k] + zi[k] * zi[k]);
+        nco->re[k] = zr[k] * g;
+        nco->im[k] = zi[k] * g;
+        }
+}
+
+
+/**
+ * xorshift32, returning a uniform float in [-1, 1)
+ */
+static inline float noiseNext(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)(int32_t)x * (1.0f / 2147483648.0f);
+}
+
+
+
+/*############################################################################
+## S C E N E
+############################################################################*/
+
+
+/**
+ * Recompute everything that depends on the sample rate
+ */
+static void signalSetup(Signal *sig, double rate)
+{
+    sig->amp = pow(10.0, sig->level / 20.0);
+    switch (sig->type)
+        {
+        case SIG_USB:
+            ncoSet(&(sig->carrier), sig->freq + sig->tone, rate);
+            break;
+        case SIG_LSB:
+            ncoSet(&(sig->carrier), sig->freq - sig->tone, rate);
+            break;
+        case SIG_FM:
+            sig->phaseInc = (uint32_t)(int64_t)llround(sig->freq / rate * 4294967296.0);
+            sig->devInc   = (float)(sig->dev / rate * 4294967296.0);
+            ncoSet(&(sig->mod), sig->tone, rate);
+            break;
+        case SIG_FSK:
+            sig->phaseInc    = (uint32_t)(int64_t)llround(sig->freq / rate * 4294967296.0);
+            sig->devInc      = (float)(0.5 * sig->shift / rate * 4294967296.0);
+            sig->bitClockInc = (uint32_t)(int64_t)llround(sig->baud / rate * 4294967296.0);
+            break;
+        case SIG_WFM:
+            sig->phaseInc = (uint32_t)(int64_t)llround(sig->freq / rate * 4294967296.0);
+            sig->devInc   = (float)(sig->dev / rate * 4294967296.0);
+            ncoSet(&(sig->mod), sig->tone, rate);
+            ncoSet(&(sig->mod2), sig->tone2, rate);
+            ncoSet(&(sig->pilot), 19000.0, rate);
+            sig->rdsClockInc = (uint32_t)(int64_t)llround(1187.5 / rate * 4294967296.0);
+            break;
+        case SIG_AM:
+            ncoSet(&(sig->carrier), sig->freq, rate);
+            ncoSet(&(sig->mod), sig->tone, rate);
+            break;
+        case SIG_BURST:
+            ncoSet(&(sig->carrier), sig->freq, rate);
+            sig->burstOn     = (long long)(sig->on * rate);
+            sig->burstPeriod = (long long)(sig->period * rate);
+            if (sig->burstPeriod < 1)
+                sig->burstPeriod = 1;
+            sig->burstPos = 0;
+            break;
+        default:
+            ncoSet(&(sig->carrier), sig->freq, rate);
+        }
+}
+
+
+/**
+ * Append one 26 bit RDS block, with its checkword and offset
+ */
+static unsigned char *rdsBlock(unsigned char *bits, unsigned int data, unsigned int offset)
+{
+    uint32_t reg = data << 10;
+    for (int i = 25 ; i >= 10 ; i--)
+        if (reg & (1u << i))
+            reg ^= 0x5b9u << (i - 10);
+    uint32_t block = (data << 10) | ((reg & 0x3ff) ^ offset);
+    for (int i = 25 ; i >= 0 ; i--)
+        *bits++ = (block >> i) & 1;
+    return bits;
+}
+
+
+static void rdsEncode(Signal *sig)
+{
+    char rt[64];
+    memset(rt, ' ', sizeof(rt));
+    memcpy(rt, SYNTH_RT, strlen(SYNTH_RT));
+    rt[strlen(SYNTH_RT)] = '\r';
+    unsigned char *bits = sig->rdsBits;
+    for (int seg = 0 ; seg < 4 ; seg++)
+        {
+        bits = rdsBlock(bits, sig->pi, 0x0fc);
+        bits = rdsBlock(bits, (0 << 12) | seg, 0x198);
+        bits = rdsBlock(bits, 0xe0cd, 0x168); //no alternative frequencies
+        bits = rdsBlock(bits, (SYNTH_PS[2*seg] << 8) | SYNTH_PS[2*seg + 1], 0x1b4);
+        }
+    for (int seg = 0 ; seg < 16 ; seg++)
+        {
+        bits = rdsBlock(bits, sig->pi, 0x0fc);
+        bits = rdsBlock(bits, (2 << 12) | seg, 0x198);
+        bits = rdsBlock(bits, (rt[4*seg] << 8) | rt[4*seg + 1], 0x168);
+        bits = rdsBlock(bits, (rt[4*seg + 2] << 8) | rt[4*seg + 3], 0x1b4);
+        }
+}
+
+
+static int parseSignal(Context *ctx, char *str)
+{
+    if (ctx->nrSignals >= MAX_SIGNALS)
+        {
+        ctx->par->error("Too many signals, max %d", MAX_SIGNALS);
+        return FALSE;
+        }
+    Signal *sig = &(ctx->signals[ctx->nrSignals]);
+    memset(sig, 0, sizeof(Signal));
+    sig->level  = -20.0;
+    sig->depth  = 0.8;
+    sig->dev    = 5000.0;
+    sig->tone   = 1000.0;
+    sig->tone2  = 400.0;
+    sig->on     = 0.01;
+    sig->period = 0.1;
+    sig->shift  = 170.0;
+    sig->baud   = 45.45;
+    sig->prbs   = 0x7f;
+    sig->pi     = 0x1234;
+
+    char *params = strchr(str, ':');
+    if (params)
+        *params++ = '\0';
+    if (strcmp(str, "tone") == 0)
+        sig->type = SIG_TONE;
+    else if (strcmp(str, "am") == 0)
+        sig->type = SIG_AM;
+    else if (strcmp(str, "fm") == 0)
+        sig->type = SIG_FM;
+    else if (strcmp(str, "usb") == 0)
+        sig->type = SIG_USB;
+    else if (strcmp(str, "lsb") == 0)
+        sig->type = SIG_LSB;
+    else if (strcmp(str, "burst") == 0)
+        sig->type = SIG_BURST;
+    else if (strcmp(str, "fsk") == 0)
+        sig->type = SIG_FSK;
+    else if (strcmp(str, "wfm") == 0)
+        {
+        sig->type = SIG_WFM;
+        sig->dev  = 75000.0;
+        }
+    else if (strcmp(str, "noise") == 0)
+        {
+        sig->type  = SIG_NOISE;
+        sig->level = -60.0;
+        }
+    else
+        {
+        ctx->par->error("Unknown signal type '%s'", str);
+        return FALSE;
+        }
+
+    while (params && *params)
+        {
+        char *next = strchr(params, ',');
+        if (next)
+            *next++ = '\0';
+        char *val = strchr(params, '=');
+        if (!val)
+            {
+            ctx->par->error("Expected name=value, got '%s'", params);
+            return FALSE;
+            }
+        *val++ = '\0';
+        double v = atof(val);
+        if (strcmp(params, "freq") == 0)
+            sig->freq = v;
+        else if (strcmp(params, "level") == 0)
+            sig->level = v;
+        else if (strcmp(params, "depth") == 0)
+            sig->depth = v;
+        else if (strcmp(params, "dev") == 0)
+            sig->dev = v;
+        else if (strcmp(params, "tone") == 0)
+            sig->tone = v;
+        else if (strcmp(params, "tone2") == 0)
+            sig->tone2 = v;
+        else if (strcmp(params, "on") == 0)
+            sig->on = v;
+        else if (strcmp(params, "period") == 0)
+            sig->period = v;
+        else if (strcmp(params, "shift") == 0)
+            sig->shift = v;
+        else if (strcmp(params, "baud") == 0)
+            sig->baud = v;
+        else if (strcmp(params, "rds") == 0)
+            sig->rds = v;
+        else if (strcmp(params, "pi") == 0)
+            sig->pi = (int)v & 0xffff;
+        else
+            {
+            ctx->par->error("Unknown signal parameter '%s'", params);
+            return FALSE;
+            }
+        params = next;
+        }
+    if (sig->type == SIG_WFM)
+        rdsEncode(sig);
+    ctx->nrSignals++;
+    return TRUE;
+}
+
+
+static int parseScene(Context *ctx, char *scene)
+{
+    char *buf = strdup(scene);
+    if (!buf)
+        return FALSE;
+    int ret = TRUE;
+    char *str = buf;
+    while (ret && str && *str)
+        {
+        char *next = strchr(str, ';');
+        if (next)
+            *next++ = '\0';
+        while (*str == ' ')
+            str++;
+        if (*str)
+            ret = parseSignal(ctx, str);
+        str = next;
+        }
+    free(buf);
+    if (ret && !ctx->nrSignals)
+        {
+        ctx->par->error("SDRLIB_SYNTH scene has no signals");
+        ret = FALSE;
+        }
+    return ret;
+}
+
+
+/**
+ * Add one signal to the accumulators
+ */
+static void signalGenerate(Context *ctx, Signal *sig, int size)
+{
+    float *accRe = ctx->accRe;
+    float *accIm = ctx->accIm;
+    float *carRe = ctx->carRe;
+    float *carIm = ctx->carIm;
+    float *modRe = ctx->modRe;
+    float *modIm = ctx->modIm;
+    float amp = sig->amp;
+
+    switch (sig->type)
+        {
+        case SIG_AM:
+            {
+            ncoGenerate(&(sig->carrier), carRe, carIm, size);
+            ncoGenerate(&(sig->mod), modRe, modIm, size);
+            float depth = sig->depth;
+            for (int n = 0 ; n < size ; n++)
+                {
+                float a = amp * (1.0f + depth * modRe[n]);
+                accRe[n] += a * carRe[n];
+                accIm[n] += a * carIm[n];
+                }
+            break;
+            }
+        case SIG_FM:
+            {
+            //the phase is a 32-bit accumulator, so it wraps by itself
+            ncoGenerate(&(sig->mod), modRe, modIm, size);
+            uint32_t phase = sig->phase;
+            uint32_t inc   = sig->phaseInc;
+            float devInc   = sig->devInc;
+            float complex *table = ctx->table;
+            for (int n = 0 ; n < size ; n++)
+                {
+                phase += inc + (uint32_t)(int32_t)(devInc * modRe[n]);
+                float complex c = table[phase >> (32 - TABLE_BITS)];
+                accRe[n] += amp * crealf(c);
+                accIm[n] += amp * cimagf(c);
+                }
+            sig->phase = phase;
+            break;
+            }
+        case SIG_WFM:
+            {
+            //the composite: 90% audio, with (L+R)/2 at baseband and (L-R)/2
+            //on 38 kHz, twice the pilot, and 10% pilot
+            float *mod2Re = ctx->mod2Re;
+            float *mod2Im = ctx->mod2Im;
+            float complex *table = ctx->table;
+            ncoGenerate(&(sig->mod), modRe, modIm, size);
+            ncoGenerate(&(sig->mod2), mod2Re, mod2Im, size);
+            ncoGenerate(&(sig->pilot), carRe, carIm, size);
+            for (int n = 0 ; n < size ; n++)
+                {
+                float sub = carRe[n] * carRe[n] - carIm[n] * carIm[n];
+                float sum = 0.5f * (modRe[n] + mod2Re[n]);
+                float dif = 0.5f * (modRe[n] - mod2Re[n]);
+                modRe[n] = 0.9f * (sum + dif * sub) + 0.1f * carRe[n];
+                }
+            if (sig->rds > 0.0f)
+                {
+                //biphase symbols, one cycle of a sine per bit, on 57 kHz,
+                //three times the pilot.  The audio makes room for it
+                float audio = (0.9f - sig->rds) / 0.9f;
+                uint32_t clock = sig->rdsClock;
+                for (int n = 0 ; n < size ; n++)
+                    {
+                    uint32_t next = clock + sig->rdsClockInc;
+                    if (next < clock)
+                        {
+                        int bit = sig->rdsBits[sig->rdsPos] ^ sig->rdsLast;
+                        sig->rdsLast = bit;
+                        sig->rdsSymbol = bit ? 1.0f : -1.0f;
+                        if (++sig->rdsPos >= RDS_BITS)
+                            sig->rdsPos = 0;
+                        }
+                    clock = next;
+                    float shape = cimagf(table[clock >> (32 - TABLE_BITS)]);
+                    float sub57 = carRe[n] * (4.0f * carRe[n] * carRe[n] - 3.0f);
+                    float pilot = 0.1f * carRe[n];
+                    modRe[n] = (modRe[n] - pilot) * audio + pilot +
+                               sig->rds * sig->rdsSymbol * shape * sub57;
+                    }
+                sig->rdsClock = clock;
+                }
+            uint32_t phase = sig->phase;
+            uint32_t inc   = sig->phaseInc;
+            float devInc   = sig->devInc;
+            for (int n = 0 ; n < size ; n++)
+                {
+                phase += inc + (uint32_t)(int32_t)(devInc * modRe[n]);
+                float complex c = table[phase >> (32 - TABLE_BITS)];
+                accRe[n] += amp * crealf(c);
+                accIm[n] += amp * cimagf(c);
+                }
+            sig->phase = phase;
+            break;
+            }
+        case SIG_BURST:
+            {
+            ncoGenerate(&(sig->carrier), carRe, carIm, size);
+            long long pos = sig->burstPos;
+            for (int n = 0 ; n < size ; n++)
+                {
+                float a = (pos < sig->burstOn) ? amp : 0.0f;
+                accRe[n] += a * carRe[n];
+                accIm[n] += a * carIm[n];
+                if (++pos >= sig->burstPeriod)
+                    pos = 0;
+                }
+            sig->burstPos = pos;
+            break;
+            }
+        case SIG_FSK:
+            {
+            uint32_t phase = sig->phase;
+            uint32_t inc   = sig->phaseInc;
+            int32_t  dev   = (int32_t)sig->devInc;
+            uint32_t clock = sig->bitClock;
+            int      prbs  = sig->prbs;
+            float complex *table = ctx->table;
+            for (int n = 0 ; n < size ; n++)
+                {
+                uint32_t next = clock + sig->bitClockInc;
+                if (next < clock)
+                    prbs = ((prbs << 1) | (((prbs >> 6) ^ (prbs >> 5)) & 1)) & 0x7f;
+                clock = next;
+                phase += inc + (uint32_t)((prbs & 1) ? dev : -dev);
+                float complex c = table[phase >> (32 - TABLE_BITS)];
+                accRe[n] += amp * crealf(c);
+                accIm[n] += amp * cimagf(c);
+                }
+            sig->phase    = phase;
+            sig->bitClock = clock;
+            sig->prbs     = prbs;
+            break;
+            }
+        case SIG_NOISE:
+            {
+            //sum of two uniforms is close enough to gaussian for this.
+            //each has a variance of 2/3; scale so the total power is amp^2
+            float scale = amp * 0.8660254f;
+            uint32_t state = ctx->noiseState;
+            for (int n = 0 ; n < size ; n++)
+                {
+                accRe[n] += scale * (noiseNext(&state) + noiseNext(&state));
+                accIm[n] += scale * (noiseNext(&state) + noiseNext(&state));
+                }
+            ctx->noiseState = state;
+            break;
+            }
+        default:
+            {
+            //tone, and ssb with a single modulating tone, are one carrier
+            ncoGenerate(&(sig->carrier), carRe, carIm, size);
+            for (int n = 0 ; n < size ; n++)
+                {
+                accRe[n] += amp * carRe[n];
+                accIm[n] += amp * carIm[n];
+                }
+            }
+        }
+}
+
+
+/**
+ * Generate one block of 'size' samples, up to BUFSIZE, into 'out', in
+ * the current format
+ */
+static void sceneGenerate(Context *ctx, void *out, int size)
+{
+    memset(ctx->accRe, 0, size * sizeof(float));
+    memset(ctx->accIm, 0, size * sizeof(float));
+    for (int i = 0 ; i < ctx->nrSignals ; i++)
+        signalGenerate(ctx, &(ctx->signals[i]), size);
+
+    float gain = ctx->gain;
+    if (ctx->format == SAMPLE_U8)
+        {
+        unsigned char *b = (unsigned char *)out;
+        for (int n = 0 ; n < size ; n++)
+            {
+            float re = ctx->accRe[n] * gain * 128.0f + 127.5f;
+            float im = ctx->accIm[n] * gain * 128.0f + 127.5f;
+            re = (re < 0.0f) ? 0.0f : (re > 255.0f) ? 255.0f : re;
+            im = (im < 0.0f) ? 0.0f : (im > 255.0f) ? 255.0f : im;
+            b[2*n]     = (unsigned char)re;
+            b[2*n + 1] = (unsigned char)im;
+            }
+        }
+    else
+        {
+        float *f = (float *)out;
+        for (int n = 0 ; n < size ; n++)
+            {
+            f[2*n]     = ctx->accRe[n] * gain;
+            f[2*n + 1] = ctx->accIm[n] * gain;
+            }
+        }
+}
+
+
+static int sampleBytes(Context *ctx)
+{
+    return (ctx->format == SAMPLE_U8) ? 2 : sizeof(float complex);
+}
+
+
+
+/*############################################################################
+## D E V I C E
+############################################################################*/
+
+
+static int setGain(void *context, float gain)
+{
+    Context *ctx = (Context *)context;
+    ctx->gain = gain;
+    return TRUE;
+}
+
+static float getGain(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->gain;
+}
+
+static int setSampleRate(void *context, float rate)
+{
+    Context *ctx = (Context *)context;
+    if (rate <= 0.0)
+        return FALSE;
+    ctx->startTime += (double)ctx->seq / ctx->rate - (double)ctx->seq / rate;
+    ctx->rate = rate;
+    for (int i = 0 ; i < ctx->nrSignals ; i++)
+        signalSetup(&(ctx->signals[i]), rate);
+    return TRUE;
+}
+
+static float getSampleRate(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->rate;
+}
+
+static int setCenterFrequency(void *context, double freq)
+{
+    Context *ctx = (Context *)context;
+    ctx->freq = freq;
+    return TRUE;
+}
+
+static double getCenterFrequency(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->freq;
+}
+
+
+/**
+ * Size of the next block.  Cached blocks are always BUFSIZE.
+ */
+static int nextSize(Context *ctx)
+{
+    int size = ctx->blockSize;
+    return (ctx->cacheBlocks > 0 || size <= 0 || size > BUFSIZE) ? BUFSIZE : size;
+}
+
+
+/**
+ * Seconds until the next block is due, in realtime mode
+ */
+static double timeToNext(Context *ctx)
+{
+    if (!ctx->realtime)
+        return 0.0;
+    double due = ctx->startTime + (double)(ctx->seq + nextSize(ctx)) / ctx->rate;
+    return due - now();
+}
+
+
+/**
+ * In realtime mode, when the first sample of the next block would have
+ * been captured.  Otherwise, now.
+ */
+static unsigned long long captureTime(Context *ctx)
+{
+    double t = (ctx->realtime) ? ctx->startTime + (double)ctx->seq / ctx->rate : now();
+    return (unsigned long long)(t * 1.0e9);
+}
+
+
+static int readPeek(void *context, DeviceBlock *block)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen || ctx->atEnd)
+        return FALSE;
+    if (ctx->duration > 0.0 && (double)ctx->seq >= ctx->duration * ctx->rate)
+        {
+        ctx->atEnd = TRUE;
+        return FALSE;
+        }
+    if (timeToNext(ctx) > 0.0)
+        return FALSE;
+    int size = nextSize(ctx);
+    unsigned char *out = (unsigned char *)ctx->out;
+    if (ctx->cacheBlocks > 0)
+        out += (size_t)ctx->cachePos * BUFSIZE * sampleBytes(ctx);
+    else
+        sceneGenerate(ctx, out, size);
+    block->data  = NULL;
+    block->bytes = NULL;
+    if (ctx->format == SAMPLE_U8)
+        block->bytes = out;
+    else
+        block->data  = (float complex *)out;
+    block->size = size;
+    block->seq  = ctx->seq;
+    block->time = captureTime(ctx);
+    ctx->peekSize = size;
+    return TRUE;
+}
+
+
+static int readRelease(void *context)
+{
+    Context *ctx = (Context *)context;
+    int size = ctx->peekSize;
+    ctx->seq += size;
+    if (ctx->cacheBlocks > 0 && ++ctx->cachePos >= ctx->cacheBlocks)
+        ctx->cachePos = 0;
+    ctx->stats.transfers++;
+    ctx->stats.samples += size;
+    ctx->peekSize = 0;
+    return TRUE;
+}
+
+
+static int readWait(void *context, int timeoutMs)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen || ctx->atEnd)
+        return FALSE;
+    double wait = timeToNext(ctx);
+    double timeout = (double)timeoutMs / 1000.0;
+    if (wait > timeout)
+        {
+        sleepFor(timeout);
+        return FALSE;
+        }
+    sleepFor(wait);
+    return TRUE;
+}
+
+
+static int read(void *context, float complex *buf, int buflen)
+{
+    Context *ctx = (Context *)context;
+    if (buflen < BUFSIZE)
+        {
+        ctx->par->error("buflen param is too small");
+        return 0;
+        }
+    DeviceBlock block;
+    if (!readPeek(ctx, &block))
+        return 0;
+    if (block.data)
+        memcpy(buf, block.data, block.size * sizeof(float complex));
+    else
+        {
+        for (int n = 0 ; n < block.size ; n++)
+            buf[n] = ((float)block.bytes[2*n] - 127.5f) / 128.0f +
+                     ((float)block.bytes[2*n + 1] - 127.5f) / 128.0f * I;
+        }
+    readRelease(ctx);
+    return block.size;
+}
+
+
+static int getStats(void *context, DeviceStats *stats)
+{
+    Context *ctx = (Context *)context;
+    *stats = ctx->stats;
+    return TRUE;
+}
+
+
+static int setBlockSize(void *context, int size)
+{
+    Context *ctx = (Context *)context;
+    ctx->blockSize = size;
+    return TRUE;
+}
+
+
+static int setFormat(void *context, int format)
+{
+    Context *ctx = (Context *)context;
+    if (ctx->isOpen)
+        {
+        ctx->par->error("Cannot change sample format while open");
+        return FALSE;
+        }
+    if (format != SAMPLE_FLOAT && format != SAMPLE_U8)
+        return FALSE;
+    ctx->format = format;
+    return TRUE;
+}
+
+static int write(void *context, float complex *cbuf, int datalen)
+{
+    return 0;
+}
+
+static int transmit(void *context, int truefalse)
+{
+    return 0;
+}
+
+
+static int open(void *context)
+{
+    Context *ctx = (Context *)context;
+    if (ctx->isOpen)
+        return 0;
+    int blocks = (ctx->cacheBlocks > 0) ? ctx->cacheBlocks : 1;
+    ctx->out = malloc((size_t)blocks * BUFSIZE * sampleBytes(ctx));
+    if (!ctx->out)
+        {
+        ctx->par->error("Cannot allocate %d synth blocks", blocks);
+        return FALSE;
+        }
+    for (int i = 0 ; i < ctx->nrSignals ; i++)
+        signalSetup(&(ctx->signals[i]), ctx->rate);
+    if (ctx->cacheBlocks > 0)
+        {
+        unsigned char *out = (unsigned char *)ctx->out;
+        for (int i = 0 ; i < ctx->cacheBlocks ; i++)
+            sceneGenerate(ctx, out + (size_t)i * BUFSIZE * sampleBytes(ctx), BUFSIZE);
+        }
+    ctx->seq       = 0;
+    ctx->cachePos  = 0;
+    ctx->peekSize  = 0;
+    ctx->atEnd     = FALSE;
+    ctx->startTime = now();
+    memset(&(ctx->stats), 0, sizeof(DeviceStats));
+    ctx->par->trace("Synth: %d signals at %f samples/sec%s", ctx->nrSignals,
+         ctx->rate, ctx->realtime ? "" : ", not paced");
+    ctx->isOpen = TRUE;
+    return TRUE;
+}
+
+static int isOpen(void *context)
+{
+    Context *ctx = (Context *)context;
+    return ctx->isOpen && !ctx->atEnd;
+}
+
+static int close(void *context)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen)
+        return TRUE;
+    ctx->isOpen = FALSE;
+    free(ctx->out);
+    ctx->out = NULL;
+    return TRUE;
+}
+
+static int delete(void *context)
+{
+    Context *ctx = (Context *)context;
+    close(ctx);
+    free(ctx);
+    return TRUE;
+}
+
+
+int deviceCreate(Device *dv, Parent *parent)
+{
+    char *scene = getenv("SDRLIB_SYNTH");
+    if (!scene || !*scene)
+        return 0;
+    Context *ctx = (Context *)malloc(sizeof(Context));
+    if (!ctx)
+        {
+        return 0;
+        }
+    memset(ctx, 0, sizeof(Context));
+    ctx->par         = parent;
+    ctx->gain        = 1.0;
+    ctx->noiseState  = 0x12345678;
+    ctx->rate        = envFloat("SDRLIB_SYNTH_RATE", DEFAULT_RATE);
+    ctx->realtime    = (int)envFloat("SDRLIB_SYNTH_REALTIME", 1);
+    ctx->duration    = envFloat("SDRLIB_SYNTH_DURATION", 0);
+    ctx->cacheBlocks = (int)envFloat("SDRLIB_SYNTH_CACHE", 0);
+    if (!parseScene(ctx, scene))
+        {
+        free(ctx);
+        return 0;
+        }
+    for (int i = 0 ; i < TABLE_SIZE ; i++)
+        {
+        double w = 2.0 * M_PI * (double)i / (double)TABLE_SIZE;
+        ctx->table[i] = cos(w) + sin(w) * I;
+        }
+
+    dv->type               = DEVICE_SDR,
+    dv->name               = "Synthetic Signal Generator";
+    dv->ctx                = (void *)ctx;
+    dv->open               = open;
+    dv->isOpen             = isOpen;
+    dv->close              = close;
+    dv->delete             = delete;
+    dv->setGain            = setGain;
+    dv->getGain            = getGain;
+    dv->setSampleRate      = setSampleRate;
+    dv->getSampleRate      = getSampleRate;
+    dv->setCenterFrequency = setCenterFrequency;
+    dv->getCenterFrequency = getCenterFrequency;
+    dv->setFormat          = setFormat;
+    dv->read               = read;
+    dv->readPeek           = readPeek;
+    dv->readRelease        = readRelease;
+    dv->readWait           = readWait;
+    dv->getStats           = getStats;
+    dv->setBlockSize       = setBlockSize;
+    dv->write              = write;
+    dv->transmit           = transmit;
+    return 1;
+}
+
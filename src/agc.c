@@ -0,0 +1,324 @@
+/**
+ * Automatic gain control
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "agc.h"
+#include "private.h"
+
+
+/**
+ * Log2 of the quietest level the envelope goes down to, about -200 dB
+ */
+#define FLOOR_LOG -33.0f
+
+
+
+Agc *agcCreateChannels(float inRate, int channels)
+{
+    if (channels < 1 || channels > 2)
+        {
+        error("agc: channels must be 1 or 2");
+        return NULL;
+        }
+    Agc *obj = (Agc *)smalloc(sizeof(Agc));
+    if (!obj)
+        return NULL;
+    memset(obj, 0, sizeof(Agc));
+    obj->channels  = channels;
+    obj->delayLine = (float *)smalloc(AGC_MAX_LOOKAHEAD * AGC_STEP * channels * sizeof(float));
+    if (!obj->delayLine)
+        {
+        free(obj);
+        return NULL;
+        }
+    obj->attack     = AGC_ATTACK;
+    obj->hang       = AGC_HANG;
+    obj->decay      = AGC_DECAY;
+    obj->targetLog  = log2(AGC_TARGET);
+    obj->maxGainLog = log2(AGC_MAX_GAIN);
+    obj->blockSize  = AGC_BUFSIZE;
+    agcSetInRate(obj, inRate);
+    return obj;
+}
+
+
+Agc *agcCreate(float inRate)
+{
+    return agcCreateChannels(inRate, 1);
+}
+
+
+void agcDelete(Agc *obj)
+{
+    if (!obj)
+        return;
+    blockRelease(obj->buf);
+    free(obj->delayLine);
+    free(obj);
+}
+
+
+/**
+ * Work out the per-step values from the times and the rate
+ */
+static void agcUpdateCoeffs(Agc *obj)
+{
+    float stepTime = (float)AGC_STEP / obj->inRate;
+    obj->attackCoeff = (obj->attack > 0.0) ? 1.0 - exp(-stepTime / obj->attack) : 1.0;
+    obj->decayCoeff  = (obj->decay  > 0.0) ? 1.0 - exp(-stepTime / obj->decay)  : 1.0;
+    obj->hangFrames  = (int)(obj->hang / stepTime + 0.5) * AGC_STEP;
+    int steps = (int)(obj->lookahead / stepTime + 0.5);
+    if (steps > AGC_MAX_LOOKAHEAD)
+        steps = AGC_MAX_LOOKAHEAD;
+    obj->delay = steps * AGC_STEP;
+}
+
+
+void agcSetInRate(Agc *obj, float inRate)
+{
+    if (inRate <= 0.0 || inRate == obj->inRate)
+        return;
+    obj->inRate = inRate;
+    agcUpdateCoeffs(obj);
+    agcReset(obj);
+}
+
+
+void agcSetTimes(Agc *obj, float attack, float hang, float decay)
+{
+    obj->attack = (attack > 0.0) ? attack : 0.0;
+    obj->hang   = (hang   > 0.0) ? hang   : 0.0;
+    obj->decay  = (decay  > 0.0) ? decay  : 0.0;
+    agcUpdateCoeffs(obj);
+}
+
+
+void agcSetLookahead(Agc *obj, float seconds)
+{
+    seconds = (seconds > 0.0) ? seconds : 0.0;
+    if (seconds == obj->lookahead)
+        return;
+    obj->lookahead = seconds;
+    agcUpdateCoeffs(obj);
+    agcReset(obj);
+}
+
+
+void agcSetBlockSize(Agc *obj, int frames)
+{
+    obj->blockSize = (frames <= 0 || frames > AGC_BUFSIZE) ? AGC_BUFSIZE : frames;
+}
+
+
+void agcReset(Agc *obj)
+{
+    obj->env       = obj->targetLog;
+    obj->hangCount = 0;
+    obj->started   = FALSE;
+    obj->gain      = 1.0;
+    obj->quiet     = obj->delay;
+    memset(obj->delayLine, 0, AGC_MAX_LOOKAHEAD * AGC_STEP * obj->channels * sizeof(float));
+}
+
+
+int agcGetBacklog(Agc *obj)
+{
+    return obj->bufPtr / obj->channels + obj->delay;
+}
+
+
+/**
+ * The coefficient for a step of 'frames', of one for a whole step.
+ * Steps are cut short at the ends of blocks, and those must move the
+ * envelope no faster than whole ones.
+ */
+static float agcCoeff(float coeff, int frames)
+{
+    if (frames == AGC_STEP)
+        return coeff;
+    return 1.0f - powf(1.0f - coeff, (float)frames / (float)AGC_STEP);
+}
+
+
+/**
+ * Move the envelope on by one step of 'frames' whose peak is 'peak'
+ * @return the gain for the end of the step
+ */
+static float agcStep(Agc *obj, float peak, int frames)
+{
+    float level = (peak > 0.0f) ? log2f(peak) : FLOOR_LOG;
+    float env = obj->env;
+    if (!obj->started)
+        {
+        //take the first level as it is, rather than rising to it
+        env = level;
+        obj->hangCount = obj->hangFrames;
+        }
+    else if (level > env)
+        {
+        env += agcCoeff(obj->attackCoeff, frames) * (level - env);
+        obj->hangCount = obj->hangFrames;
+        }
+    else if (obj->hangCount > 0)
+        obj->hangCount -= frames;
+    else
+        env += agcCoeff(obj->decayCoeff, frames) * (level - env);
+    obj->env = env;
+    float gainLog = obj->targetLog - env;
+    if (gainLog > obj->maxGainLog)
+        gainLog = obj->maxGainLog;
+    return exp2f(gainLog);
+}
+
+
+/**
+ * Get the next block to fill.  Mono fits in a block of floats.
+ */
+static float *agcRenew(Agc *obj, float *buf)
+{
+    return (float *)((obj->channels == 1) ? blockRenewFloat(buf) : blockRenew(buf));
+}
+
+
+void agcUpdate(Agc *obj, float *data, int size, FloatOutputFunc *func, void *context)
+{
+    if (!obj->buf)
+        {
+        obj->buf = agcRenew(obj, NULL);
+        obj->bufPtr = 0;
+        if (!obj->buf)
+            return;
+        }
+    obj->quiet   = 0;
+    int channels = obj->channels;
+    int bufSize  = obj->blockSize * channels;
+    float *buf   = obj->buf;
+    int bufPtr   = obj->bufPtr;
+    if (bufPtr >= bufSize)
+        {
+        //the block size has been lowered under what is waiting
+        func(buf, bufPtr / channels, context);
+        buf = obj->buf = agcRenew(obj, buf);
+        bufPtr = 0;
+        if (!buf)
+            return;
+        }
+    int delay    = obj->delay * channels;
+    float *delayLine = obj->delayLine;
+    float work[(AGC_MAX_LOOKAHEAD + 1) * AGC_STEP * 2];
+    float ramp[AGC_STEP];
+
+    while (size > 0)
+        {
+        int frames = (bufSize - bufPtr) / channels;
+        if (frames > AGC_STEP)
+            frames = AGC_STEP;
+        if (frames > size)
+            frames = size;
+        int n = frames * channels;
+
+        //the envelope is of the newest input, both channels together
+        float peak = 0.0f;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float v = fabsf(data[i]);
+            peak = (v > peak) ? v : peak;
+            }
+        float gain1 = agcStep(obj, peak, frames);
+        float gain0 = (obj->started) ? obj->gain : gain1;
+        obj->gain = gain1;
+        obj->started = TRUE;
+
+        //while the audio is the oldest, 'delay' behind
+        float *in = data;
+        if (delay)
+            {
+            memcpy(work, delayLine, delay * sizeof(float));
+            memcpy(work + delay, data, n * sizeof(float));
+            memcpy(delayLine, work + n, delay * sizeof(float));
+            in = work;
+            }
+        float *out = buf + bufPtr;
+        float slope = (gain1 - gain0) / (float)frames;
+        for (int i = 0 ; i < frames ; i++)
+            ramp[i] = gain0 + slope * (float)(i + 1);
+        if (channels == 1)
+            {
+            for (int i = 0 ; i < n ; i++)
+                out[i] = in[i] * ramp[i];
+            }
+        else
+            {
+            for (int i = 0 ; i < frames ; i++)
+                {
+                out[2*i]   = in[2*i]   * ramp[i];
+                out[2*i+1] = in[2*i+1] * ramp[i];
+                }
+            }
+
+        data   += n;
+        size   -= frames;
+        bufPtr += n;
+        if (bufPtr >= bufSize)
+            {
+            func(buf, bufPtr / channels, context);
+            buf = obj->buf = agcRenew(obj, buf);
+            bufPtr = 0;
+            if (!buf)
+                break;
+            }
+        }
+    obj->bufPtr = bufPtr;
+}
+
+
+/**
+ * The audio in the delay line is pushed out with silence behind it,
+ * which also lets the envelope fall as it would have.  The rest of the
+ * silence needs no work.
+ */
+int agcSkip(Agc *obj, int size, FloatOutputFunc *func, void *context)
+{
+    float zeros[AGC_STEP * 2];
+    memset(zeros, 0, sizeof(zeros));
+    int quiet = obj->quiet;
+    int push = obj->delay - quiet;
+    if (push > size)
+        push = size;
+    for (int left = push ; left > 0 ; left -= AGC_STEP)
+        agcUpdate(obj, zeros, (left < AGC_STEP) ? left : AGC_STEP, func, context);
+    obj->quiet = quiet + push;
+    if (obj->buf && obj->bufPtr > 0)
+        {
+        func(obj->buf, obj->bufPtr / obj->channels, context);
+        obj->buf = agcRenew(obj, obj->buf);
+        obj->bufPtr = 0;
+        }
+    return size - push;
+}
+
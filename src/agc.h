@@ -0,0 +1,172 @@
+#ifndef _AGC_H_
+#define _AGC_H_
+
+/**
+ * Automatic gain control, between the demodulator and the resampler, so
+ * that every mode gives audio at about the same level.
+ *
+ * The envelope is followed in the log domain, a step of AGC_STEP samples
+ * at a time: the peak of each step is found with a plain loop, and only
+ * its log goes through the attack, hang and decay.  The gain is ramped
+ * across each step from the last one to the next, so there are no
+ * per-sample branches, and no zipper noise.
+ *
+ * With look-ahead, the audio is delayed behind the envelope, so the gain
+ * is already down when a peak arrives.
+ *
+ * Stereo is taken as frames of left,right pairs.  Both channels have the
+ * same gain, from the louder of them, so that the image does not move.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "sdrlib.h"
+#include "pool.h"
+
+
+/**
+ * Output frames per block.  A pool block holds this many stereo frames,
+ * as a float complex each.
+ */
+#define AGC_BUFSIZE (POOL_BLOCK_SAMPLES)
+
+/**
+ * Frames per step of the envelope
+ */
+#define AGC_STEP 32
+
+/**
+ * Most look-ahead, in steps
+ */
+#define AGC_MAX_LOOKAHEAD 64
+
+/**
+ * Defaults, in seconds
+ */
+#define AGC_ATTACK  0.002
+#define AGC_HANG    0.25
+#define AGC_DECAY   0.3
+
+/**
+ * Peak level the output is brought to, and the most gain used to get
+ * there, so that silence is not brought up to a roar
+ */
+#define AGC_TARGET   0.3
+#define AGC_MAX_GAIN 10000.0
+
+
+struct Agc
+{
+    int    channels;       //1, or 2 for stereo frames
+    float  inRate;
+    float  attack;         //times in seconds, as set
+    float  hang;
+    float  decay;
+    float  lookahead;
+    float  attackCoeff;    //per whole step
+    float  decayCoeff;
+    int    hangFrames;
+    int    delay;          //look-ahead, in frames
+    float  targetLog;      //log2 of AGC_TARGET
+    float  maxGainLog;
+    float  env;            //log2 of the envelope
+    int    hangCount;      //frames left to hold the envelope
+    int    started;        //false until the envelope has been set by a first step
+    float  gain;           //applied at the end of the last step
+    float  *delayLine;     //the last 'delay' frames of input
+    int    quiet;          //frames of silence at the end of the delay line
+    float  *buf;           //pool block being filled
+    int    bufPtr;         //in floats
+    int    blockSize;      //frames per output block, up to AGC_BUFSIZE
+};
+
+
+/**
+ * @param inRate the rate of the demodulated audio
+ */
+Agc *agcCreate(float inRate);
+
+/**
+ * @param inRate the frame rate
+ * @param channels 1 or 2
+ */
+Agc *agcCreateChannels(float inRate, int channels);
+
+/**
+ *
+ */
+void agcDelete(Agc *obj);
+
+/**
+ * Start over at a new rate.  Does nothing if the rate is the same.  Not
+ * to be called while agcUpdate() may be running.
+ */
+void agcSetInRate(Agc *obj, float inRate);
+
+/**
+ * @param attack time constant of a rise in level, in seconds
+ * @param hang how long the gain is held after a peak, in seconds
+ * @param decay time constant of a fall in level, once the hang is over
+ */
+void agcSetTimes(Agc *obj, float attack, float hang, float decay);
+
+/**
+ * Delay the audio behind the envelope, so the gain is down before a
+ * peak arrives.  Up to AGC_MAX_LOOKAHEAD steps.  A change starts over,
+ * so, as for agcSetInRate(), not while agcUpdate() may be running.
+ * @param seconds 0 for none
+ */
+void agcSetLookahead(Agc *obj, float seconds);
+
+/**
+ * Output blocks of at most 'frames', for lower latency.  0 for
+ * AGC_BUFSIZE, the default.
+ */
+void agcSetBlockSize(Agc *obj, int frames);
+
+/**
+ * Forget the level and the delayed audio, after a gap in the input
+ */
+void agcReset(Agc *obj);
+
+/**
+ * @return the number of frames held back, in the delay and the block
+ */
+int agcGetBacklog(Agc *obj);
+
+/**
+ * Level 'size' frames, calling func with blocks of up to the block size
+ */
+void agcUpdate(Agc *obj, float *data, int size, FloatOutputFunc *func, void *context);
+
+/**
+ * Account for 'size' frames of silence, as from a closed squelch.  The
+ * audio held back is output first, the last of it in a short block.
+ * @return the number of frames of silence left after it
+ */
+int agcSkip(Agc *obj, int size, FloatOutputFunc *func, void *context);
+
+
+
+#endif /* _AGC_H_ */
+
@@ -36,7 +36,7 @@
 #include "audio.h"
 #include "private.h"
 
-#define SAMPLE_RATE 44100.0
+#define SAMPLE_RATE SDR_AUDIO_RATE
 
 
 
@@ -54,8 +54,11 @@ Audio *audioCreate()
         return audio;
     audio->sampleRate = SAMPLE_RATE;
     audio->gain = 0.0;
-    int elemSize = AUDIO_FRAMES_PER_BUFFER * sizeof(float);
-    audio->ringBuffer = ringbuffer_create(1024, elemSize);
+    audio->writePos   = 0;
+    audio->overflows  = 0;
+    audio->underflows = 0;
+    int elemSize = AUDIO_FRAMES_PER_BUFFER * 2 * sizeof(float);
+    audio->ringBuffer = ringbuffer_create(AUDIO_QUEUE_BLOCKS, elemSize);
     if (!audio->ringBuffer)
         {
         error("audioCreate: cannot initialize ringbuffer");
@@ -132,6 +135,25 @@ void audioDelete(Audio *audio)
 }
 
 
+/**
+ * One slot of the ring buffer is always left empty
+ */
+void audioGetQueue(Audio *audio, int *queued, int *size)
+{
+    ringbuffer *rb = audio->ringBuffer;
+    *queued = ringbuffer_count(rb);
+    *size   = rb->total_size / rb->element_size - 1;
+}
+
+
+float audioGetDelay(Audio *audio)
+{
+    int frames = ringbuffer_count(audio->ringBuffer) * AUDIO_FRAMES_PER_BUFFER +
+                 audio->writePos;
+    return (float)frames / audio->sampleRate;
+}
+
+
 /**
  * Return the gain, 0-1
  * Convert to 0-40 db 
@@ -170,53 +192,90 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
     if (in)
         {
         float *out = (float *)outputBuffer;
-        while (framesPerBuffer--)
-            {
-            float v = (*in++) * gain;
-            //trace("v:%f",v);
-            *out++ = v;
-            *out++ = v;
-            }
+        int n = framesPerBuffer * 2;
+        while (n--)
+            *out++ = (*in++) * gain;
         ringbuffer_radvance(rb);
         }
     else
         {
         //trace("underflow");
+        audio->underflows++;
         memset(outputBuffer, 0, framesPerBuffer * 2 * sizeof(float));
         }
     return paContinue;
 }
 
 
-#if 1
 /**
- * Queue up data to be read by paCallback
+ * Get the next free block of the ring buffer, or count an overflow
  */
-int audioPlay(Audio *audio, float *data, int size)
+static float *audioNextBlock(Audio *audio)
 {
-    ringbuffer *rb = audio->ringBuffer;
-    int ret = ringbuffer_write(rb, data);
-    if (!ret)
+    float *out = (float *)ringbuffer_wpeek(audio->ringBuffer);
+    if (!out)
         {
+        audio->overflows++;
         error("Audio: ringBuffer full");
         }
-    return ret;
+    return out;
 }
-#else
-int audioPlay(Audio *audio, float *data, int size)
+
+
+/**
+ * Pack 'size' frames of 'channels' into the blocks of the ring buffer,
+ * after what is already in the one being filled.  Each block is queued
+ * once it is full, so short blocks of audio play without gaps.
+ */
+static int audioWrite(Audio *audio, float *data, int size, int channels)
 {
-    PaStream *stream = audio->stream;
-    
-    int err = Pa_WriteStream(stream, data, size);
-    if (err != paNoError)
+    while (size > 0)
         {
-        error("Audio write: %s", Pa_GetErrorText(err));
+        float *out = audioNextBlock(audio);
+        if (!out)
+            return FALSE;
+        int writePos = audio->writePos;
+        int n = AUDIO_FRAMES_PER_BUFFER - writePos;
+        if (n > size)
+            n = size;
+        out += writePos * 2;
+        if (channels == 1)
+            {
+            for (int i = 0 ; i < n ; i++)
+                {
+                *out++ = data[i];
+                *out++ = data[i];
+                }
+            }
+        else
+            memcpy(out, data, n * 2 * sizeof(float));
+        data += n * channels;
+        size -= n;
+        writePos += n;
+        if (writePos >= AUDIO_FRAMES_PER_BUFFER)
+            {
+            ringbuffer_wadvance(audio->ringBuffer);
+            writePos = 0;
+            }
+        audio->writePos = writePos;
         }
-    return err;
+    return TRUE;
 }
 
 
-#endif
+/**
+ * Queue up data to be read by paCallback, as stereo
+ */
+int audioPlay(Audio *audio, float *data, int size)
+{
+    return audioWrite(audio, data, size, 1);
+}
+
+
+int audioPlayStereo(Audio *audio, float *data, int size)
+{
+    return audioWrite(audio, data, size, 2);
+}
 
 
 
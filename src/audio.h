@@ -33,7 +33,18 @@
 #include "sdrlib.h"
 #include "ringbuffer.h"
 
-#define AUDIO_FRAMES_PER_BUFFER (16*1024)
+/**
+ * Frames the player takes at a time, about 46 ms.  Audio of any length
+ * is packed into blocks of this many, so a block waits at most this
+ * long to be filled.
+ */
+#define AUDIO_FRAMES_PER_BUFFER (2*1024)
+
+/**
+ * Blocks of AUDIO_FRAMES_PER_BUFFER stereo frames that may wait to be
+ * played.  Mono is kept as stereo, so both play the same way.
+ */
+#define AUDIO_QUEUE_BLOCKS 512
 
 
 struct Audio
@@ -42,6 +53,9 @@ struct Audio
     float sampleRate;
     float gain;
     ringbuffer *ringBuffer;
+    int writePos;                  //frames already in the block being filled
+    unsigned long long overflows;  //writes dropped because the ring buffer was full
+    unsigned long long underflows; //times the stream needed data, and there was none
 };
 
 
@@ -52,10 +66,15 @@ struct Audio
 Audio *audioCreate();
 
 /**
- * Send audio data to the player
+ * Send mono audio data to the player
  */
 int audioPlay(Audio *audio, float *data, int size);
 
+/**
+ * Send stereo audio data to the player: 'size' left,right pairs
+ */
+int audioPlayStereo(Audio *audio, float *data, int size);
+
 /**
  * Delete an Audio instance, stopping
  * any processing and freeing any resources.
@@ -64,6 +83,18 @@ int audioPlay(Audio *audio, float *data, int size);
 void audioDelete(Audio *audio);
 
 
+/**
+ * Get the number of blocks waiting to be played, and the most there can be
+ */
+void audioGetQueue(Audio *audio, int *queued, int *size);
+
+/**
+ * Get how long audio played now waits to be heard: the blocks queued
+ * ahead of it, and what is in the one being filled
+ * @return the wait, in seconds
+ */
+float audioGetDelay(Audio *audio);
+
 /**
  * Return the gain, 0-1
  */
@@ -35,13 +35,13 @@
 
 
 
-static void sendHeader(ogg_stream_state *os)
+static void sendHeader(ogg_stream_state *os, int channels)
 {
     ogg_stream_reset(os);
     unsigned char head[] = {
         'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 
         1,                //version
-        1,                //nr channels  1 or 2
+        channels,         //nr channels  1 or 2
         0, 0,             //16 bits, pre-skip
         0x80, 0xbb, 0, 0, //samplerate, 32 bits, little-endian. 0xbb80 == 48000
         0, 0,             //gain, 16 bits.  0 recommended
@@ -75,12 +75,24 @@ static void sendHeader(ogg_stream_state *os)
 
 Codec *codecCreate()
 {
+    return codecCreateChannels(1);
+}
+
+
+Codec *codecCreateChannels(int channels)
+{
+    if (channels < 1 || channels > 2)
+        {
+        error("codecCreate: %d channels.  Must be 1 or 2", channels);
+        return NULL;
+        }
     Codec *obj = (Codec *)malloc(sizeof(Codec));
     if (!obj)
         return NULL;
     memset(obj, 0, sizeof(Codec));
+    obj->channels = channels;
     int err;
-    obj->enc = opus_encoder_create(48000, 1, OPUS_APPLICATION_AUDIO, &err);
+    obj->enc = opus_encoder_create(48000, channels, OPUS_APPLICATION_AUDIO, &err);
     if (err != OPUS_OK || obj->enc==NULL)
         {
         free(obj);
@@ -92,7 +104,16 @@ Codec *codecCreate()
         free(obj);
         return NULL;
         }
-    sendHeader(&(obj->os));
+    //a frame of silence, encoded once and sent for every silent frame.
+    //The encoder is then put back as it was
+    obj->silenceLen = opus_encode_float(obj->enc, obj->inbuf, FRAME_SIZE, obj->silence, SILENCE_PACKET);
+    opus_encoder_ctl(obj->enc, OPUS_RESET_STATE);
+    if (obj->silenceLen < 0)
+        {
+        codecDelete(obj);
+        return NULL;
+        }
+    sendHeader(&(obj->os), obj->channels);
     return obj;
 }
 
@@ -118,56 +139,78 @@ static void dumpBuf(unsigned char *buf, int len)
 
 
 
+/**
+ * Add an Opus packet to the stream.  Every 16 packets, the pages are
+ * sent, and the stream starts over with its headers.
+ */
+static void codecPacket(Codec *obj, unsigned char *packet, int len, ByteOutputFunc *func, void *context)
+{
+    ogg_packet op;
+    op.packet = packet;
+    op.bytes  = len;
+    op.b_o_s=0;
+    op.e_o_s=0;
+    op.granulepos=0;
+    op.packetno=0; //currently ignored by libogg
+    ogg_stream_packetin(&(obj->os), &op);
+    obj->packetCount++;
+    if (obj->packetCount >= 16)
+        {
+        obj->packetCount = 0;
+        ogg_packet op;
+        op.packet = packet;
+        op.bytes  = 0;
+        op.b_o_s=0;
+        op.e_o_s=1;
+        op.granulepos=0;
+        op.packetno=0; //currently ignored by libogg
+        ogg_stream_packetin(&(obj->os), &op);
+        ogg_page page;
+        unsigned char *buf = obj->oggbuf;
+        unsigned char *b = buf;
+        while (ogg_stream_flush(&(obj->os), &page))
+            {
+            memcpy(b, page.header, page.header_len);
+            b += page.header_len;
+            memcpy(b, page.body, page.body_len);
+            b += page.body_len;
+            }
+        int bufsize = b - buf;
+        for (int i = 0 ; i < 50 ; i++)
+            printf("%d : %02x %c\n", i, buf[i], buf[i]);
+        dumpBuf(buf, bufsize);
+        if (func)
+            (*func)(buf, bufsize, context);
+        sendHeader(&(obj->os), obj->channels);
+        }
+}
+
+
+/**
+ * Encode the frame in inbuf
+ */
+static void codecFrame(Codec *obj, ByteOutputFunc *func, void *context)
+{
+    int len = opus_encode_float(obj->enc, obj->inbuf, FRAME_SIZE, obj->opusbuf, OPUS_PACKET);
+    codecPacket(obj, obj->opusbuf, len, func, context);
+}
+
+
+
 int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void *context)
 {
     float *inbuf = obj->inbuf;
     int inptr    = obj->inbufPtr;
+    int frameLen = FRAME_SIZE * obj->channels;
+    datalen *= obj->channels;
     
     while (datalen--)
         {
         inbuf[inptr++] = *data++;
-        if (inptr >= FRAME_SIZE)
+        if (inptr >= frameLen)
             {
             inptr = 0;
-            int len = opus_encode_float(obj->enc, inbuf, FRAME_SIZE, obj->opusbuf, OPUS_PACKET);
-            ogg_packet op;
-            op.packet = obj->opusbuf;
-            op.bytes  = len;
-            op.b_o_s=0;
-            op.e_o_s=0;
-            op.granulepos=0;
-            op.packetno=0; //currently ignored by libogg
-            ogg_stream_packetin(&(obj->os), &op);
-            obj->packetCount++;
-            if (obj->packetCount >= 16)
-                {
-                obj->packetCount = 0;
-                ogg_packet op;
-                op.packet = obj->opusbuf;
-                op.bytes  = 0;
-                op.b_o_s=0;
-                op.e_o_s=1;
-                op.granulepos=0;
-                op.packetno=0; //currently ignored by libogg
-                ogg_stream_packetin(&(obj->os), &op);
-                ogg_page page;
-                unsigned char *buf = obj->oggbuf;
-                unsigned char *b = buf;
-                while (ogg_stream_flush(&(obj->os), &page))
-                    {
-                    memcpy(b, page.header, page.header_len);
-                    b += page.header_len;
-                    memcpy(b, page.body, page.body_len);
-                    b += page.body_len;
-                    }
-                int bufsize = b - buf;
-                for (int i = 0 ; i < 50 ; i++)
-                    printf("%d : %02x %c\n", i, buf[i], buf[i]);
-                dumpBuf(buf, bufsize);
-                if (func)
-                    (*func)(buf, bufsize, context);
-                sendHeader(&(obj->os));
-                }
+            codecFrame(obj, func, context);
             }
         }
         
@@ -177,5 +220,44 @@ int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void
 }
 
 
+/**
+ * The frame under way is finished with zeros and encoded.  Whole frames
+ * after it are the silence packet, and the rest waits as zeros.
+ */
+int codecSilence(Codec *obj, int datalen, ByteOutputFunc *func, void *context)
+{
+    float *inbuf = obj->inbuf;
+    int inptr    = obj->inbufPtr;
+    int frameLen = FRAME_SIZE * obj->channels;
+    datalen *= obj->channels;
 
+    if (inptr > 0)
+        {
+        int n = frameLen - inptr;
+        if (n > datalen)
+            n = datalen;
+        memset(inbuf + inptr, 0, n * sizeof(float));
+        inptr   += n;
+        datalen -= n;
+        if (inptr >= frameLen)
+            {
+            inptr = 0;
+            codecFrame(obj, func, context);
+            }
+        }
+    while (datalen >= frameLen)
+        {
+        codecPacket(obj, obj->silence, obj->silenceLen, func, context);
+        datalen -= frameLen;
+        }
+    if (datalen > 0)
+        {
+        memset(inbuf + inptr, 0, datalen * sizeof(float));
+        inptr += datalen;
+        }
+
+    obj->inbufPtr = inptr;
+
+    return TRUE;
+}
 
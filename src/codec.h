@@ -40,26 +40,35 @@
 #define OPUS_PACKET (1024 * 16)
 #define OGG_PACKET (1024 * 16)
 #define FRAME_SIZE (2880)
+#define SILENCE_PACKET (256)
 struct Codec
 {
     OpusEncoder *enc;
+    int channels;
     ogg_stream_state os;
-    float inbuf[FRAME_SIZE];
-    int inbufPtr;
+    float inbuf[FRAME_SIZE * 2];
+    int inbufPtr; //in floats: frames * channels
     int packetCount;
     unsigned char opusbuf[OPUS_PACKET];
     int oggSerial;
     unsigned char oggbuf[OGG_PACKET];
+    unsigned char silence[SILENCE_PACKET]; //a frame of silence, encoded
+    int silenceLen;
 };
 
 
 
 
 /**
- *
+ * Create a mono encoder
  */
 Codec *codecCreate();
 
+/**
+ * @param channels 1 or 2
+ */
+Codec *codecCreateChannels(int channels);
+
 
 
 /**
@@ -69,10 +78,17 @@ void codecDelete(Codec *obj);
 
 
 /**
- *
+ * Encode 'datalen' frames.  With 2 channels, data is left,right pairs.
  */
 int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void *context);
 
+/**
+ * Account for 'datalen' frames of silence, as from a closed squelch,
+ * without encoding them.  Each whole frame of it is sent as the same
+ * small packet.
+ */
+int codecSilence(Codec *obj, int datalen, ByteOutputFunc *func, void *context);
+
 
 
 
@@ -25,10 +25,60 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "demod.h"
+#include "filter.h"
 #include "private.h"
 
 
+static void resetDefault(Demodulator *dem)
+{
+    dem->lastVal = 0;
+}
+
+
+/**
+ * The pool block to fill, getting one if needed.  If the block size has
+ * been lowered under what is already in it, that goes out first.
+ */
+static float *demodBlock(Demodulator *dem, FloatOutputFunc *func, void *context)
+{
+    if (!dem->outBuf)
+        {
+        dem->outBuf = (float *)blockAllocFloat();
+        dem->bufPtr = 0;
+        }
+    else if (dem->bufPtr >= dem->blockSize)
+        {
+        func(dem->outBuf, dem->bufPtr, context);
+        dem->outBuf = (float *)blockRenewFloat(dem->outBuf);
+        dem->bufPtr = 0;
+        }
+    return dem->outBuf;
+}
+
+
+/**
+ * A demodulator with nothing set but the default reset
+ */
+static Demodulator *demodAlloc()
+{
+    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    if (!dem)
+        return NULL;
+    memset(dem, 0, sizeof(Demodulator));
+    dem->reset     = resetDefault;
+    dem->blockSize = DEMOD_BUFSIZE;
+    return dem;
+}
+
+
 static void nullDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
 }
@@ -36,27 +86,33 @@ static void nullDemodulate(Demodulator *dem, float complex *data, int size, Floa
 
 Demodulator *demodNullCreate()
 {
-    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    Demodulator *dem = demodAlloc();
     if (!dem)
         return NULL;
-    dem->update  = nullDemodulate;
+    dem->update = nullDemodulate;
     return dem;
 }
 
 static void amDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
+    float *buf = demodBlock(dem, func, context);
+    if (!buf)
+        return;
     int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
+    int blockSize = dem->blockSize;
     while (size--)
         {
         float complex cpx = *data++;
         float v = cabsf(cpx);
         //trace("v:%f",v);
         buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        if (bufPtr >= blockSize)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
             bufPtr = 0;
+            if (!buf)
+                break;
             }
         }
     dem->bufPtr  = bufPtr;
@@ -65,40 +121,160 @@ static void amDemodulate(Demodulator *dem, float complex *data, int size, FloatO
 
 Demodulator *demodAmCreate()
 {
-    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    Demodulator *dem = demodAlloc();
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
-    dem->lastVal = 0;
-    dem->update  = amDemodulate;
+    dem->update = amDemodulate;
     return dem;
 }
 
+/**
+ * atan(z) for 0 <= z <= 1, by a minimax polynomial.  The error is
+ * under 1e-5 radians, far below the noise of any signal we receive.
+ */
+#define ATAN_C1  0.99997726f
+#define ATAN_C3 -0.33262347f
+#define ATAN_C5  0.19354346f
+#define ATAN_C7 -0.11643287f
+#define ATAN_C9  0.05265332f
+#define ATAN_C11 -0.01172120f
+
+#define FM_PI      3.14159265f
+#define FM_HALF_PI 1.57079633f
+
+
+/**
+ * atan2(y, x), with no branches to get in the way of the compiler.
+ * The ratio of the smaller to the larger of |x| and |y| is always
+ * in [0,1], so the polynomial can be used, and folded into the
+ * right octant after.  0 for (0,0), as cargf gives.
+ */
+static inline float fastAtan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mx = (ax > ay) ? ax : ay;
+    float mn = (ax > ay) ? ay : ax;
+    float z  = mn / ((mx > FLT_MIN) ? mx : FLT_MIN);
+    float z2 = z * z;
+    float r  = z * (ATAN_C1 + z2 * (ATAN_C3 + z2 * (ATAN_C5 + z2 *
+                   (ATAN_C7 + z2 * (ATAN_C9 + z2 * ATAN_C11)))));
+    r = (ay > ax)   ? FM_HALF_PI - r : r;
+    r = (x < 0.0f)  ? FM_PI - r : r;
+    return (y < 0.0f) ? -r : r;
+}
+
+
+#ifdef __SSE2__
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/**
+ * fastAtan2() on four values at once
+ */
+static inline __m128 fastAtan2x4(__m128 y, __m128 x)
+{
+    __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    __m128 ax = _mm_andnot_ps(signMask, x);
+    __m128 ay = _mm_andnot_ps(signMask, y);
+    __m128 mx = _mm_max_ps(ax, ay);
+    __m128 mn = _mm_min_ps(ax, ay);
+    __m128 z  = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(FLT_MIN)));
+    __m128 z2 = _mm_mul_ps(z, z);
+    __m128 p  = _mm_set1_ps(ATAN_C11);
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C9));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C7));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C5));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C3));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(ATAN_C1));
+    __m128 r  = _mm_mul_ps(z, p);
+    r = select4(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(FM_HALF_PI), r), r);
+    r = select4(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(FM_PI), r), r);
+    return _mm_xor_ps(r, _mm_and_ps(signMask, y));
+}
+
+/**
+ * The phase steps of four samples, from in[-1] .. in[3].  The float
+ * complex pairs are split into vectors of re and im.
+ */
+static inline __m128 fmDiscriminate4(float *in)
+{
+    __m128 c0 = _mm_loadu_ps(in);
+    __m128 c1 = _mm_loadu_ps(in + 4);
+    __m128 p0 = _mm_loadu_ps(in - 2);
+    __m128 p1 = _mm_loadu_ps(in + 2);
+    __m128 cr = _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 ci = _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 1, 3, 1));
+    __m128 pr = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 pi = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+    //cur * conj(prev)
+    __m128 re = _mm_add_ps(_mm_mul_ps(cr, pr), _mm_mul_ps(ci, pi));
+    __m128 im = _mm_sub_ps(_mm_mul_ps(ci, pr), _mm_mul_ps(cr, pi));
+    return fastAtan2x4(im, re);
+}
+
+#endif
+
+
+/**
+ * The angle between each sample and the one before it, which is the
+ * instantaneous frequency.  The product is not normalized, since the
+ * angle does not depend on the magnitude.  With SSE2, 8 samples are
+ * done per pass.
+ */
+static void fmDiscriminate(float complex *in, float complex lastVal, float *out, int count)
+{
+    int i = 0;
+    if (count > 0)
+        {
+        float complex prod = in[0] * conjf(lastVal);
+        out[0] = fastAtan2(cimagf(prod), crealf(prod));
+        i = 1;
+        }
+#ifdef __SSE2__
+    float *f = (float *)in;
+    for ( ; i + 8 <= count ; i += 8)
+        {
+        _mm_storeu_ps(out + i,     fmDiscriminate4(f + 2 * i));
+        _mm_storeu_ps(out + i + 4, fmDiscriminate4(f + 2 * i + 8));
+        }
+#endif
+    for ( ; i < count ; i++)
+        {
+        float complex prod = in[i] * conjf(in[i-1]);
+        out[i] = fastAtan2(cimagf(prod), crealf(prod));
+        }
+}
+
+
 static void fmDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
+    float *buf = demodBlock(dem, func, context);
+    if (!buf)
+        return;
     int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
+    int blockSize = dem->blockSize;
     float complex lastVal = dem->lastVal;
-    while (size--)
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float complex prod = cpx * conj(lastVal);
-        lastVal = cpx;
-        
-        // limit (remove the amplitude variations)
-        float m = cabsf(prod);
-        if (m > 0.0)
-            prod /= m;
-            
-        //get the angle
-        float v = cargf(prod);
-        
-        //trace("v:%f",v);
-        buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int count = blockSize - bufPtr;
+        if (count > size)
+            count = size;
+        fmDiscriminate(data, lastVal, buf + bufPtr, count);
+        lastVal = data[count-1];
+        data   += count;
+        size   -= count;
+        bufPtr += count;
+        if (bufPtr >= blockSize)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
             bufPtr = 0;
+            if (!buf)
+                break;
             }
         }
     dem->lastVal = lastVal;
@@ -108,80 +284,1136 @@ static void fmDemodulate(Demodulator *dem, float complex *data, int size, FloatO
                 
 Demodulator *demodFmCreate()
 {
-    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    Demodulator *dem = demodAlloc();
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
-    dem->lastVal = 0;
-    dem->update  = fmDemodulate;
+    dem->update = fmDemodulate;
     return dem;
 }
 
-static void lsbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+/**
+ * The Weaver method of taking one sideband.  The middle of the sideband
+ * is mixed down to 0 Hz, where a lowpass of half the sideband's width
+ * keeps it and takes off the rest, and it is mixed back up to where it
+ * was.  The real part of that is the audio.  The lowpass has real
+ * coefficients, so it is half the work of a complex bandpass or a
+ * Hilbert transformer of the same length.
+ *
+ * The filter's transition is within the sideband, so the lowest and
+ * highest WEAVER_TRANSITION/2 of it are lost, as in any SSB receiver.
+ */
+#define WEAVER_STEP       256    //samples mixed and filtered at a time
+#define WEAVER_TRANSITION 0.1    //width of the lowpass's transition, as a part of the sideband's
+#define WEAVER_MIN_TAPS   15
+#define WEAVER_MAX_TAPS   255
+
+typedef struct
+{
+    float complex osc;     //mixing phasor at the middle of the sideband
+    float complex oscStep;
+    Fir   *lowpass;        //NULL if the sideband has no width
+} Weaver;
+
+
+static void weaverReset(Weaver *w)
+{
+    w->osc = 1.0;
+    if (w->lowpass)
+        firReset(w->lowpass);
+}
+
+
+/**
+ * Keep lo to hi, in Hz from 0
+ */
+static void weaverSet(Weaver *w, float inRate, float lo, float hi)
+{
+    float width = hi - lo;
+    float omega = TWOPI * 0.5 * (lo + hi) / inRate;
+    w->oscStep = cos(omega) + sin(omega) * I;
+    if (w->lowpass)
+        firDelete(w->lowpass);
+    w->lowpass = NULL;
+    if (width > 0.0)
+        {
+        //a Hamming window's transition is about 3.3/taps of the rate
+        float transition = WEAVER_TRANSITION * width;
+        int taps = (int)(3.3 * inRate / transition);
+        taps = (taps < WEAVER_MIN_TAPS) ? WEAVER_MIN_TAPS :
+               (taps > WEAVER_MAX_TAPS) ? WEAVER_MAX_TAPS : taps;
+        w->lowpass = firLP(taps, 0.5 * (width - transition), inRate, W_HAMMING);
+        if (!w->lowpass)
+            error("weaver: could not create the lowpass");
+        }
+    weaverReset(w);
+}
+
+
+static void weaverFree(Weaver *w)
 {
+    if (w->lowpass)
+        firDelete(w->lowpass);
+    w->lowpass = NULL;
+}
+
+
+/**
+ * Take the sideband of n <= WEAVER_STEP samples, each multiplied by
+ * 'gain', into out.  The mixing is done in real arithmetic, since a
+ * complex multiply is a library call unless the compiler may ignore
+ * infinities.
+ */
+static void weaverUpdate(Weaver *w, float complex *data, float *out, int n, float gain)
+{
+    float zr = crealf(w->osc);
+    float zi = cimagf(w->osc);
+    float sr = crealf(w->oscStep);
+    float si = cimagf(w->oscStep);
+    float oscRe[WEAVER_STEP];
+    float oscIm[WEAVER_STEP];
+    float complex v[WEAVER_STEP];
+    for (int i = 0 ; i < n ; i++)
+        {
+        oscRe[i] = zr;
+        oscIm[i] = zi;
+        float r = zr * sr - zi * si;
+        zi = zr * si + zi * sr;
+        zr = r;
+        }
+    //keep it on the unit circle
+    float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+    w->osc = (zr * g) + (zi * g) * I;
+    //down, by the conjugate of the phasor
+    for (int i = 0 ; i < n ; i++)
+        {
+        float xr = crealf(data[i]);
+        float xi = cimagf(data[i]);
+        v[i] = (xr * oscRe[i] + xi * oscIm[i]) + (xi * oscRe[i] - xr * oscIm[i]) * I;
+        }
+    if (w->lowpass)
+        firUpdateBlockC(w->lowpass, v, n);
+    else
+        memset(v, 0, n * sizeof(float complex));
+    //and back up, keeping only the real part
+    for (int i = 0 ; i < n ; i++)
+        out[i] = (crealf(v[i]) * oscRe[i] - cimagf(v[i]) * oscIm[i]) * gain;
+}
+
+
+
+/**
+ * Single sideband.  All of it runs at the IF rate out of the ddc, which
+ * is only twice the passband.
+ */
+#define SSB_DEFAULT_WIDTH 3000.0
+
+typedef struct
+{
+    int    lower;          //true for LSB, which takes the part of the passband below the vfo
+    Weaver weaver;
+} Ssb;
+
+
+static void ssbReset(Demodulator *dem)
+{
+    Ssb *ssb = (Ssb *)dem->state;
+    weaverReset(&ssb->weaver);
+    dem->lastVal = 0;
+}
+
+
+static void ssbSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi)
+{
+    Ssb *ssb = (Ssb *)dem->state;
+    if (inRate <= 0.0)
+        return;
+    //a passband across the vfo has both sidebands.  Keep ours
+    if (pbLo < 0.0 && pbHi > 0.0)
+        {
+        if (ssb->lower)
+            pbHi = 0.0;
+        else
+            pbLo = 0.0;
+        }
+    weaverSet(&ssb->weaver, inRate, pbLo, pbHi);
+    dem->lastVal = 0;
+}
+
+
+static void ssbDestroy(Demodulator *dem)
+{
+    Ssb *ssb = (Ssb *)dem->state;
+    if (ssb)
+        weaverFree(&ssb->weaver);
+    free(ssb);
+}
+
+
+static void ssbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+{
+    Ssb *ssb = (Ssb *)dem->state;
+    float *buf = demodBlock(dem, func, context);
+    if (!buf)
+        return;
     int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
-    while (size--)
+    int blockSize = dem->blockSize;
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float v = creal(cpx) - cimag(cpx);
-        //trace("v:%f",v);
-        buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = blockSize - bufPtr;
+        if (n > WEAVER_STEP)
+            n = WEAVER_STEP;
+        if (n > size)
+            n = size;
+        weaverUpdate(&ssb->weaver, data, buf + bufPtr, n, 1.0f);
+        data   += n;
+        size   -= n;
+        bufPtr += n;
+        if (bufPtr >= blockSize)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
             bufPtr = 0;
+            if (!buf)
+                break;
             }
         }
-    dem->bufPtr  = bufPtr;
+    dem->bufPtr = bufPtr;
 }
 
 
-Demodulator *demodLsbCreate()
+static Demodulator *ssbCreate(int lower)
 {
-    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    Demodulator *dem = demodAlloc();
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
+    Ssb *ssb = (Ssb *)smalloc(sizeof(Ssb));
+    if (!ssb)
+        {
+        free(dem);
+        return NULL;
+        }
+    memset(ssb, 0, sizeof(Ssb));
+    ssb->lower       = lower;
+    dem->state       = ssb;
+    dem->update      = ssbDemodulate;
+    dem->reset       = ssbReset;
+    dem->setPassband = ssbSetPassband;
+    dem->destroy     = ssbDestroy;
+    float width = SSB_DEFAULT_WIDTH;
+    ssbSetPassband(dem, 2.0 * width, (lower) ? -width : 0.0, (lower) ? 0.0 : width);
+    if (!ssb->weaver.lowpass)
+        {
+        demodDelete(dem);
+        return NULL;
+        }
+    return dem;
+}
+
+
+Demodulator *demodLsbCreate()
+{
+    return ssbCreate(TRUE);
+}
+
+
+Demodulator *demodUsbCreate()
+{
+    return ssbCreate(FALSE);
+}
+
+
+
+/**
+ * Synchronous AM.  A PLL locks a reference to the carrier, and the
+ * signal turned back by the reference is the carrier as a real DC level
+ * plus the sidebands.  Its real part, less the carrier, is the audio.
+ * Unlike the envelope, it does not distort when selective fading takes
+ * more of the carrier than of the sidebands, and either sideband may be
+ * taken alone, away from interference on the other.
+ *
+ * As in the stereo decoder, the reference is made a step at a time with
+ * the frequency held, and the phase is measured on the sum over the
+ * step, so only the loop update is done per step and the rest are plain
+ * loops.  Until it locks, the frequency is also pulled in by the average
+ * phase change from one sample to the next over the step, which the
+ * sidebands and the noise add little to, and the phase loop then takes
+ * over.
+ *
+ * Until it locks, the output is the envelope, less its average.
+ */
+#define SAM_STEP         32
+#define SAM_DEFAULT_RATE 10000.0
+#define SAM_RANGE        500.0   //Hz either side of the vfo the carrier may be found
+#define SAM_LOOP_FREQ    25.0    //natural frequency of the PLL, Hz
+#define SAM_LOOP_DAMPING 0.707
+#define SAM_FLL_GAIN     0.2     //of the frequency error, per step, before lock
+#define SAM_CARRIER_TIME 0.1     //seconds to average the carrier level over
+#define SAM_LOCK_TIME    0.05    //seconds to average the lock detector over
+#define SAM_LOCK_ON      0.8     //cosine of the phase error, averaged, to lock
+#define SAM_LOCK_OFF     0.5
+#define SAM_FADE         0.25    //carrier below this part of its average holds the loop
+
+typedef struct
+{
+    Sideband sideband;
+    float  inRate;
+    float  pbLo;
+    float  pbHi;
+    float complex ref;     //carrier reference, as a unit phasor
+    float  freq;           //of the reference, in radians/sample
+    float  freqLimit;
+    float  alpha;          //loop gains, for phase and frequency
+    float  beta;
+    float complex lastY;   //last sample turned back, for the frequency detector
+    float  carrier;        //average level, taken off as DC
+    float  carrierCoeff;
+    float  lock;           //average cosine of the phase error
+    float  lockCoeff;
+    int    locked;
+    Weaver weaver;         //of the sideband, if only one is wanted
+} Sam;
+
+
+static void samReset(Demodulator *dem)
+{
+    Sam *sam = (Sam *)dem->state;
+    sam->ref     = 1.0;
+    sam->freq    = 0.0;
+    sam->lastY   = 0.0;
+    sam->carrier = 0.0;
+    sam->lock    = 0.0;
+    sam->locked  = FALSE;
+    weaverReset(&sam->weaver);
     dem->lastVal = 0;
-    dem->update  = lsbDemodulate;
+}
+
+
+/**
+ * Set the sideband's filter from the passband
+ */
+static void samSetWeaver(Sam *sam)
+{
+    float lo = (sam->pbLo < 0.0) ? sam->pbLo : -0.5 * sam->inRate;
+    float hi = (sam->pbHi > 0.0) ? sam->pbHi :  0.5 * sam->inRate;
+    if (sam->sideband == SIDEBAND_LOWER)
+        weaverSet(&sam->weaver, sam->inRate, lo, 0.0);
+    else if (sam->sideband == SIDEBAND_UPPER)
+        weaverSet(&sam->weaver, sam->inRate, 0.0, hi);
+    else
+        weaverFree(&sam->weaver);
+}
+
+
+static void samSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi)
+{
+    Sam *sam = (Sam *)dem->state;
+    if (inRate <= 0.0)
+        return;
+    sam->inRate = inRate;
+    sam->pbLo   = pbLo;
+    sam->pbHi   = pbHi;
+    float stepTime = (float)SAM_STEP / inRate;
+    float range = SAM_RANGE;
+    if (range > 0.25 * inRate)
+        range = 0.25 * inRate;
+    sam->freqLimit = TWOPI * range / inRate;
+    float wnT = TWOPI * SAM_LOOP_FREQ * stepTime;
+    sam->alpha = 2.0 * SAM_LOOP_DAMPING * wnT;
+    sam->beta  = wnT * wnT;
+    sam->carrierCoeff = 1.0 - exp(-stepTime / SAM_CARRIER_TIME);
+    sam->lockCoeff    = 1.0 - exp(-stepTime / SAM_LOCK_TIME);
+    samSetWeaver(sam);
+    samReset(dem);
+}
+
+
+static void samDestroy(Demodulator *dem)
+{
+    Sam *sam = (Sam *)dem->state;
+    if (sam)
+        weaverFree(&sam->weaver);
+    free(sam);
+}
+
+
+/**
+ * Turn n samples back by the reference, into v, and move the loop on
+ * @return the carrier level of the step, from the sum if locked, else
+ *     from the envelope, which is put in out
+ */
+static float samStep(Sam *sam, float complex *data, float complex *v, float *out, int n)
+{
+    float zr = crealf(sam->ref);
+    float zi = cimagf(sam->ref);
+    float sr = cosf(sam->freq);
+    float si = sinf(sam->freq);
+    float refRe[SAM_STEP];
+    float refIm[SAM_STEP];
+    for (int i = 0 ; i < n ; i++)
+        {
+        refRe[i] = zr;
+        refIm[i] = zi;
+        float r = zr * sr - zi * si;
+        zi = zr * si + zi * sr;
+        zr = r;
+        }
+    float sumRe = 0.0f;
+    float sumIm = 0.0f;
+    for (int i = 0 ; i < n ; i++)
+        {
+        float xr = crealf(data[i]);
+        float xi = cimagf(data[i]);
+        float yr = xr * refRe[i] + xi * refIm[i];
+        float yi = xi * refRe[i] - xr * refIm[i];
+        v[i] = yr + yi * I;
+        sumRe += yr;
+        sumIm += yi;
+        }
+    float complex sum = (sumRe + sumIm * I) / (float)n;
+    float level = crealf(sum);
+    float mag = cabsf(sum);
+    float complex lastY = sam->lastY;
+    sam->lastY = v[n-1];
+
+    //hold the loop while the carrier is faded, else it follows the noise
+    if (mag > SAM_FADE * sam->carrier || !sam->locked)
+        {
+        float err = atan2f(cimagf(sum), crealf(sum));
+        float freq = sam->freq + sam->beta * err / (float)SAM_STEP;
+        if (!sam->locked)
+            {
+            //the sum of each sample times the conjugate of the one before
+            float *y = (float *)v;
+            float turnRe = crealf(v[0]) * crealf(lastY) + cimagf(v[0]) * cimagf(lastY);
+            float turnIm = cimagf(v[0]) * crealf(lastY) - crealf(v[0]) * cimagf(lastY);
+            for (int i = 1 ; i < n ; i++)
+                {
+                turnRe += y[2*i]   * y[2*i-2] + y[2*i+1] * y[2*i-1];
+                turnIm += y[2*i+1] * y[2*i-2] - y[2*i]   * y[2*i-1];
+                }
+            freq += SAM_FLL_GAIN * atan2f(turnIm, turnRe);
+            }
+        float lim = sam->freqLimit;
+        sam->freq = (freq < -lim) ? -lim : (freq > lim) ? lim : freq;
+        float corr = sam->alpha * err;
+        float cr = cosf(corr);
+        float ci = sinf(corr);
+        float r = zr * cr - zi * ci;
+        zi = zr * ci + zi * cr;
+        zr = r;
+        float cosErr = (mag > 0.0f) ? cosf(err) : 0.0f;
+        sam->lock += sam->lockCoeff * (cosErr - sam->lock);
+        }
+    float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+    sam->ref = (zr * g) + (zi * g) * I;
+
+    if (!sam->locked && sam->lock > SAM_LOCK_ON)
+        sam->locked = TRUE;
+    else if (sam->locked && sam->lock < SAM_LOCK_OFF)
+        sam->locked = FALSE;
+
+    if (sam->locked)
+        return level;
+    float env = 0.0f;
+    for (int i = 0 ; i < n ; i++)
+        {
+        out[i] = cabsf(data[i]);
+        env += out[i];
+        }
+    return env / (float)n;
+}
+
+
+static void samDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+{
+    Sam *sam = (Sam *)dem->state;
+    float *buf = demodBlock(dem, func, context);
+    if (!buf)
+        return;
+    int bufPtr = dem->bufPtr;
+    int blockSize = dem->blockSize;
+    float complex v[SAM_STEP];
+    while (size > 0)
+        {
+        int n = blockSize - bufPtr;
+        if (n > SAM_STEP)
+            n = SAM_STEP;
+        if (n > size)
+            n = size;
+        float *out = buf + bufPtr;
+        float level = samStep(sam, data, v, out, n);
+        sam->carrier += sam->carrierCoeff * (level - sam->carrier);
+        float carrier = sam->carrier;
+        if (!sam->locked)
+            {
+            for (int i = 0 ; i < n ; i++)
+                out[i] -= carrier;
+            }
+        else if (sam->weaver.lowpass)
+            {
+            //one sideband has half the audio of both
+            for (int i = 0 ; i < n ; i++)
+                v[i] -= carrier;
+            weaverUpdate(&sam->weaver, v, out, n, 2.0f);
+            }
+        else
+            {
+            for (int i = 0 ; i < n ; i++)
+                out[i] = crealf(v[i]) - carrier;
+            }
+        data   += n;
+        size   -= n;
+        bufPtr += n;
+        if (bufPtr >= blockSize)
+            {
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
+            bufPtr = 0;
+            if (!buf)
+                break;
+            }
+        }
+    dem->bufPtr = bufPtr;
+}
+
+
+Demodulator *demodSamCreate()
+{
+    Demodulator *dem = demodAlloc();
+    if (!dem)
+        return NULL;
+    Sam *sam = (Sam *)smalloc(sizeof(Sam));
+    if (!sam)
+        {
+        free(dem);
+        return NULL;
+        }
+    memset(sam, 0, sizeof(Sam));
+    sam->sideband    = SIDEBAND_BOTH;
+    dem->state       = sam;
+    dem->update      = samDemodulate;
+    dem->reset       = samReset;
+    dem->setPassband = samSetPassband;
+    dem->destroy     = samDestroy;
+    samSetPassband(dem, SAM_DEFAULT_RATE, -0.5 * SAM_DEFAULT_RATE, 0.5 * SAM_DEFAULT_RATE);
     return dem;
 }
 
-static void usbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+
+void demodSamSetSideband(Demodulator *dem, Sideband sideband)
+{
+    if (!dem || dem->update != samDemodulate)
+        return;
+    Sam *sam = (Sam *)dem->state;
+    if (sideband == sam->sideband)
+        return;
+    sam->sideband = sideband;
+    samSetWeaver(sam);
+}
+
+
+/**
+ * CW.  The carrier is at the vfo.  A lowpass of half the filter's width
+ * keeps it and takes off the rest, and it is mixed up to the BFO tone,
+ * whose real part is the audio.  As in SSB, it all runs at the IF rate,
+ * which has to be more than twice the tone.
+ *
+ * The keying detector, if there is a function to tell, is a Goertzel
+ * filter at the tone over blocks of CW_KEY_TIME.  The key is down once
+ * the tone is most of the way from the recent floor to the recent peak,
+ * for long enough that it is not a burst of noise.
+ */
+#define CW_STEP         256
+#define CW_DEFAULT_RATE 10000.0
+#define CW_BFO          700.0
+#define CW_WIDTH        500.0
+#define CW_TRANSITION   0.5     //of the lowpass, as a part of the width
+#define CW_MIN_TAPS     15
+#define CW_MAX_TAPS     255
+#define CW_KEY_TIME     0.005   //seconds per Goertzel block
+#define CW_PEAK_TIME    2.0     //seconds for the peak to fall back
+#define CW_FLOOR_TIME   5.0     //and for the floor to rise
+#define CW_KEY_ON       0.6     //of the way from the floor to the peak, to key down
+#define CW_KEY_OFF      0.4
+#define CW_CONTRAST     4.0     //least peak over floor that is keyed
+#define CW_KEY_BLOCKS   2       //a change has to last this many blocks, against noise
+
+typedef struct
+{
+    float  inRate;
+    float  bfo;
+    float  width;
+    Fir    *lowpass;
+    float complex osc;     //the BFO, as a unit phasor
+    float complex oscStep;
+    KeyOutputFunc *keyFunc; //NULL for no keying detector
+    void   *keyContext;
+    int    keyLen;         //samples per Goertzel block
+    int    keyCount;
+    float  coeff;          //2cos of the tone, in radians/sample
+    float  s1;
+    float  s2;
+    float  peak;
+    float  floor;
+    float  peakCoeff;      //per block
+    float  floorCoeff;
+    int    down;
+    int    changed;        //blocks that have disagreed with down
+    long long keySamples;  //since the key last changed
+} Cw;
+
+
+static void cwReset(Demodulator *dem)
 {
+    Cw *cw = (Cw *)dem->state;
+    cw->osc        = 1.0;
+    cw->keyCount   = 0;
+    cw->s1         = 0.0;
+    cw->s2         = 0.0;
+    cw->peak       = 0.0;
+    cw->floor      = 0.0;
+    cw->down       = FALSE;
+    cw->changed    = 0;
+    cw->keySamples = 0;
+    if (cw->lowpass)
+        firReset(cw->lowpass);
+    dem->lastVal = 0;
+}
+
+
+/**
+ * Work out the filter, the BFO and the detector from the rate and the
+ * settings.  The tone and the filter around it are kept under the
+ * Nyquist frequency.
+ */
+static void cwUpdate(Demodulator *dem)
+{
+    Cw *cw = (Cw *)dem->state;
+    float inRate = cw->inRate;
+    float width = cw->width;
+    if (width > 0.8 * inRate)
+        width = 0.8 * inRate;
+    float bfo = cw->bfo;
+    if (bfo + 0.5 * width > 0.45 * inRate)
+        bfo = 0.45 * inRate - 0.5 * width;
+    float omega = TWOPI * bfo / inRate;
+    cw->oscStep = cos(omega) + sin(omega) * I;
+    cw->coeff   = 2.0 * cos(omega);
+    float transition = CW_TRANSITION * width;
+    int taps = (int)(3.3 * inRate / transition);
+    taps = (taps < CW_MIN_TAPS) ? CW_MIN_TAPS : (taps > CW_MAX_TAPS) ? CW_MAX_TAPS : taps;
+    if (cw->lowpass)
+        firDelete(cw->lowpass);
+    cw->lowpass = firLP(taps, 0.5 * width, inRate, W_HAMMING);
+    if (!cw->lowpass)
+        error("cw: could not create the lowpass");
+    cw->keyLen = (int)(CW_KEY_TIME * inRate + 0.5);
+    if (cw->keyLen < 8)
+        cw->keyLen = 8;
+    float blockTime = (float)cw->keyLen / inRate;
+    cw->peakCoeff  = 1.0 - exp(-blockTime / CW_PEAK_TIME);
+    cw->floorCoeff = 1.0 - exp(-blockTime / CW_FLOOR_TIME);
+    cwReset(dem);
+}
+
+
+static void cwSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi)
+{
+    Cw *cw = (Cw *)dem->state;
+    if (inRate <= 0.0)
+        return;
+    cw->inRate = inRate;
+    cwUpdate(dem);
+}
+
+
+static void cwDestroy(Demodulator *dem)
+{
+    Cw *cw = (Cw *)dem->state;
+    if (cw && cw->lowpass)
+        firDelete(cw->lowpass);
+    free(cw);
+}
+
+
+/**
+ * Decide the key from one Goertzel block
+ */
+static void cwKeyBlock(Cw *cw, float s1, float s2)
+{
+    float power = s1 * s1 + s2 * s2 - cw->coeff * s1 * s2;
+    float m = 2.0f * sqrtf((power > 0.0f) ? power : 0.0f) / (float)cw->keyLen;
+    cw->peak  += ((m > cw->peak)  ? 1.0f : cw->peakCoeff)  * (m - cw->peak);
+    cw->floor += ((m < cw->floor) ? 1.0f : cw->floorCoeff) * (m - cw->floor);
+    float span = cw->peak - cw->floor;
+    int down = cw->down;
+    if (cw->peak < CW_CONTRAST * cw->floor)
+        down = FALSE;
+    else if (!down && m > cw->floor + CW_KEY_ON * span)
+        down = TRUE;
+    else if (down && m < cw->floor + CW_KEY_OFF * span)
+        down = FALSE;
+    cw->keySamples += cw->keyLen;
+    if (down == cw->down)
+        cw->changed = 0;
+    else if (++cw->changed >= CW_KEY_BLOCKS)
+        {
+        //the change started that many blocks ago
+        long long changedSamples = (long long)cw->changed * cw->keyLen;
+        cw->down    = down;
+        cw->changed = 0;
+        cw->keyFunc(down, (float)(cw->keySamples - changedSamples) / cw->inRate, cw->keyContext);
+        cw->keySamples = changedSamples;
+        }
+}
+
+
+/**
+ * Run the Goertzel filter over n samples of audio
+ */
+static void cwKey(Cw *cw, float *x, int n)
+{
+    float coeff = cw->coeff;
+    float s1 = cw->s1;
+    float s2 = cw->s2;
+    int count = cw->keyCount;
+    for (int i = 0 ; i < n ; i++)
+        {
+        float s = x[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s;
+        if (++count >= cw->keyLen)
+            {
+            cwKeyBlock(cw, s1, s2);
+            s1 = 0.0f;
+            s2 = 0.0f;
+            count = 0;
+            }
+        }
+    cw->s1 = s1;
+    cw->s2 = s2;
+    cw->keyCount = count;
+}
+
+
+static void cwDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+{
+    Cw *cw = (Cw *)dem->state;
+    float *buf = demodBlock(dem, func, context);
+    if (!buf || !cw->lowpass)
+        return;
     int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
-    while (size--)
+    int blockSize = dem->blockSize;
+    float complex v[CW_STEP];
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float v = creal(cpx) + cimag(cpx);
-        //trace("v:%f",v);
-        buf[bufPtr++] = v * 100.0;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = blockSize - bufPtr;
+        if (n > CW_STEP)
+            n = CW_STEP;
+        if (n > size)
+            n = size;
+        memcpy(v, data, n * sizeof(float complex));
+        firUpdateBlockC(cw->lowpass, v, n);
+        //up to the tone, in real arithmetic
+        float *out = buf + bufPtr;
+        float zr = crealf(cw->osc);
+        float zi = cimagf(cw->osc);
+        float sr = crealf(cw->oscStep);
+        float si = cimagf(cw->oscStep);
+        for (int i = 0 ; i < n ; i++)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
+            out[i] = crealf(v[i]) * zr - cimagf(v[i]) * zi;
+            float r = zr * sr - zi * si;
+            zi = zr * si + zi * sr;
+            zr = r;
+            }
+        float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+        cw->osc = (zr * g) + (zi * g) * I;
+        if (cw->keyFunc)
+            cwKey(cw, out, n);
+        data   += n;
+        size   -= n;
+        bufPtr += n;
+        if (bufPtr >= blockSize)
+            {
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
             bufPtr = 0;
+            if (!buf)
+                break;
             }
         }
-    dem->bufPtr  = bufPtr;
+    dem->bufPtr = bufPtr;
 }
 
 
-Demodulator *demodUsbCreate()
+Demodulator *demodCwCreate()
 {
-    Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
+    Demodulator *dem = demodAlloc();
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
+    Cw *cw = (Cw *)smalloc(sizeof(Cw));
+    if (!cw)
+        {
+        free(dem);
+        return NULL;
+        }
+    memset(cw, 0, sizeof(Cw));
+    cw->inRate       = CW_DEFAULT_RATE;
+    cw->bfo          = CW_BFO;
+    cw->width        = CW_WIDTH;
+    dem->state       = cw;
+    dem->update      = cwDemodulate;
+    dem->reset       = cwReset;
+    dem->setPassband = cwSetPassband;
+    dem->destroy     = cwDestroy;
+    cwUpdate(dem);
+    if (!cw->lowpass)
+        {
+        demodDelete(dem);
+        return NULL;
+        }
+    return dem;
+}
+
+
+void demodCwSet(Demodulator *dem, float bfo, float width)
+{
+    if (!dem || dem->update != cwDemodulate || width <= 0.0)
+        return;
+    Cw *cw = (Cw *)dem->state;
+    bfo = (bfo > 0.0) ? bfo : 0.0;
+    if (bfo == cw->bfo && width == cw->width)
+        return;
+    cw->bfo   = bfo;
+    cw->width = width;
+    cwUpdate(dem);
+}
+
+
+void demodCwSetKeyOutput(Demodulator *dem, KeyOutputFunc *func, void *context)
+{
+    if (!dem || dem->update != cwDemodulate)
+        return;
+    Cw *cw = (Cw *)dem->state;
+    cw->keyFunc    = NULL;
+    cw->keyContext = context;
+    cw->keyFunc    = func;
+}
+
+
+
+/**
+ * FSK.  The mark is half the shift above the vfo and the space half
+ * below.  Each is mixed down to 0 Hz and summed over a symbol, which is
+ * the matched filter of a tone held for a symbol, and the output is the
+ * difference of their energies over their sum: +1 for mark, -1 for
+ * space and about 0 for noise, for a client to slice into bits.  The
+ * tones are either side of 0 Hz, so one phasor mixes both, one way and
+ * the other.  The sums are kept running, and made over again from the
+ * rings of mixed samples each time they go round, so that rounding does
+ * not build up.  The rings hold one symbol, and are made to fit it.
+ */
+#define FSK_STEP         64
+#define FSK_DEFAULT_RATE 10000.0
+#define FSK_SHIFT        170.0
+#define FSK_BAUD         45.45
+#define FSK_MAX_SYMBOL   1024
+
+typedef struct
+{
+    float  inRate;
+    float  shift;
+    float  baud;
+    float complex osc;     //at the mark, as a unit phasor
+    float complex oscStep;
+    int    symLen;         //samples per symbol
+    float complex *mark;   //rings of the last symLen samples, mixed down
+    float complex *space;
+    int    ringPos;
+    float complex markSum;
+    float complex spaceSum;
+} Fsk;
+
+
+static void fskReset(Demodulator *dem)
+{
+    Fsk *fsk = (Fsk *)dem->state;
+    fsk->osc      = 1.0;
+    fsk->ringPos  = 0;
+    fsk->markSum  = 0.0;
+    fsk->spaceSum = 0.0;
+    memset(fsk->mark, 0, fsk->symLen * sizeof(float complex));
+    memset(fsk->space, 0, fsk->symLen * sizeof(float complex));
     dem->lastVal = 0;
-    dem->update  = usbDemodulate;
+}
+
+
+/**
+ * @return false if the rings could not be made.  The demodulator
+ *     then gives no output
+ */
+static int fskUpdate(Demodulator *dem)
+{
+    Fsk *fsk = (Fsk *)dem->state;
+    float omega = TWOPI * 0.5 * fsk->shift / fsk->inRate;
+    fsk->oscStep = cos(omega) + sin(omega) * I;
+    int symLen = (int)(fsk->inRate / fsk->baud + 0.5);
+    symLen = (symLen < 1) ? 1 : (symLen > FSK_MAX_SYMBOL) ? FSK_MAX_SYMBOL : symLen;
+    if (symLen != fsk->symLen)
+        {
+        free(fsk->mark);
+        free(fsk->space);
+        fsk->mark   = (float complex *)smalloc(symLen * sizeof(float complex));
+        fsk->space  = (float complex *)smalloc(symLen * sizeof(float complex));
+        fsk->symLen = symLen;
+        if (!fsk->mark || !fsk->space)
+            {
+            free(fsk->mark);
+            free(fsk->space);
+            fsk->mark   = NULL;
+            fsk->space  = NULL;
+            fsk->symLen = 0;
+            return FALSE;
+            }
+        }
+    fskReset(dem);
+    return TRUE;
+}
+
+
+static void fskSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi)
+{
+    Fsk *fsk = (Fsk *)dem->state;
+    if (inRate <= 0.0)
+        return;
+    fsk->inRate = inRate;
+    fskUpdate(dem);
+}
+
+
+static void fskDestroy(Demodulator *dem)
+{
+    Fsk *fsk = (Fsk *)dem->state;
+    if (fsk)
+        {
+        free(fsk->mark);
+        free(fsk->space);
+        }
+    free(fsk);
+}
+
+
+/**
+ * Make the sums over again from the rings
+ */
+static void fskResum(Fsk *fsk)
+{
+    float mr = 0.0f, mi = 0.0f, sr = 0.0f, si = 0.0f;
+    for (int i = 0 ; i < fsk->symLen ; i++)
+        {
+        mr += crealf(fsk->mark[i]);
+        mi += cimagf(fsk->mark[i]);
+        sr += crealf(fsk->space[i]);
+        si += cimagf(fsk->space[i]);
+        }
+    fsk->markSum  = mr + mi * I;
+    fsk->spaceSum = sr + si * I;
+}
+
+
+static void fskDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+{
+    Fsk *fsk = (Fsk *)dem->state;
+    if (!fsk->symLen)
+        return;
+    float *buf = demodBlock(dem, func, context);
+    if (!buf)
+        return;
+    int bufPtr = dem->bufPtr;
+    int blockSize = dem->blockSize;
+    int symLen = fsk->symLen;
+    float complex *mark  = fsk->mark;
+    float complex *space = fsk->space;
+    float oscRe[FSK_STEP];
+    float oscIm[FSK_STEP];
+    while (size > 0)
+        {
+        int n = blockSize - bufPtr;
+        if (n > FSK_STEP)
+            n = FSK_STEP;
+        if (n > size)
+            n = size;
+        float zr = crealf(fsk->osc);
+        float zi = cimagf(fsk->osc);
+        float sr = crealf(fsk->oscStep);
+        float si = cimagf(fsk->oscStep);
+        for (int i = 0 ; i < n ; i++)
+            {
+            oscRe[i] = zr;
+            oscIm[i] = zi;
+            float r = zr * sr - zi * si;
+            zi = zr * si + zi * sr;
+            zr = r;
+            }
+        float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+        fsk->osc = (zr * g) + (zi * g) * I;
+
+        float *out = buf + bufPtr;
+        float mr = crealf(fsk->markSum);
+        float mi = cimagf(fsk->markSum);
+        float pr = crealf(fsk->spaceSum);
+        float pi = cimagf(fsk->spaceSum);
+        int pos = fsk->ringPos;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float xr = crealf(data[i]);
+            float xi = cimagf(data[i]);
+            //the mark down by the phasor's conjugate, the space up by it
+            float ar = xr * oscRe[i] + xi * oscIm[i];
+            float ai = xi * oscRe[i] - xr * oscIm[i];
+            float br = xr * oscRe[i] - xi * oscIm[i];
+            float bi = xi * oscRe[i] + xr * oscIm[i];
+            mr += ar - crealf(mark[pos]);
+            mi += ai - cimagf(mark[pos]);
+            pr += br - crealf(space[pos]);
+            pi += bi - cimagf(space[pos]);
+            mark[pos]  = ar + ai * I;
+            space[pos] = br + bi * I;
+            float em = mr * mr + mi * mi;
+            float es = pr * pr + pi * pi;
+            out[i] = (em - es) / (em + es + FLT_MIN);
+            if (++pos >= symLen)
+                {
+                pos = 0;
+                fskResum(fsk);
+                mr = crealf(fsk->markSum);
+                mi = cimagf(fsk->markSum);
+                pr = crealf(fsk->spaceSum);
+                pi = cimagf(fsk->spaceSum);
+                }
+            }
+        fsk->ringPos  = pos;
+        fsk->markSum  = mr + mi * I;
+        fsk->spaceSum = pr + pi * I;
+        data   += n;
+        size   -= n;
+        bufPtr += n;
+        if (bufPtr >= blockSize)
+            {
+            func(buf, bufPtr, context);
+            buf = dem->outBuf = (float *)blockRenewFloat(buf);
+            bufPtr = 0;
+            if (!buf)
+                break;
+            }
+        }
+    dem->bufPtr = bufPtr;
+}
+
+
+Demodulator *demodFskCreate()
+{
+    Demodulator *dem = demodAlloc();
+    if (!dem)
+        return NULL;
+    Fsk *fsk = (Fsk *)smalloc(sizeof(Fsk));
+    if (!fsk)
+        {
+        free(dem);
+        return NULL;
+        }
+    memset(fsk, 0, sizeof(Fsk));
+    dem->state       = fsk;
+    dem->update      = fskDemodulate;
+    dem->reset       = fskReset;
+    dem->setPassband = fskSetPassband;
+    dem->destroy     = fskDestroy;
+    fsk->inRate = FSK_DEFAULT_RATE;
+    fsk->shift  = FSK_SHIFT;
+    fsk->baud   = FSK_BAUD;
+    if (!fskUpdate(dem))
+        {
+        demodDelete(dem);
+        return NULL;
+        }
     return dem;
 }
 
 
+void demodFskSet(Demodulator *dem, float shift, float baud)
+{
+    if (!dem || dem->update != fskDemodulate || shift <= 0.0 || baud <= 0.0)
+        return;
+    Fsk *fsk = (Fsk *)dem->state;
+    if (shift == fsk->shift && baud == fsk->baud)
+        return;
+    fsk->shift = shift;
+    fsk->baud  = baud;
+    fskUpdate(dem);
+}
+
+
+Demodulator *demodCreate(Mode mode)
+{
+    switch (mode)
+        {
+        case MODE_NULL:
+            return demodNullCreate();
+        case MODE_AM:
+            return demodAmCreate();
+        case MODE_FM:
+        case MODE_WFM:
+            return demodFmCreate();
+        case MODE_LSB:
+            return demodLsbCreate();
+        case MODE_USB:
+            return demodUsbCreate();
+        case MODE_SAM:
+            return demodSamCreate();
+        case MODE_CW:
+            return demodCwCreate();
+        case MODE_FSK:
+            return demodFskCreate();
+        default:
+            return NULL;
+        }
+}
+
+
+void demodSetBlockSize(Demodulator *dem, int samples)
+{
+    if (dem)
+        dem->blockSize = (samples <= 0 || samples > DEMOD_BUFSIZE) ? DEMOD_BUFSIZE : samples;
+}
+
+
 void demodDelete(Demodulator *dem)
 {
+    if (!dem)
+        return;
+    if (dem->destroy)
+        dem->destroy(dem);
+    blockRelease(dem->outBuf);
     free(dem);
 }
 
+
+void demodReset(Demodulator *dem)
+{
+    if (dem && dem->reset)
+        dem->reset(dem);
+}
+
+
+void demodSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi)
+{
+    if (!dem || !dem->setPassband)
+        return;
+    if (inRate == dem->inRate && pbLo == dem->pbLo && pbHi == dem->pbHi)
+        return;
+    dem->inRate = inRate;
+    dem->pbLo   = pbLo;
+    dem->pbHi   = pbHi;
+    dem->setPassband(dem, inRate, pbLo, pbHi);
+}
@@ -30,18 +30,27 @@
 
 
 #include "sdrlib.h"
+#include "pool.h"
 
 
 
-#define DEMOD_BUFSIZE (16384)
+#define DEMOD_BUFSIZE (POOL_BLOCK_SAMPLES)
 
 
 struct Demodulator
 {
     void (*update)(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context);
+    void (*reset)(Demodulator *dem);
+    void (*setPassband)(Demodulator *dem, float inRate, float pbLo, float pbHi); //NULL if it does not matter
+    void (*destroy)(Demodulator *dem); //frees state.  NULL if there is none
     float complex lastVal;
     int   bufPtr;
-    float outBuf[DEMOD_BUFSIZE];
+    int   blockSize; //samples per output block, up to DEMOD_BUFSIZE
+    float inRate;    //as last given to demodSetPassband()
+    float pbLo;
+    float pbHi;
+    float *outBuf; //pool block being filled
+    void  *state;  //of the modes which need more than lastVal
 };
 
 
@@ -49,10 +58,88 @@ struct Demodulator
 Demodulator *demodNullCreate();
 Demodulator *demodAmCreate();
 Demodulator *demodFmCreate();
+
+/**
+ * Single sideband, by the Weaver method.  The sideband is the part of the
+ * passband on its side of the vfo, or the whole passband if it is all on
+ * one side, so the passband offsets select what is heard.  Both start with
+ * a passband of 0 to 3 kHz, on their own side, until demodSetPassband().
+ */
 Demodulator *demodLsbCreate();
 Demodulator *demodUsbCreate();
+
+/**
+ * Synchronous AM, with a PLL locked to the carrier.  Both sidebands at
+ * first.
+ */
+Demodulator *demodSamCreate();
+
+/**
+ * Take one sideband of synchronous AM, or both.  The width of one is up
+ * to the edge of the passband on its side.  Does nothing to the other
+ * modes, or if the sideband is the same.
+ */
+void demodSamSetSideband(Demodulator *dem, Sideband sideband);
+
+/**
+ * CW.  The carrier at the vfo comes out as a tone of the BFO frequency,
+ * through a filter of the given width around it.
+ */
+Demodulator *demodCwCreate();
+
+/**
+ * Rebuilds the filter and starts over, unless neither has changed
+ * @param bfo the tone, in Hz
+ * @param width of the filter, in Hz
+ */
+void demodCwSet(Demodulator *dem, float bfo, float width);
+
+/**
+ * Detect the key from the tone, and call func when it changes.
+ * NULL stops the detector.
+ */
+void demodCwSetKeyOutput(Demodulator *dem, KeyOutputFunc *func, void *context);
+
+/**
+ * FSK, with the mark shift/2 above the vfo and the space shift/2 below.
+ * The output is a soft bit from -1, space, to +1, mark.
+ */
+Demodulator *demodFskCreate();
+
+/**
+ * Starts over, unless neither has changed
+ * @param shift between the tones, in Hz
+ * @param baud symbols per second
+ */
+void demodFskSet(Demodulator *dem, float shift, float baud);
+
+/**
+ * The demodulator for a mode, with its defaults.  WFM has the FM one.
+ * @return NULL if the mode is unknown, or on failure
+ */
+Demodulator *demodCreate(Mode mode);
+
 void demodDelete(Demodulator *dem);
 
+/**
+ * Output blocks of at most 'samples', for lower latency.  0 for
+ * DEMOD_BUFSIZE, the default.
+ */
+void demodSetBlockSize(Demodulator *dem, int samples);
+
+/**
+ * Clear any state carried from one sample to the next,
+ * such as after a gap in the input
+ */
+void demodReset(Demodulator *dem);
+
+/**
+ * Tell the demodulator the rate of its input, and the passband offsets
+ * from the vfo that the ddc was set to, for the modes that use them.
+ * Does nothing if they are the same as last time.
+ */
+void demodSetPassband(Demodulator *dem, float inRate, float pbLo, float pbHi);
+
 
 #endif /* _DEMOD_H_ */
 
@@ -109,7 +109,34 @@ static int deviceScanDir(char *deviceDir, int type, Device **outbuf, int maxDevi
             {
             //trace("got dynamic lib");
             void *sym = dlsym(dlib, "deviceCreate");
-            if (sym)
+            void *countSym = dlsym(dlib, "deviceCount");
+            void *indexedSym = dlsym(dlib, "deviceCreateIndexed");
+            if (countSym && indexedSym)
+                {
+                DeviceCountFunc *countFunc = (DeviceCountFunc *)countSym;
+                DeviceOpenIndexedFunc *func = (DeviceOpenIndexedFunc *)indexedSym;
+                int units = countFunc();
+                for (int i = 0 ; i < units && count < maxDevices ; i++)
+                    {
+                    Device *dev = (Device *)malloc(sizeof(Device));
+                    if (!dev)
+                        {
+                        error("creating Device info structure");
+                        return count;
+                        }
+                    memset(dev, 0, sizeof(Device));
+                    if (func(dev, &parent, i))
+                        {
+                        trace("Loaded device: %s", dev->name);
+                        outbuf[count++] = dev;
+                        }
+                    else
+                        {
+                        free(dev);
+                        }
+                    }
+                }
+            else if (sym)
                 {
                 //trace("got function");
                 DeviceOpenFunc *func = (DeviceOpenFunc *)sym;
@@ -119,6 +146,8 @@ static int deviceScanDir(char *deviceDir, int type, Device **outbuf, int maxDevi
                     error("creating Device info structure");
                     return count;
                     }
+                //so that optional members not set by the plugin are NULL
+                memset(dev, 0, sizeof(Device));
                 int ret = func(dev, &parent);
                 if (ret)
                     {
@@ -38,6 +38,35 @@ typedef enum
 } DeviceType;
 
 
+/**
+ * Formats a device may deliver samples in
+ */
+typedef enum
+{
+    SAMPLE_FLOAT = 0, //float complex.  The default
+    SAMPLE_U8         //interleaved unsigned 8-bit I,Q pairs, centered on 127.5
+} SampleFormat;
+
+
+
+/**
+ * Describes a block of samples borrowed from a device with readPeek().
+ * The memory still belongs to the device, and is only valid until
+ * the matching call to readRelease().
+ *
+ * seq counts every sample the hardware produced, including any the
+ * device had to drop, so a block whose seq is not the previous block's
+ * seq + size follows a gap in the data.
+ */
+typedef struct
+{
+    float complex      *data;  //set for SAMPLE_FLOAT
+    unsigned char      *bytes; //set for SAMPLE_U8, 2 bytes per sample
+    int                size;   //in complex samples
+    unsigned long long seq;    //number of the first sample, counting from open()
+    unsigned long long time;   //when the first sample was captured, in ns of
+                               //CLOCK_MONOTONIC.  0 if the device cannot tell
+} DeviceBlock;
 
 
 
@@ -110,17 +139,60 @@ struct Device
      */
     double (*getCenterFrequency)(void *ctx);
     
+    /**
+     * Select the SampleFormat used by readPeek().  Call this before open().
+     * Optional.  Devices without it only deliver SAMPLE_FLOAT.
+     * @return true if the device supports the format, else false
+     */
+    int (*setFormat)(void *ctx, int format);
+
     /**
      * Read/write complex data to/from the device
      * @return number of samples read
      */
     int (*read)(void *ctx, float complex *buf, int buflen);
+    /**
+     * Borrow the next block of complex data directly from the device's
+     * buffers, without copying.  Each successful call must be matched
+     * by a call to readRelease() before the next readPeek().
+     * Optional.  Devices that do not support it leave this NULL.
+     * @return true if a block was available, else false
+     */
+    int (*readPeek)(void *ctx, DeviceBlock *block);
+    /**
+     * Give the block obtained by readPeek() back to the device
+     * @return true if successful, else false
+     */
+    int (*readRelease)(void *ctx);
+    /**
+     * Block until data is ready to be read, the device is closed, or
+     * timeoutMs milliseconds have passed, whichever comes first.
+     * Optional.  If NULL, readers will poll.
+     * @return true if data is ready, else false
+     */
+    int (*readWait)(void *ctx, int timeoutMs);
     /**
      * Read/write complex data to/from the device
      * @return true if successful, else false
      */
     int (*write)(void *ctx, float complex *buf, int datalen);
     
+    /**
+     * Get the counters kept since open()
+     * Optional.
+     * @return true if successful, else false
+     */
+    int (*getStats)(void *ctx, DeviceStats *stats);
+
+    /**
+     * Ask for blocks of about this many samples, or 0 for the device's
+     * own size.  Smaller blocks arrive sooner after the samples in them
+     * are captured, at the cost of more overhead per sample.
+     * Optional.
+     * @return true if successful, else false
+     */
+    int (*setBlockSize)(void *ctx, int size);
+
     /**
      * True to set the device into transmit mode
      * @return true if successful, else false
@@ -148,6 +220,14 @@ struct Parent
 
 typedef int DeviceOpenFunc(Device *, Parent *);
 
+/**
+ * Plugins for hardware that can have several units attached may also
+ * export deviceCount() and deviceCreateIndexed().  Then one Device is
+ * created for each unit, instead of calling deviceCreate() once.
+ */
+typedef int DeviceCountFunc(void);
+typedef int DeviceOpenIndexedFunc(Device *, Parent *, int index);
+
 
 
 #endif /* _DEVICE_H_ */
@@ -83,6 +83,28 @@ fasterlog2 (float x)
 
 
 
+static void fftCompute(Fft *fft, FftOutputFunc *func, void *context)
+{
+    int N = fft->N;
+    fftw_execute(fft->plan);
+    unsigned int *ps = fft->spectrum;
+    int half = N>>1;
+    fftw_complex *lower = fft->out;
+    fftw_complex *upper = fft->out + half;
+    int count = half;
+    while (count--)
+        {
+        *ps++ = (unsigned int)(20.0 * fasterlog2(1.0 + cabsf(*upper++)));
+        }
+    count = half;
+    while (count--)
+        {
+        *ps++ = (unsigned int)(20.0 * fasterlog2(1.0 + cabsf(*lower++)));
+        }
+    func(fft->spectrum, N, context);
+}
+
+
 void fftUpdate(Fft *fft, float complex *inbuf, int count, FftOutputFunc *func, void *context)
 {
     float complex *in = inbuf;
@@ -97,22 +119,35 @@ void fftUpdate(Fft *fft, float complex *inbuf, int count, FftOutputFunc *func, v
         if (inPtr >= N)
             {
             inPtr = 0;
-            fftw_execute(fft->plan);
-            unsigned int *ps = fft->spectrum;
-            int half = N>>1;
-            fftw_complex *lower = fft->out;
-            fftw_complex *upper = fft->out + half;
-            int count = half;
-            while (count--)
-                {
-                *ps++ = (unsigned int)(20.0 * fasterlog2(1.0 + cabsf(*upper++)));
-                }
-            count = half;
-            while (count--)
-                {
-                *ps++ = (unsigned int)(20.0 * fasterlog2(1.0 + cabsf(*lower++)));
-                }
-            func(fft->spectrum, N, context);
+            fftCompute(fft, func, context);
+            fft->skipCounter = 0;
+            }
+        }
+    fft->inPtr = inPtr;
+}
+
+
+void fftUpdateBytes(Fft *fft, unsigned char *inbuf, int count, FftOutputFunc *func, void *context)
+{
+    unsigned char *in = inbuf;
+    fftw_complex  *fftwin = fft->in;
+    int N     = fft->N;
+    int inPtr = fft->inPtr;
+    while (count--)
+        {
+        if ((fft->skipCounter++) < fft->threshold)
+            {
+            in += 2;
+            continue;
+            }
+        float re = ((float)in[0] - 127.5) / 128.0;
+        float im = ((float)in[1] - 127.5) / 128.0;
+        in += 2;
+        fftwin[inPtr++] = re + im * I;
+        if (inPtr >= N)
+            {
+            inPtr = 0;
+            fftCompute(fft, func, context);
             fft->skipCounter = 0;
             }
         }
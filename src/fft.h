@@ -64,5 +64,11 @@ typedef void FftOutputFunc(unsigned int *vals, int size, void *context);
 
 void fftUpdate(Fft *fft, float complex *inbuf, int count, FftOutputFunc *func, void *context);
 
+/**
+ * Same as fftUpdate(), but for raw interleaved unsigned 8-bit I/Q.
+ * Only the samples actually transformed are converted to float.
+ */
+void fftUpdateBytes(Fft *fft, unsigned char *inbuf, int count, FftOutputFunc *func, void *context);
+
 #endif /* _FFT_H_ */
 
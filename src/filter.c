@@ -129,6 +129,68 @@ float complex firUpdateC(Fir *fir, float complex sample)
 }
 
 
+
+void firReset(Fir *fir)
+{
+    memset(fir->delayLine, 0, fir->size * sizeof(float));
+    memset(fir->delayLineC, 0, fir->size * sizeof(float complex));
+    fir->delayIndex = 0;
+}
+
+
+/**
+ * Add the products of n interleaved complex samples with n real
+ * coefficients to sum[0] and sum[1].  Float adds may not be reordered
+ * by the compiler, so the sums are split four ways here, which lets
+ * them be vectorized and keeps them from waiting on each other.
+ */
+static inline void firDotC(float *v, float *c, int n, float *sum)
+{
+    float r0 = 0.0f, i0 = 0.0f, r1 = 0.0f, i1 = 0.0f;
+    float r2 = 0.0f, i2 = 0.0f, r3 = 0.0f, i3 = 0.0f;
+    int k = 0;
+    for ( ; k + 4 <= n ; k += 4)
+        {
+        r0 += v[2*k]   * c[k];   i0 += v[2*k+1] * c[k];
+        r1 += v[2*k+2] * c[k+1]; i1 += v[2*k+3] * c[k+1];
+        r2 += v[2*k+4] * c[k+2]; i2 += v[2*k+5] * c[k+2];
+        r3 += v[2*k+6] * c[k+3]; i3 += v[2*k+7] * c[k+3];
+        }
+    for ( ; k < n ; k++)
+        {
+        r0 += v[2*k]   * c[k];
+        i0 += v[2*k+1] * c[k];
+        }
+    sum[0] += (r0 + r1) + (r2 + r3);
+    sum[1] += (i0 + i1) + (i2 + i3);
+}
+
+
+/**
+ * The delay line is the one firUpdateC() uses, newest first from
+ * delayIndex.  The window for each output is walked in its two pieces,
+ * rather than with a modulo per tap.
+ */
+void firUpdateBlockC(Fir *fir, float complex *data, int size)
+{
+    float complex *delayLine = fir->delayLineC;
+    float *coeffs = fir->coeffs;
+    int firSize = fir->size;
+    int delayIndex = fir->delayIndex;
+    for (int i = 0 ; i < size ; i++)
+        {
+        delayLine[delayIndex] = data[i];
+        int head = firSize - delayIndex;
+        float sum[2] = { 0.0f, 0.0f };
+        firDotC((float *)(delayLine + delayIndex), coeffs, head, sum);
+        firDotC((float *)delayLine, coeffs + head, delayIndex, sum);
+        data[i] = sum[0] + sum[1] * I;
+        delayIndex = (delayIndex) ? delayIndex-1 : firSize-1;
+        }
+    fir->delayIndex = delayIndex;
+}
+
+
 static void windowize(int size, float *coeffs, int windowType)
 {
     int i = 0;
@@ -262,7 +324,23 @@ Fir *firBP(int size, float loCutoffFreq, float hiCutoffFreq, float sampleRate, i
 static Biquad *biquadCreate()
 {
     Biquad *bq = (Biquad *)malloc(sizeof(Biquad));
-    memset(bq, 0, sizeof(Biquad));
+    if (bq)
+        memset(bq, 0, sizeof(Biquad));
+    return bq;
+}
+
+/**
+ * Divide through by a0, so that the update need not
+ */
+static Biquad *biquadNormalize(Biquad *bq)
+{
+    float a0 = bq->a0;
+    bq->b0 /= a0;
+    bq->b1 /= a0;
+    bq->b2 /= a0;
+    bq->a1 /= a0;
+    bq->a2 /= a0;
+    bq->a0 = 1.0;
     return bq;
 }
 
@@ -271,23 +349,57 @@ void biquadDelete(Biquad *bq)
     free(bq);
 }
 
+void biquadReset(Biquad *bq)
+{
+    bq->x1  = bq->x2  = bq->y1  = bq->y2  = 0.0;
+    bq->x1c = bq->x2c = bq->y1c = bq->y2c = 0.0;
+}
+
+/**
+ * Direct form I:  y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+ */
 float biquadUpdate(Biquad *bq, float v)
 {
-   float y = v * bq->a0 + bq->x1 * bq->a1 + bq->x2 * bq->a2 - bq->y1 * bq->b1 - bq->y2 * bq->b2;
+   float y = v * bq->b0 + bq->x1 * bq->b1 + bq->x2 * bq->b2 - bq->y1 * bq->a1 - bq->y2 * bq->a2;
    bq->x2 = bq->x1 ; bq->x1 = v ; bq->y2 = bq->y1 ; bq->y1 = y;
    return y;
 }
 
 float complex biquadUpdateC(Biquad *bq, float complex v)
 {
-   float y = v * bq->a0 + bq->x1c * bq->a1 + bq->x2c * bq->a2 - bq->y1c * bq->b1 - bq->y2c * bq->b2;
+   float complex y = v * bq->b0 + bq->x1c * bq->b1 + bq->x2c * bq->b2 - bq->y1c * bq->a1 - bq->y2c * bq->a2;
    bq->x2c = bq->x1c ; bq->x1c = v ; bq->y2c = bq->y1c ; bq->y1c = y;
    return y;
 }
 
+void biquadUpdateBlockC(Biquad *bq, float complex *data, int size)
+{
+    float b0 = bq->b0, b1 = bq->b1, b2 = bq->b2, a1 = bq->a1, a2 = bq->a2;
+    float x1r = crealf(bq->x1c), x1i = cimagf(bq->x1c);
+    float x2r = crealf(bq->x2c), x2i = cimagf(bq->x2c);
+    float y1r = crealf(bq->y1c), y1i = cimagf(bq->y1c);
+    float y2r = crealf(bq->y2c), y2i = cimagf(bq->y2c);
+    for (int i = 0 ; i < size ; i++)
+        {
+        float vr = crealf(data[i]);
+        float vi = cimagf(data[i]);
+        float yr = vr * b0 + x1r * b1 + x2r * b2 - y1r * a1 - y2r * a2;
+        float yi = vi * b0 + x1i * b1 + x2i * b2 - y1i * a1 - y2i * a2;
+        x2r = x1r ; x1r = vr ; y2r = y1r ; y1r = yr;
+        x2i = x1i ; x1i = vi ; y2i = y1i ; y1i = yi;
+        data[i] = yr + yi * I;
+        }
+    bq->x1c = x1r + x1i * I;
+    bq->x2c = x2r + x2i * I;
+    bq->y1c = y1r + y1i * I;
+    bq->y2c = y2r + y2i * I;
+}
+
 Biquad *biquadLP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
     float freq = TWOPI * frequency / sampleRate;
     float alpha = sin(freq) / (2.0 * q);
@@ -297,12 +409,14 @@ Biquad *biquadLP(float frequency, float sampleRate, float q)
     bq->a0 =  1.0 + alpha;
     bq->a1 = -2.0 * cos(freq);
     bq->a2 =  1.0 - alpha;
-    return bq;
+    return biquadNormalize(bq);
 }
 
 Biquad *biquadHP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
     float freq = TWOPI * frequency / sampleRate;
     float alpha = sin(freq) / (2.0 * q);
@@ -312,12 +426,14 @@ Biquad *biquadHP(float frequency, float sampleRate, float q)
     bq->a0 =  1.0 + alpha;
     bq->a1 = -2.0 * cos(freq);
     bq->a2 =  1.0 - alpha;
-    return bq;
+    return biquadNormalize(bq);
 }
 
 Biquad *biquadBP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
     float freq = TWOPI * frequency / sampleRate;
     float alpha = sin(freq) / (2.0 * q);
@@ -327,12 +443,14 @@ Biquad *biquadBP(float frequency, float sampleRate, float q)
     bq->a0 =  1.0 + alpha;
     bq->a1 = -2.0 * cos(freq);
     bq->a2 =  1.0 - alpha;
-    return bq;
+    return biquadNormalize(bq);
 }
 
 Biquad *biquadBR(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
     float freq = TWOPI * frequency / sampleRate;
     float alpha = sin(freq) / (2.0 * q);
@@ -342,7 +460,7 @@ Biquad *biquadBR(float frequency, float sampleRate, float q)
     bq->a0 =  1.0 + alpha;
     bq->a1 = -2.0 * cos(freq);
     bq->a2 =  1.0 - alpha;
-    return bq;
+    return biquadNormalize(bq);
 }
 
 
@@ -50,7 +50,7 @@ struct Fir
 };
 
 
-enum
+typedef enum
 {
     W_NONE,
     W_HAMMING,
@@ -91,6 +91,19 @@ float firUpdate(Fir *fir, float sample);
 float complex firUpdateC(Fir *fir, float complex sample);
 
 
+/**
+ * Clear the filter history
+ */
+void firReset(Fir *fir);
+
+
+/**
+ * Filter 'size' complex samples in place.  The same as firUpdateC() on
+ * each, and shares its history, but without the per-tap modulo.
+ */
+void firUpdateBlockC(Fir *fir, float complex *data, int size);
+
+
 /**
  * Create a FIR lowpass filter
  */
@@ -136,10 +149,21 @@ struct Biquad
 
 void biquadDelete(Biquad *bq);
 
+/**
+ * Clear the filter history
+ */
+void biquadReset(Biquad *bq);
+
 float biquadUpdate(Biquad *bq, float v);
 
 float complex biquadUpdateC(Biquad *bq, float complex v);
 
+/**
+ * Filter 'size' samples in place.  The same as biquadUpdateC() on each,
+ * but the history stays in registers for the whole block.
+ */
+void biquadUpdateBlockC(Biquad *bq, float complex *data, int size);
+
 Biquad *biquadLP(float frequency, float sampleRate, float q);
 
 Biquad *biquadHP(float frequency, float sampleRate, float q);
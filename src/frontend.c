@@ -0,0 +1,234 @@
+/**
+ * Fixed-point front end for raw 8-bit IQ devices.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frontend.h"
+#include "private.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+Frontend *frontendCreate(int stages)
+{
+    Frontend *obj = (Frontend *)smalloc(sizeof(Frontend));
+    if (!obj)
+        return NULL;
+    obj->buf = (float complex *)blockAlloc();
+    if (!obj->buf)
+        {
+        free(obj);
+        return NULL;
+        }
+    frontendSetStages(obj, stages);
+    return obj;
+}
+
+
+void frontendDelete(Frontend *obj)
+{
+    if (!obj)
+        return;
+    blockRelease(obj->buf);
+    free(obj);
+}
+
+
+void frontendSetStages(Frontend *obj, int stages)
+{
+    if (stages < 0)
+        stages = 0;
+    else if (stages > FRONTEND_MAX_STAGES)
+        stages = FRONTEND_MAX_STAGES;
+    obj->stages = stages;
+    for (int s = 0 ; s <= FRONTEND_MAX_STAGES ; s++)
+        {
+        FrontendStage *st = &(obj->stage[s]);
+        memset(st->i, 0, sizeof(st->i));
+        memset(st->q, 0, sizeof(st->q));
+        //start with a full history of zeros, except for the output buffer
+        st->len = (s < stages) ? FRONTEND_TAPS - 1 : 0;
+        }
+}
+
+
+void frontendReset(Frontend *obj)
+{
+    frontendSetStages(obj, obj->stages);
+}
+
+
+int frontendGetFactor(Frontend *obj)
+{
+    return 1 << obj->stages;
+}
+
+
+/**
+ * float complex is laid out as re,im pairs, so the interleaved bytes map
+ * one-to-one onto the output floats.  With SSE2, each pass widens 16
+ * bytes to four vectors of 32-bit ints, converts them, and scales them.
+ */
+void frontendConvert(unsigned char *data, float complex *out, int size)
+{
+    float *f = (float *)out;
+    int n = size * 2;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i zero   = _mm_setzero_si128();
+    __m128  offset = _mm_set1_ps(127.5f);
+    __m128  scale  = _mm_set1_ps(1.0f / 128.0f);
+    for ( ; i + 16 <= n ; i += 16)
+        {
+        __m128i b  = _mm_loadu_si128((__m128i *)(data + i));
+        __m128i lo = _mm_unpacklo_epi8(b, zero);
+        __m128i hi = _mm_unpackhi_epi8(b, zero);
+        __m128  v0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+        __m128  v1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+        __m128  v2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+        __m128  v3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+        _mm_storeu_ps(f + i,      _mm_mul_ps(_mm_sub_ps(v0, offset), scale));
+        _mm_storeu_ps(f + i + 4,  _mm_mul_ps(_mm_sub_ps(v1, offset), scale));
+        _mm_storeu_ps(f + i + 8,  _mm_mul_ps(_mm_sub_ps(v2, offset), scale));
+        _mm_storeu_ps(f + i + 12, _mm_mul_ps(_mm_sub_ps(v3, offset), scale));
+        }
+#endif
+    for ( ; i < n ; i++)
+        f[i] = ((float)data[i] - 127.5f) * (1.0f / 128.0f);
+}
+
+
+/**
+ * Halfband lowpass, cutoff at 1/4 of the input rate, decimating by 2.
+ *
+ *    h = [ 3, 0, -25, 0, 150, 256, 150, 0, -25, 0, 3 ] / 512
+ *
+ * Half the taps are zero and the rest are symmetric, so only four
+ * multiplies per output are needed.  Dividing by 256 rather than 512
+ * gives each stage a gain of 2, which keeps one more bit of the
+ * precision gained by averaging.  There are no branches or carried
+ * dependencies, so the loop can be vectorized by the compiler.
+ */
+static void halfband(short *x, short *y, int nOut)
+{
+    for (int n = 0 ; n < nOut ; n++)
+        {
+        short *p = x + 2 * n;
+        int acc = 3   * (p[0] + p[10])
+                - 25  * (p[2] + p[8])
+                + 150 * (p[4] + p[6])
+                + 256 *  p[5];
+        y[n] = (short)((acc + 128) >> 8);
+        }
+}
+
+
+/**
+ * Filter what is in the stage's buffer, appending the output to 'out'.
+ * Keep the samples needed as history for the next pass.
+ */
+static void stageUpdate(FrontendStage *st, FrontendStage *out)
+{
+    int len = st->len;
+    if (len < FRONTEND_TAPS)
+        return;
+    int nOut = (len - FRONTEND_TAPS) / 2 + 1;
+    halfband(st->i, out->i + out->len, nOut);
+    halfband(st->q, out->q + out->len, nOut);
+    out->len += nOut;
+    int used   = 2 * nOut;
+    int remain = len - used;
+    memmove(st->i, st->i + used, remain * sizeof(short));
+    memmove(st->q, st->q + used, remain * sizeof(short));
+    st->len = remain;
+}
+
+
+void frontendUpdate(Frontend *obj, unsigned char *data, int size, ComplexOutputFunc *func, void *context)
+{
+    if (!obj->buf)
+        {
+        obj->buf = (float complex *)blockAlloc();
+        if (!obj->buf)
+            return;
+        }
+    int stages = obj->stages;
+    if (!stages)
+        {
+        while (size > 0)
+            {
+            int count = (size < FRONTEND_BLOCK) ? size : FRONTEND_BLOCK;
+            frontendConvert(data, obj->buf, count);
+            func(obj->buf, count, context);
+            obj->buf = (float complex *)blockRenew(obj->buf);
+            if (!obj->buf)
+                return;
+            data += 2 * count;
+            size -= count;
+            }
+        return;
+        }
+    FrontendStage *first = &(obj->stage[0]);
+    FrontendStage *last  = &(obj->stage[stages]);
+    //undo the headroom bits: one for the widening, one per stage
+    float scale = 1.0 / (float)(256 << stages);
+    while (size > 0)
+        {
+        int count = (size < FRONTEND_BLOCK) ? size : FRONTEND_BLOCK;
+        //widen to shorts, centered on 127.5, split into I and Q
+        short *si = first->i + first->len;
+        short *sq = first->q + first->len;
+        unsigned char *b = data;
+        for (int n = 0 ; n < count ; n++)
+            {
+            si[n] = (short)(2 * b[2*n]     - 255);
+            sq[n] = (short)(2 * b[2*n + 1] - 255);
+            }
+        first->len += count;
+        data += 2 * count;
+        size -= count;
+
+        for (int s = 0 ; s < stages ; s++)
+            stageUpdate(&(obj->stage[s]), &(obj->stage[s+1]));
+
+        //finally expand to float, at the reduced rate
+        int outLen = last->len;
+        float complex *buf = obj->buf;
+        for (int n = 0 ; n < outLen ; n++)
+            buf[n] = (float)last->i[n] * scale + (float)last->q[n] * scale * I;
+        last->len = 0;
+        if (outLen)
+            {
+            func(buf, outLen, context);
+            obj->buf = (float complex *)blockRenew(buf);
+            if (!obj->buf)
+                return;
+            }
+        }
+}
+
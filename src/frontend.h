@@ -0,0 +1,116 @@
+#ifndef _FRONTEND_H_
+#define _FRONTEND_H_
+/**
+ * Fixed-point front end for raw 8-bit IQ devices.
+ *
+ * Raw bytes are widened to shorts and decimated by 2 in each of
+ * a chain of halfband stages, using integer arithmetic only.
+ * Samples are converted to float complex only after the last stage,
+ * when the rate has already been reduced.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+
+
+#include "sdrlib.h"
+#include "pool.h"
+
+
+
+/**
+ * Most decimate-by-2 stages allowed.  Each stage adds one bit of
+ * headroom, so this also bounds the range of the shorts.
+ */
+#define FRONTEND_MAX_STAGES (4)
+
+/**
+ * Number of complex input samples processed per pass
+ */
+#define FRONTEND_BLOCK (4096)
+
+/**
+ * Length of the halfband filter.  Each stage keeps this many samples
+ * of history, minus one.
+ */
+#define FRONTEND_TAPS (11)
+
+
+typedef struct
+{
+    int   len; //history + pending samples in i[] and q[]
+    short i[FRONTEND_TAPS + FRONTEND_BLOCK];
+    short q[FRONTEND_TAPS + FRONTEND_BLOCK];
+} FrontendStage;
+
+
+struct Frontend
+{
+    int           stages;
+    FrontendStage stage[FRONTEND_MAX_STAGES + 1]; //the last one holds the output
+    float complex *buf; //pool block for the output
+};
+
+
+/**
+ * Create a front end with the given number of decimate-by-2 stages.
+ * Zero stages just converts to float complex.
+ */
+Frontend *frontendCreate(int stages);
+
+/**
+ *
+ */
+void frontendDelete(Frontend *obj);
+
+/**
+ * Change the number of stages.  This clears the filter history.
+ */
+void frontendSetStages(Frontend *obj, int stages);
+
+/**
+ * Clear the filter history, after a gap in the input
+ */
+void frontendReset(Frontend *obj);
+
+/**
+ * @return the overall decimation factor, 2^stages
+ */
+int frontendGetFactor(Frontend *obj);
+
+/**
+ * Convert 'size' complex samples of interleaved unsigned 8-bit I/Q to
+ * float complex, as (b - 127.5) / 128.   Uses SSE2 where available.
+ */
+void frontendConvert(unsigned char *data, float complex *out, int size);
+
+/**
+ * Process 'size' complex samples of interleaved unsigned 8-bit I/Q,
+ * calling func with the decimated float complex output.
+ */
+void frontendUpdate(Frontend *obj, unsigned char *data, int size, ComplexOutputFunc *func, void *context);
+
+
+
+#endif /* _FRONTEND_H_ */
+
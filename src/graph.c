@@ -0,0 +1,827 @@
+/**
+ * Processing graph.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _POSIX_C_SOURCE 200112L //for clock_gettime()
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "graph.h"
+#include "agc.h"
+#include "audio.h"
+#include "codec.h"
+#include "demod.h"
+#include "fft.h"
+#include "frontend.h"
+#include "rds.h"
+#include "samplerate.h"
+#include "squelch.h"
+#include "stereo.h"
+#include "private.h"
+
+
+static char *typeNames[] = { "none", "complex", "float", "uint", "byte", "iq8", "stereo" };
+
+
+int portTypeSize(PortType type)
+{
+    switch (type)
+        {
+        case PORT_COMPLEX: return sizeof(float complex);
+        case PORT_FLOAT:   return sizeof(float);
+        case PORT_UINT:    return sizeof(unsigned int);
+        case PORT_BYTE:    return sizeof(unsigned char);
+        case PORT_IQ8:     return 2 * sizeof(unsigned char);
+        case PORT_STEREO:  return 2 * sizeof(float);
+        default:           return 0;
+        }
+}
+
+
+/*############################################################################
+## N O D E
+############################################################################*/
+
+
+Node *nodeCreate(char *name, PortType inType, PortType outType, void *obj, NodeProcessFunc *process)
+{
+    Node *node = (Node *)smalloc(sizeof(Node));
+    if (!node)
+        return NULL;
+    memset(node, 0, sizeof(Node));
+    node->name = (char *)smalloc(strlen(name) + 1);
+    if (!node->name)
+        {
+        free(node);
+        return NULL;
+        }
+    strcpy(node->name, name);
+    strncpy(node->stats.name, name, sizeof(node->stats.name) - 1);
+    node->inType  = inType;
+    node->outType = outType;
+    node->obj     = obj;
+    node->process = process;
+    node->enabled = TRUE;
+    return node;
+}
+
+
+void nodeDelete(Node *node)
+{
+    if (!node)
+        return;
+    listDelete(node->outputs, NULL);
+    histogramDelete(node->latency);
+    free(node->buf);
+    free(node->name);
+    free(node);
+}
+
+
+int nodeConnect(Node *from, Node *to)
+{
+    if (from->outType == PORT_NONE || from->outType != to->inType)
+        {
+        error("Cannot connect %s (%s) to %s (%s)", from->name, typeNames[from->outType],
+            to->name, typeNames[to->inType]);
+        return FALSE;
+        }
+    List *outputs = listAppend(from->outputs, to);
+    if (!outputs)
+        return FALSE;
+    from->outputs = outputs;
+    return TRUE;
+}
+
+
+int nodeDisconnect(Node *from, Node *to)
+{
+    from->outputs = listRemove(from->outputs, to);
+    return TRUE;
+}
+
+
+int nodeInsert(Node *from, Node *node)
+{
+    if (node->inType != from->outType || node->outType != from->outType)
+        {
+        error("Cannot insert %s after %s: types differ", node->name, from->name);
+        return FALSE;
+        }
+    //the new node takes over the outputs
+    listDelete(node->outputs, NULL);
+    node->outputs = from->outputs;
+    from->outputs = NULL;
+    return nodeConnect(from, node);
+}
+
+
+void nodeSetEnabled(Node *node, int enabled)
+{
+    node->enabled = enabled;
+}
+
+
+int nodeSetBatch(Node *node, int samples)
+{
+    nodeFlush(node);
+    free(node->buf);
+    node->buf   = NULL;
+    node->batch = 0;
+    if (samples <= 0)
+        return TRUE;
+    node->buf = (unsigned char *)smalloc(samples * portTypeSize(node->inType));
+    if (!node->buf)
+        return FALSE;
+    node->batch = samples;
+    return TRUE;
+}
+
+
+static unsigned long long nodeNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static unsigned long long nodeRun(Node *node, void *data, int size);
+
+/**
+ * Once output, nothing is held back until the node processes more input
+ */
+void nodeOutput(Node *node, void *data, int size)
+{
+    unsigned long long stamp = (node->pendingStamp) ? node->pendingStamp : node->stamp;
+    node->pendingStamp = 0;
+    node->stats.samplesOut += size;
+    for (List *out = node->outputs ; out ; out = out->next)
+        {
+        Node *next = (Node *)out->data;
+        next->stamp = stamp;
+        node->outNanos += nodeRun(next, data, size);
+        }
+}
+
+
+/**
+ * Silence takes no time worth counting, so it is not timed.  A batch
+ * waiting in the node goes first, since it came before the silence.
+ */
+void nodeOutputSilence(Node *node, int size)
+{
+    for (List *out = node->outputs ; out ; out = out->next)
+        {
+        Node *next = (Node *)out->data;
+        if (!next->enabled)
+            {
+            if (next->inType == next->outType)
+                nodeOutputSilence(next, size);
+            continue;
+            }
+        nodeFlush(next);
+        if (next->silence)
+            next->silence(next, size);
+        }
+}
+
+
+/**
+ * Whatever the object still holds afterward came in with this input, or
+ * with earlier input if it did not output anything.
+ */
+static void nodeProcess(Node *node, void *data, int size)
+{
+    if (!node->pendingStamp)
+        node->pendingStamp = node->stamp;
+    if (node->latency && node->stamp)
+        {
+        unsigned long long wait = (node->delay) ? node->delay(node) : 0;
+        histogramRecord(node->latency, (nodeNanos() - node->stamp + wait) / 1000);
+        }
+    node->stats.calls++;
+    node->process(node, data, size);
+    if (!node->backlog || node->backlog(node) <= 0)
+        node->pendingStamp = 0;
+    else if (!node->pendingStamp)
+        node->pendingStamp = node->stamp;
+}
+
+
+void nodeFlush(Node *node)
+{
+    if (node->bufLen > 0)
+        {
+        int len = node->bufLen;
+        node->bufLen = 0;
+        nodeProcess(node, node->buf, len);
+        }
+}
+
+
+/**
+ * Whole batches are processed in place.  Only the remainder
+ * is copied, to wait for the next input.
+ */
+static void nodeAccept(Node *node, void *data, int size)
+{
+    node->stats.samplesIn += size;
+    if (!node->enabled)
+        {
+        if (node->inType == node->outType)
+            nodeOutput(node, data, size);
+        else
+            node->stats.dropped += size;
+        return;
+        }
+    int batch = node->batch;
+    if (!batch)
+        {
+        nodeProcess(node, data, size);
+        return;
+        }
+    int width = portTypeSize(node->inType);
+    unsigned char *in = (unsigned char *)data;
+    if (node->bufLen > 0)
+        {
+        int count = batch - node->bufLen;
+        if (count > size)
+            count = size;
+        memcpy(node->buf + node->bufLen * width, in, count * width);
+        node->bufLen += count;
+        in   += count * width;
+        size -= count;
+        if (node->bufLen < batch)
+            return;
+        nodeFlush(node);
+        }
+    int whole = size - size % batch;
+    if (whole > 0)
+        {
+        nodeProcess(node, in, whole);
+        in   += whole * width;
+        size -= whole;
+        }
+    if (size > 0)
+        {
+        memcpy(node->buf, in, size * width);
+        node->bufLen = size;
+        if (!node->pendingStamp)
+            node->pendingStamp = node->stamp;
+        }
+}
+
+
+/**
+ * Input is pushed all the way down the graph before this returns, so
+ * the time of the nodes after this one is taken out of its own.
+ * @return the time taken, in ns, including the nodes after this one
+ */
+static unsigned long long nodeRun(Node *node, void *data, int size)
+{
+    unsigned long long start = nodeNanos();
+    unsigned long long outBefore = node->outNanos;
+    nodeAccept(node, data, size);
+    unsigned long long elapsed = nodeNanos() - start;
+    node->stats.nanos += elapsed - (node->outNanos - outBefore);
+    return elapsed;
+}
+
+
+void nodeInput(Node *node, void *data, int size)
+{
+    nodeRun(node, data, size);
+}
+
+
+void nodeInputTimed(Node *node, void *data, int size, unsigned long long stamp)
+{
+    node->stamp = stamp;
+    nodeRun(node, data, size);
+}
+
+
+int nodeTrackLatency(Node *node)
+{
+    if (!node->latency)
+        node->latency = histogramCreate();
+    return (node->latency != NULL);
+}
+
+
+void nodeComplexOutput(float complex *data, int size, void *context)
+{
+    nodeOutput((Node *)context, data, size);
+}
+
+void nodeFloatOutput(float *data, int size, void *context)
+{
+    nodeOutput((Node *)context, data, size);
+}
+
+void nodeUintOutput(unsigned int *data, int size, void *context)
+{
+    nodeOutput((Node *)context, data, size);
+}
+
+void nodeByteOutput(unsigned char *data, int size, void *context)
+{
+    nodeOutput((Node *)context, data, size);
+}
+
+void nodeSilenceOutput(int size, void *context)
+{
+    nodeOutputSilence((Node *)context, size);
+}
+
+void nodeComplexInput(float complex *data, int size, void *context)
+{
+    nodeInput((Node *)context, data, size);
+}
+
+void nodeFloatInput(float *data, int size, void *context)
+{
+    nodeInput((Node *)context, data, size);
+}
+
+void nodeUintInput(unsigned int *data, int size, void *context)
+{
+    nodeInput((Node *)context, data, size);
+}
+
+void nodeByteInput(unsigned char *data, int size, void *context)
+{
+    nodeInput((Node *)context, data, size);
+}
+
+
+
+/*############################################################################
+## S T A N D A R D    N O D E S
+############################################################################*/
+
+
+static void fftProcess(Node *node, void *data, int size)
+{
+    fftUpdate((Fft *)node->obj, (float complex *)data, size, nodeUintOutput, node);
+}
+
+static int fftBacklog(Node *node)
+{
+    return ((Fft *)node->obj)->inPtr;
+}
+
+Node *fftNodeCreate(char *name, Fft *fft)
+{
+    Node *node = nodeCreate(name, PORT_COMPLEX, PORT_UINT, fft, fftProcess);
+    if (node)
+        node->backlog = fftBacklog;
+    return node;
+}
+
+
+static void fftBytesProcess(Node *node, void *data, int size)
+{
+    fftUpdateBytes((Fft *)node->obj, (unsigned char *)data, size, nodeUintOutput, node);
+}
+
+Node *fftBytesNodeCreate(char *name, Fft *fft)
+{
+    Node *node = nodeCreate(name, PORT_IQ8, PORT_UINT, fft, fftBytesProcess);
+    if (node)
+        node->backlog = fftBacklog;
+    return node;
+}
+
+
+static void frontendProcess(Node *node, void *data, int size)
+{
+    frontendUpdate((Frontend *)node->obj, (unsigned char *)data, size, nodeComplexOutput, node);
+}
+
+Node *frontendNodeCreate(char *name, Frontend *frontend)
+{
+    return nodeCreate(name, PORT_IQ8, PORT_COMPLEX, frontend, frontendProcess);
+}
+
+
+static void ddcProcess(Node *node, void *data, int size)
+{
+    ddcUpdate((Ddc *)node->obj, (float complex *)data, size, nodeComplexOutput, node);
+}
+
+static int ddcBacklog(Node *node)
+{
+    return ((Ddc *)node->obj)->bufPtr;
+}
+
+Node *ddcNodeCreate(char *name, Ddc *ddc)
+{
+    Node *node = nodeCreate(name, PORT_COMPLEX, PORT_COMPLEX, ddc, ddcProcess);
+    if (node)
+        node->backlog = ddcBacklog;
+    return node;
+}
+
+
+/**
+ * The demodulator can be swapped by setting node->obj
+ */
+static void demodProcess(Node *node, void *data, int size)
+{
+    Demodulator *dem = (Demodulator *)node->obj;
+    dem->update(dem, (float complex *)data, size, nodeFloatOutput, node);
+}
+
+static int demodBacklog(Node *node)
+{
+    return ((Demodulator *)node->obj)->bufPtr;
+}
+
+Node *demodNodeCreate(char *name, Demodulator *demod)
+{
+    Node *node = nodeCreate(name, PORT_COMPLEX, PORT_FLOAT, demod, demodProcess);
+    if (node)
+        node->backlog = demodBacklog;
+    return node;
+}
+
+
+static void resamplerProcess(Node *node, void *data, int size)
+{
+    resamplerUpdate((Resampler *)node->obj, (float *)data, size, nodeFloatOutput, node);
+}
+
+static int resamplerBacklog(Node *node)
+{
+    return ((Resampler *)node->obj)->bufPtr;
+}
+
+static void resamplerSilence(Node *node, int size)
+{
+    int n = resamplerSkip((Resampler *)node->obj, size, nodeFloatOutput, node);
+    if (n > 0)
+        nodeOutputSilence(node, n);
+}
+
+Node *resamplerNodeCreate(char *name, Resampler *resampler)
+{
+    Node *node = nodeCreate(name, PORT_FLOAT, PORT_FLOAT, resampler, resamplerProcess);
+    if (node)
+        {
+        node->backlog = resamplerBacklog;
+        node->silence = resamplerSilence;
+        }
+    return node;
+}
+
+
+/**
+ * The coefficients are real, so the complex resampler does the left
+ * and right channels independently
+ */
+static void resamplerStereoProcess(Node *node, void *data, int size)
+{
+    resamplerUpdateC((Resampler *)node->obj, (float complex *)data, size, nodeComplexOutput, node);
+}
+
+static void resamplerStereoSilence(Node *node, int size)
+{
+    int n = resamplerSkipC((Resampler *)node->obj, size, nodeComplexOutput, node);
+    if (n > 0)
+        nodeOutputSilence(node, n);
+}
+
+Node *resamplerStereoNodeCreate(char *name, Resampler *resampler)
+{
+    Node *node = nodeCreate(name, PORT_STEREO, PORT_STEREO, resampler, resamplerStereoProcess);
+    if (node)
+        {
+        node->backlog = resamplerBacklog;
+        node->silence = resamplerStereoSilence;
+        }
+    return node;
+}
+
+
+static void squelchProcess(Node *node, void *data, int size)
+{
+    squelchUpdate((Squelch *)node->obj, (float *)data, size, nodeFloatOutput, nodeSilenceOutput, node);
+}
+
+/**
+ * The audio is passed on in place, so nothing is held back
+ */
+Node *squelchNodeCreate(char *name, Squelch *squelch)
+{
+    Node *node = nodeCreate(name, PORT_FLOAT, PORT_FLOAT, squelch, squelchProcess);
+    if (node)
+        node->silence = nodeOutputSilence;
+    return node;
+}
+
+
+static void agcProcess(Node *node, void *data, int size)
+{
+    agcUpdate((Agc *)node->obj, (float *)data, size, nodeFloatOutput, node);
+}
+
+static int agcBacklog(Node *node)
+{
+    return agcGetBacklog((Agc *)node->obj);
+}
+
+static void agcSilence(Node *node, int size)
+{
+    int n = agcSkip((Agc *)node->obj, size, nodeFloatOutput, node);
+    if (n > 0)
+        nodeOutputSilence(node, n);
+}
+
+/**
+ * PORT_STEREO is given to nodeOutput() as it came, in pairs, which is
+ * what nodeFloatOutput() passes on
+ */
+Node *agcNodeCreate(char *name, Agc *agc)
+{
+    PortType type = (agc->channels == 2) ? PORT_STEREO : PORT_FLOAT;
+    Node *node = nodeCreate(name, type, type, agc, agcProcess);
+    if (node)
+        {
+        node->backlog = agcBacklog;
+        node->silence = agcSilence;
+        }
+    return node;
+}
+
+
+static void stereoProcess(Node *node, void *data, int size)
+{
+    stereoUpdate((Stereo *)node->obj, (float *)data, size, nodeComplexOutput, node);
+}
+
+static int stereoBacklog(Node *node)
+{
+    return ((Stereo *)node->obj)->bufPtr;
+}
+
+/**
+ * A frame of output for each sample of input
+ */
+static void stereoSilence(Node *node, int size)
+{
+    stereoFlush((Stereo *)node->obj, nodeComplexOutput, node);
+    nodeOutputSilence(node, size);
+}
+
+Node *stereoNodeCreate(char *name, Stereo *stereo)
+{
+    Node *node = nodeCreate(name, PORT_FLOAT, PORT_STEREO, stereo, stereoProcess);
+    if (node)
+        {
+        node->backlog = stereoBacklog;
+        node->silence = stereoSilence;
+        }
+    return node;
+}
+
+
+static void rdsProcess(Node *node, void *data, int size)
+{
+    rdsUpdate((Rds *)node->obj, (float *)data, size, (RdsOutputFunc *)node->func, node->context);
+}
+
+Node *rdsNodeCreate(char *name, Rds *rds)
+{
+    return nodeCreate(name, PORT_FLOAT, PORT_NONE, rds, rdsProcess);
+}
+
+
+static void audioProcess(Node *node, void *data, int size)
+{
+    audioPlay((Audio *)node->obj, (float *)data, size);
+}
+
+/**
+ * Audio is only heard once what is queued before it has played
+ */
+static unsigned long long audioDelay(Node *node)
+{
+    Audio *audio = (Audio *)node->obj;
+    return (audio) ? (unsigned long long)(audioGetDelay(audio) * 1.0e9) : 0;
+}
+
+Node *audioNodeCreate(char *name, Audio *audio)
+{
+    Node *node = nodeCreate(name, PORT_FLOAT, PORT_NONE, audio, audioProcess);
+    if (node)
+        node->delay = audioDelay;
+    return node;
+}
+
+
+static void audioStereoProcess(Node *node, void *data, int size)
+{
+    audioPlayStereo((Audio *)node->obj, (float *)data, size);
+}
+
+Node *audioStereoNodeCreate(char *name, Audio *audio)
+{
+    Node *node = nodeCreate(name, PORT_STEREO, PORT_NONE, audio, audioStereoProcess);
+    if (node)
+        node->delay = audioDelay;
+    return node;
+}
+
+
+static void codecProcess(Node *node, void *data, int size)
+{
+    codecEncode((Codec *)node->obj, (float *)data, size, nodeByteOutput, node);
+}
+
+static int codecBacklog(Node *node)
+{
+    Codec *codec = (Codec *)node->obj;
+    return codec->inbufPtr / codec->channels;
+}
+
+static void codecSilenceProcess(Node *node, int size)
+{
+    codecSilence((Codec *)node->obj, size, nodeByteOutput, node);
+}
+
+Node *codecNodeCreate(char *name, Codec *codec)
+{
+    PortType inType = (codec->channels == 2) ? PORT_STEREO : PORT_FLOAT;
+    Node *node = nodeCreate(name, inType, PORT_BYTE, codec, codecProcess);
+    if (node)
+        {
+        node->backlog = codecBacklog;
+        node->silence = codecSilenceProcess;
+        }
+    return node;
+}
+
+
+static void callbackProcess(Node *node, void *data, int size)
+{
+    void *func = node->func;
+    void *context = node->context;
+    if (!func)
+        return;
+    switch (node->inType)
+        {
+        case PORT_COMPLEX:
+            ((ComplexOutputFunc *)func)((float complex *)data, size, context);
+            break;
+        case PORT_FLOAT:
+        case PORT_STEREO:
+            ((FloatOutputFunc *)func)((float *)data, size, context);
+            break;
+        case PORT_UINT:
+            ((UintOutputFunc *)func)((unsigned int *)data, size, context);
+            break;
+        case PORT_BYTE:
+        case PORT_IQ8:
+            ((ByteOutputFunc *)func)((unsigned char *)data, size, context);
+            break;
+        default:
+            break;
+        }
+}
+
+Node *callbackNodeCreate(char *name, PortType type, void *func, void *context)
+{
+    Node *node = nodeCreate(name, type, PORT_NONE, NULL, callbackProcess);
+    if (node)
+        callbackNodeSet(node, func, context);
+    return node;
+}
+
+void callbackNodeSet(Node *node, void *func, void *context)
+{
+    node->func    = NULL;
+    node->context = context;
+    node->func    = func;
+}
+
+
+
+/*############################################################################
+## G R A P H
+############################################################################*/
+
+
+Graph *graphCreate()
+{
+    Graph *graph = (Graph *)smalloc(sizeof(Graph));
+    if (!graph)
+        return NULL;
+    graph->nodes = NULL;
+    return graph;
+}
+
+
+static void graphDeleteNode(void *data)
+{
+    nodeDelete((Node *)data);
+}
+
+void graphDelete(Graph *graph)
+{
+    if (!graph)
+        return;
+    listDelete(graph->nodes, graphDeleteNode);
+    free(graph);
+}
+
+
+Node *graphAdd(Graph *graph, Node *node)
+{
+    if (!node)
+        return NULL;
+    List *nodes = listAppend(graph->nodes, node);
+    if (!nodes)
+        {
+        nodeDelete(node);
+        return NULL;
+        }
+    graph->nodes = nodes;
+    return node;
+}
+
+
+Node *graphFind(Graph *graph, char *name)
+{
+    for (List *l = graph->nodes ; l ; l = l->next)
+        {
+        Node *node = (Node *)l->data;
+        if (strcmp(node->name, name) == 0)
+            return node;
+        }
+    return NULL;
+}
+
+
+void graphTrace(Graph *graph)
+{
+    for (List *l = graph->nodes ; l ; l = l->next)
+        {
+        Node *node = (Node *)l->data;
+        trace("%s (%s -> %s)%s", node->name, typeNames[node->inType],
+            typeNames[node->outType], node->enabled ? "" : " disabled");
+        for (List *out = node->outputs ; out ; out = out->next)
+            trace("    -> %s", ((Node *)out->data)->name);
+        }
+}
+
+
+int graphGetStats(Graph *graph, StageStats *stats, int max)
+{
+    int count = 0;
+    for (List *l = graph->nodes ; l && count < max ; l = l->next)
+        stats[count++] = ((Node *)l->data)->stats;
+    return count;
+}
+
+
+void graphResetStats(Graph *graph)
+{
+    for (List *l = graph->nodes ; l ; l = l->next)
+        {
+        Node *node = (Node *)l->data;
+        StageStats *st = &(node->stats);
+        st->calls      = 0;
+        st->samplesIn  = 0;
+        st->samplesOut = 0;
+        st->dropped    = 0;
+        st->nanos      = 0;
+        if (node->latency)
+            histogramReset(node->latency);
+        }
+}
+
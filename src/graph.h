@@ -0,0 +1,292 @@
+#ifndef _GRAPH_H_
+#define _GRAPH_H_
+/**
+ * Processing graph.  Each stage of the chain is a Node, with typed
+ * input and output ports.  A node's output is pushed to every node
+ * connected to it, so stages can be added to the chain, or tapped,
+ * without changing the stages around them.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+
+#include "sdrlib.h"
+#include "histogram.h"
+#include "util.h"
+
+
+/**
+ * The kind of samples on a port
+ */
+typedef enum
+{
+    PORT_NONE=0,  //no port.  Sources have no input, sinks no output
+    PORT_COMPLEX, //float complex
+    PORT_FLOAT,   //float
+    PORT_UINT,    //unsigned int, as in power spectra
+    PORT_BYTE,    //unsigned char
+    PORT_IQ8,     //interleaved unsigned 8-bit I/Q from a device.  2 bytes per sample
+    PORT_STEREO   //float left,right pairs.  Laid out as float complex, with left the real part
+} PortType;
+
+
+typedef struct Node Node;
+
+/**
+ * Process 'size' samples of the node's input type.  Results are
+ * passed on with nodeOutput().
+ */
+typedef void NodeProcessFunc(Node *node, void *data, int size);
+
+/**
+ * @return the number of samples the node's object is holding, until
+ *     it has enough to output
+ */
+typedef int NodeBacklogFunc(Node *node);
+
+/**
+ * Account for 'size' samples of silence in place of input, as from a
+ * closed squelch.  Output is passed on with nodeOutputSilence().
+ */
+typedef void NodeSilenceFunc(Node *node, int size);
+
+/**
+ * @return how long input given to the node now waits after it, before
+ *     it leaves the library, in ns.  As in a sound card's queue.
+ */
+typedef unsigned long long NodeDelayFunc(Node *node);
+
+
+struct Node
+{
+    char            *name;
+    PortType        inType;
+    PortType        outType;
+    void            *obj;      //the object doing the work.  Not owned by the node
+    NodeProcessFunc *process;
+    void            *context;  //for callback sinks
+    void            *func;
+    int             enabled;   //when false, input is passed through if the types match, else dropped
+    List            *outputs;  //Nodes
+    int             batch;     //samples to collect before processing.  0 for none
+    unsigned char   *buf;      //the batch so far
+    int             bufLen;
+    StageStats      stats;
+    unsigned long long outNanos; //time spent in the outputs, to subtract from this node's
+    unsigned long long stamp;    //capture time of the input being processed, in ns.  0 if unknown
+    unsigned long long pendingStamp; //capture time of the oldest sample held back by obj
+    NodeBacklogFunc *backlog;    //NULL if obj holds nothing back
+    NodeSilenceFunc *silence;    //NULL if silence is dropped here
+    NodeDelayFunc   *delay;      //NULL if input leaves once processed
+    Histogram       *latency;    //of the input, if tracked
+};
+
+
+/**
+ * Owns a set of nodes, so they can be found by name and deleted together
+ */
+typedef struct
+{
+    List *nodes;
+} Graph;
+
+
+/**
+ * @return the size of one sample of the type, in bytes
+ */
+int portTypeSize(PortType type);
+
+/**
+ *
+ */
+Node *nodeCreate(char *name, PortType inType, PortType outType, void *obj, NodeProcessFunc *process);
+
+/**
+ *
+ */
+void nodeDelete(Node *node);
+
+/**
+ * Send 'from's output to 'to' as well as any other outputs it has.
+ * The types must match.
+ * @return true if successful, else false
+ */
+int nodeConnect(Node *from, Node *to);
+
+/**
+ *
+ */
+int nodeDisconnect(Node *from, Node *to);
+
+/**
+ * Put 'node' between 'from' and all of its current outputs.  'node' must
+ * take and give the type that 'from' outputs.
+ * @return true if successful, else false
+ */
+int nodeInsert(Node *from, Node *node);
+
+/**
+ * Enable or bypass a node.  This, rather than changing connections,
+ * is how to change a graph that is running.
+ */
+void nodeSetEnabled(Node *node, int enabled);
+
+/**
+ * Have the node collect 'samples' input samples before processing them.
+ * 0 processes input as it arrives.
+ * @return true if successful, else false
+ */
+int nodeSetBatch(Node *node, int samples);
+
+/**
+ * Give the node input samples of its input type
+ */
+void nodeInput(Node *node, void *data, int size);
+
+/**
+ * Give the node input captured at 'stamp', in ns of CLOCK_MONOTONIC.
+ * The capture time follows the samples down the graph: the output of a
+ * node that holds samples back is stamped with the time of the oldest
+ * one, to within one input block.
+ */
+void nodeInputTimed(Node *node, void *data, int size, unsigned long long stamp);
+
+/**
+ * Keep a histogram of the latency of the node's input, from its capture,
+ * plus the node's delay if it has one
+ * @return true if successful, else false
+ */
+int nodeTrackLatency(Node *node);
+
+/**
+ * Process whatever is waiting in the node's batch
+ */
+void nodeFlush(Node *node);
+
+/**
+ * Pass samples of the node's output type to all of its outputs.
+ * Called by the process function.  Every output is given the same
+ * data, without copying.  The frontend, ddc, demod and resampler nodes
+ * output whole pool blocks, which an output may keep with blockRetain().
+ */
+void nodeOutput(Node *node, void *data, int size);
+
+/**
+ * Pass 'size' samples of silence to all of the node's outputs, without
+ * data.  Stages that keep time, such as the resampler and the codec,
+ * account for it cheaply.  The others skip it, which leaves the sinks
+ * with nothing, as the audio player would be given while idle.  A
+ * disabled node passes it on if its types match.
+ */
+void nodeOutputSilence(Node *node, int size);
+
+
+/**
+ * Adapters for the callbacks used by the processing objects.  The context
+ * is the Node.  The Output ones call nodeOutput(), the Input ones nodeInput().
+ */
+void nodeComplexOutput(float complex *data, int size, void *context);
+void nodeFloatOutput(float *data, int size, void *context);
+void nodeUintOutput(unsigned int *data, int size, void *context);
+void nodeByteOutput(unsigned char *data, int size, void *context);
+void nodeComplexInput(float complex *data, int size, void *context);
+void nodeFloatInput(float *data, int size, void *context);
+void nodeUintInput(unsigned int *data, int size, void *context);
+void nodeByteInput(unsigned char *data, int size, void *context);
+void nodeSilenceOutput(int size, void *context);
+
+
+/**
+ * Nodes for the existing processing objects
+ */
+Node *fftNodeCreate(char *name, Fft *fft);
+Node *fftBytesNodeCreate(char *name, Fft *fft);
+Node *frontendNodeCreate(char *name, Frontend *frontend);
+Node *ddcNodeCreate(char *name, Ddc *ddc);
+Node *demodNodeCreate(char *name, Demodulator *demod);
+Node *squelchNodeCreate(char *name, Squelch *squelch);
+Node *agcNodeCreate(char *name, Agc *agc); //PORT_STEREO if the agc has 2 channels
+Node *resamplerNodeCreate(char *name, Resampler *resampler);
+Node *resamplerStereoNodeCreate(char *name, Resampler *resampler);
+Node *stereoNodeCreate(char *name, Stereo *stereo);
+Node *rdsNodeCreate(char *name, Rds *rds); //a sink.  Its RdsOutputFunc is set with callbackNodeSet()
+Node *audioNodeCreate(char *name, Audio *audio);
+Node *audioStereoNodeCreate(char *name, Audio *audio);
+Node *codecNodeCreate(char *name, Codec *codec); //PORT_STEREO input if the codec has 2 channels
+
+/**
+ * A sink calling a client's callback.  func is a ComplexOutputFunc,
+ * FloatOutputFunc, UintOutputFunc or ByteOutputFunc, to match the type.
+ * PORT_IQ8 data is given to a ByteOutputFunc, with size in samples.
+ * PORT_STEREO data is given to a FloatOutputFunc, with size in pairs.
+ */
+Node *callbackNodeCreate(char *name, PortType type, void *func, void *context);
+
+/**
+ * Change the callback of a callback node, or of another sink which
+ * calls one
+ */
+void callbackNodeSet(Node *node, void *func, void *context);
+
+
+/**
+ *
+ */
+Graph *graphCreate();
+
+/**
+ * Delete the graph and all of its nodes
+ */
+void graphDelete(Graph *graph);
+
+/**
+ * Give a node to the graph
+ * @return the node
+ */
+Node *graphAdd(Graph *graph, Node *node);
+
+/**
+ * @return the node with the given name, or NULL
+ */
+Node *graphFind(Graph *graph, char *name);
+
+/**
+ * Trace the nodes and their connections
+ */
+void graphTrace(Graph *graph);
+
+/**
+ * Copy the counters of up to 'max' nodes, in the order they were added
+ * @return the number copied
+ */
+int graphGetStats(Graph *graph, StageStats *stats, int max);
+
+/**
+ * Zero the counters and latency histograms of all nodes
+ */
+void graphResetStats(Graph *graph);
+
+
+
+#endif /* _GRAPH_H_ */
+
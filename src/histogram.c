@@ -0,0 +1,133 @@
+/**
+ * Histogram of latencies.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+#include "private.h"
+
+
+
+Histogram *histogramCreate()
+{
+    Histogram *h = (Histogram *)smalloc(sizeof(Histogram));
+    if (!h)
+        return NULL;
+    histogramReset(h);
+    return h;
+}
+
+
+void histogramDelete(Histogram *h)
+{
+    free(h);
+}
+
+
+void histogramReset(Histogram *h)
+{
+    memset(h, 0, sizeof(Histogram));
+}
+
+
+/**
+ * Values below 2 * HISTOGRAM_SUB_BUCKETS have a bucket each.  Above that,
+ * the top HISTOGRAM_SUB_BITS bits after the leading one pick the bucket
+ * within its power of two.
+ */
+static int bucketIndex(unsigned long long value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (int)value;
+    int exp = 63 - __builtin_clzll(value);
+    if (exp >= HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_BUCKETS - 1;
+    int shift = exp - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+        (int)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+/**
+ * @return the highest value that falls in the bucket
+ */
+static unsigned long long bucketValue(int index)
+{
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+        return (unsigned long long)index;
+    int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    unsigned long long sub = HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+
+void histogramRecord(Histogram *h, unsigned long long value)
+{
+    h->counts[bucketIndex(value)]++;
+    if (!h->count || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += value;
+}
+
+
+unsigned long long histogramPercentile(Histogram *h, double percentile)
+{
+    if (!h->count)
+        return 0;
+    unsigned long long target = (unsigned long long)(percentile * 0.01 * (double)h->count + 0.5);
+    if (target < 1)
+        target = 1;
+    unsigned long long seen = 0;
+    for (int i = 0 ; i < HISTOGRAM_BUCKETS ; i++)
+        {
+        seen += h->counts[i];
+        if (seen >= target)
+            {
+            unsigned long long value = bucketValue(i);
+            return (value > h->max) ? h->max : value;
+            }
+        }
+    return h->max;
+}
+
+
+void histogramGetStats(Histogram *h, LatencyStats *stats)
+{
+    memset(stats, 0, sizeof(LatencyStats));
+    stats->count = h->count;
+    if (!h->count)
+        return;
+    stats->min  = (double)h->min * 0.001;
+    stats->mean = (double)h->sum / (double)h->count * 0.001;
+    stats->p50  = (double)histogramPercentile(h, 50.0) * 0.001;
+    stats->p90  = (double)histogramPercentile(h, 90.0) * 0.001;
+    stats->p99  = (double)histogramPercentile(h, 99.0) * 0.001;
+    stats->max  = (double)h->max * 0.001;
+}
+
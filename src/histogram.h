@@ -0,0 +1,90 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+/**
+ * Histogram of latencies, with buckets spaced like those of HdrHistogram:
+ * linear up to HISTOGRAM_SUB_BUCKETS * 2, then HISTOGRAM_SUB_BUCKETS of
+ * them per power of two.  Every value is kept to within 1/16 of itself,
+ * in a fixed, small table, and recording one costs a few instructions.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+#define HISTOGRAM_SUB_BITS    (4)
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/**
+ * Values are in microseconds, and are kept up to 2^32 us, over an hour.
+ * Larger ones go in the last bucket.
+ */
+#define HISTOGRAM_MAX_BITS (32)
+#define HISTOGRAM_BUCKETS  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+
+typedef struct
+{
+    unsigned long long counts[HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+} Histogram;
+
+
+/**
+ *
+ */
+Histogram *histogramCreate();
+
+/**
+ *
+ */
+void histogramDelete(Histogram *h);
+
+/**
+ *
+ */
+void histogramReset(Histogram *h);
+
+/**
+ * Count one value, in microseconds
+ */
+void histogramRecord(Histogram *h, unsigned long long value);
+
+/**
+ * @param percentile 0 - 100
+ * @return the value below which that percentage of the values fall, to
+ *     within the width of its bucket.  0 if there are none.
+ */
+unsigned long long histogramPercentile(Histogram *h, double percentile);
+
+/**
+ * Summarize the histogram, in milliseconds
+ */
+void histogramGetStats(Histogram *h, LatencyStats *stats);
+
+
+
+#endif /* _HISTOGRAM_H_ */
+
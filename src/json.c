@@ -602,6 +602,11 @@ static int getString(JsonParser *p)
 static JsonVal *getObject(JsonParser *p)
 {
     JsonVal *js = jsonObj();
+    if (skipwhite( p ) && p->buf[p->pos] == '}')
+        {
+        p->pos++; //empty object
+        return js;
+        }
     while (1)
         {
         if (!skipwhite( p ))
@@ -680,6 +685,11 @@ static JsonVal *getObject(JsonParser *p)
 static JsonVal *getArray(JsonParser *p)
 {
     JsonVal *js = jsonArr();
+    if (skipwhite( p ) && p->buf[p->pos] == ']')
+        {
+        p->pos++; //empty array
+        return js;
+        }
     while (1)
         {
         if (!skipwhite( p ))
@@ -729,12 +739,12 @@ static JsonVal *getArray(JsonParser *p)
 
 static JsonVal *parse(JsonParser *p)
 {
-    char *buf = p->buf;
-    
     if (!skipwhite( p ))
         return NULL;
     
     int ch = get(p);
+    //start of the token, including ch
+    char *buf = p->buf + p->pos - 1;
 
     if (ch == '{')
         {
@@ -757,30 +767,29 @@ static JsonVal *parse(JsonParser *p)
         }
     else if (strncmp("null", buf, 4)==0)
         {
-        p->pos += 4;
+        p->pos += 3;
         return jsonNil();
         }
     else if (strncmp("true", buf, 4)==0)
         {
-        p->pos += 4;
+        p->pos += 3;
         return jsonBool(TRUE);
         }
-    else if (strncmp("false", buf, 4)==0)
+    else if (strncmp("false", buf, 5)==0)
         {
-        p->pos += 5;
+        p->pos += 4;
         return jsonBool(FALSE);
         }
     else
         {
         //try for a float, then int
-        p->pos++; //back up to char
+        p->pos--; //back up to char
         char *startptr = p->buf + p->pos; 
         char *endptr;
         float fval = strtof(startptr, &endptr);
         int flen = endptr - startptr;
         int ival = strtol(startptr, &endptr, 10);
         int ilen = endptr - startptr;
-        trace("%f %d %d %d", fval, flen, ival, ilen);
         //if flen & ilen same length, then it was an integer
         if (flen > 0 && flen > ilen)
             {
@@ -0,0 +1,311 @@
+/**
+ * Pool of fixed-size, reference-counted sample blocks.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "private.h"
+
+
+/**
+ * Kept just before the samples, in a cache line of its own
+ */
+typedef struct BlockHeader BlockHeader;
+
+struct BlockHeader
+{
+    BlockHeader *next;  //while free
+    int         refs;
+    int         kind;   //BLOCK_COMPLEX or BLOCK_FLOAT
+    void        *raw;   //as malloc()ed, before aligning
+};
+
+#define HEADER_SIZE (POOL_ALIGN)
+
+#define blockHeader(block) ((BlockHeader *)((unsigned char *)(block) - HEADER_SIZE))
+#define blockData(hdr)     ((void *)((unsigned char *)(hdr) + HEADER_SIZE))
+
+
+/**
+ * The sizes of block.  Each has its own free lists, since a block is
+ * only ever reused as the same kind.
+ */
+#define BLOCK_COMPLEX 0
+#define BLOCK_FLOAT   1
+#define BLOCK_KINDS   2
+
+static const int kindBytes[BLOCK_KINDS] = { POOL_BLOCK_BYTES, POOL_FLOAT_BYTES };
+
+
+/**
+ * A thread's own free blocks
+ */
+typedef struct
+{
+    BlockHeader *head[BLOCK_KINDS];
+    int         count[BLOCK_KINDS];
+} ThreadCache;
+
+
+static pthread_once_t  poolOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t   cacheKey;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static BlockHeader     *sharedFree[BLOCK_KINDS] = { NULL, NULL };
+static int             blocksTotal = 0;
+static int             blocksFree  = 0;  //shared and cached, of both kinds
+
+
+
+/**
+ * Give a list of free blocks, all of one kind, to the shared list
+ */
+static void poolGive(BlockHeader *head)
+{
+    if (!head)
+        return;
+    BlockHeader *tail = head;
+    while (tail->next)
+        tail = tail->next;
+    int kind = head->kind;
+    pthread_mutex_lock(&poolLock);
+    tail->next = sharedFree[kind];
+    sharedFree[kind] = head;
+    pthread_mutex_unlock(&poolLock);
+}
+
+
+/**
+ * At thread exit
+ */
+static void cacheDelete(void *data)
+{
+    ThreadCache *cache = (ThreadCache *)data;
+    for (int kind = 0 ; kind < BLOCK_KINDS ; kind++)
+        poolGive(cache->head[kind]);
+    free(cache);
+}
+
+
+static void poolInit()
+{
+    pthread_key_create(&cacheKey, cacheDelete);
+}
+
+
+static ThreadCache *getCache()
+{
+    pthread_once(&poolOnce, poolInit);
+    ThreadCache *cache = (ThreadCache *)pthread_getspecific(cacheKey);
+    if (!cache)
+        {
+        cache = (ThreadCache *)smalloc(sizeof(ThreadCache));
+        if (!cache)
+            return NULL;
+        memset(cache, 0, sizeof(ThreadCache));
+        pthread_setspecific(cacheKey, cache);
+        }
+    return cache;
+}
+
+
+/**
+ * Get a block from the system.  It is cleared here, by the thread that
+ * will use it, so that its pages are placed on that thread's NUMA node.
+ */
+static BlockHeader *blockNew(int kind)
+{
+    int bytes = kindBytes[kind];
+    unsigned char *raw = (unsigned char *)malloc(HEADER_SIZE + bytes + POOL_ALIGN);
+    if (!raw)
+        {
+        error("blockAlloc: out of memory");
+        return NULL;
+        }
+    uintptr_t addr = ((uintptr_t)raw + POOL_ALIGN - 1) & ~((uintptr_t)POOL_ALIGN - 1);
+    BlockHeader *hdr = (BlockHeader *)addr;
+    memset(hdr, 0, HEADER_SIZE + bytes);
+    hdr->kind = kind;
+    hdr->raw  = raw;
+    __sync_add_and_fetch(&blocksTotal, 1);
+    return hdr;
+}
+
+
+/**
+ * Give a list of free blocks back to the system
+ * @return how many there were
+ */
+static int blockFreeList(BlockHeader *hdr)
+{
+    int count = 0;
+    while (hdr)
+        {
+        BlockHeader *next = hdr->next;
+        free(hdr->raw);
+        hdr = next;
+        count++;
+        }
+    return count;
+}
+
+
+static void *blockAllocKind(int kind)
+{
+    BlockHeader *hdr = NULL;
+    ThreadCache *cache = getCache();
+    if (cache && cache->head[kind])
+        {
+        hdr = cache->head[kind];
+        cache->head[kind] = hdr->next;
+        cache->count[kind]--;
+        }
+    else
+        {
+        pthread_mutex_lock(&poolLock);
+        hdr = sharedFree[kind];
+        if (hdr)
+            sharedFree[kind] = hdr->next;
+        pthread_mutex_unlock(&poolLock);
+        if (!hdr)
+            {
+            hdr = blockNew(kind);
+            if (!hdr)
+                return NULL;
+            __sync_add_and_fetch(&blocksFree, 1);
+            }
+        }
+    __sync_sub_and_fetch(&blocksFree, 1);
+    hdr->next = NULL;
+    hdr->refs = 1;
+    return blockData(hdr);
+}
+
+
+void *blockAlloc()
+{
+    return blockAllocKind(BLOCK_COMPLEX);
+}
+
+
+void *blockAllocFloat()
+{
+    return blockAllocKind(BLOCK_FLOAT);
+}
+
+
+void blockRetain(void *block)
+{
+    __sync_add_and_fetch(&(blockHeader(block)->refs), 1);
+}
+
+
+void blockRelease(void *block)
+{
+    if (!block)
+        return;
+    BlockHeader *hdr = blockHeader(block);
+    if (__sync_sub_and_fetch(&(hdr->refs), 1) > 0)
+        return;
+    __sync_add_and_fetch(&blocksFree, 1);
+    int kind = hdr->kind;
+    ThreadCache *cache = getCache();
+    if (cache && cache->count[kind] < POOL_THREAD_CACHE)
+        {
+        hdr->next = cache->head[kind];
+        cache->head[kind] = hdr;
+        cache->count[kind]++;
+        }
+    else
+        {
+        hdr->next = NULL;
+        poolGive(hdr);
+        }
+}
+
+
+static void *blockRenewKind(void *block, int kind)
+{
+    if (!block)
+        return blockAllocKind(kind);
+    BlockHeader *hdr = blockHeader(block);
+    if (hdr->refs == 1 && hdr->kind == kind)
+        return block;
+    blockRelease(block);
+    return blockAllocKind(kind);
+}
+
+
+void *blockRenew(void *block)
+{
+    return blockRenewKind(block, BLOCK_COMPLEX);
+}
+
+
+void *blockRenewFloat(void *block)
+{
+    return blockRenewKind(block, BLOCK_FLOAT);
+}
+
+
+void poolTrim()
+{
+    BlockHeader *lists[BLOCK_KINDS];
+    pthread_mutex_lock(&poolLock);
+    for (int kind = 0 ; kind < BLOCK_KINDS ; kind++)
+        {
+        lists[kind] = sharedFree[kind];
+        sharedFree[kind] = NULL;
+        }
+    pthread_mutex_unlock(&poolLock);
+    int count = 0;
+    ThreadCache *cache = getCache();
+    for (int kind = 0 ; kind < BLOCK_KINDS ; kind++)
+        {
+        count += blockFreeList(lists[kind]);
+        if (cache)
+            {
+            count += blockFreeList(cache->head[kind]);
+            cache->head[kind]  = NULL;
+            cache->count[kind] = 0;
+            }
+        }
+    __sync_sub_and_fetch(&blocksFree, count);
+    __sync_sub_and_fetch(&blocksTotal, count);
+}
+
+
+void blockCount(int *total, int *inUse)
+{
+    int t = __sync_add_and_fetch(&blocksTotal, 0);
+    int f = __sync_add_and_fetch(&blocksFree, 0);
+    if (total)
+        *total = t;
+    if (inUse)
+        *inUse = t - f;
+}
+
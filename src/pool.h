@@ -0,0 +1,117 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+/**
+ * Pool of reference-counted sample blocks, of two fixed sizes.
+ * Processing stages fill their output in blocks from the pool, rather
+ * than in buffers of their own, and pass them downstream by pointer.  A consumer that wants
+ * to keep a block past the output call, such as to hand it to another
+ * thread, takes a reference with blockRetain() and gives it back with
+ * blockRelease().  Any number of consumers can share a block this way
+ * without copying it.
+ *
+ * Each thread keeps a short list of free blocks of its own, so that
+ * allocation is normally lock-free, and the blocks a thread uses stay
+ * in its cache and on its NUMA node.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+
+
+/**
+ * Capacity of a block, in samples.  Blocks from blockAlloc() hold that
+ * many float complex samples, or stereo frames, and those from
+ * blockAllocFloat() that many floats, in half the memory.
+ */
+#define POOL_BLOCK_SAMPLES (16384)
+
+#define POOL_BLOCK_BYTES (POOL_BLOCK_SAMPLES * sizeof(float complex))
+
+#define POOL_FLOAT_BYTES (POOL_BLOCK_SAMPLES * sizeof(float))
+
+/**
+ * Blocks start on a cache line, so no two share one
+ */
+#define POOL_ALIGN (64)
+
+/**
+ * Most free blocks a thread keeps for itself.  More are given back
+ * to the shared list.
+ */
+#define POOL_THREAD_CACHE (8)
+
+
+/**
+ * Get a block, with one reference, held by the caller
+ * @return the block, or NULL if out of memory
+ */
+void *blockAlloc();
+
+/**
+ * Get a block of POOL_BLOCK_SAMPLES floats, for the stages whose output
+ * is real
+ * @return the block, or NULL if out of memory
+ */
+void *blockAllocFloat();
+
+/**
+ * Take another reference to a block
+ */
+void blockRetain(void *block);
+
+/**
+ * Give up a reference.  The block is freed when the last one is given up.
+ * NULL is ignored.
+ */
+void blockRelease(void *block);
+
+/**
+ * Give up a reference, and get a block of float complex to fill next.
+ * If nobody else took a reference to the block, it is simply reused,
+ * while still in cache.  NULL just gets a new block.
+ * @return the block, or NULL if out of memory
+ */
+void *blockRenew(void *block);
+
+/**
+ * Same as blockRenew(), for a block of floats
+ */
+void *blockRenewFloat(void *block);
+
+/**
+ * Give the free blocks back to the system: the shared ones, and those
+ * cached by the calling thread.  Blocks in use, and those cached by
+ * other threads, are kept.
+ */
+void poolTrim();
+
+/**
+ * Get the number of blocks allocated from the system, and how many
+ * of those are in use
+ */
+void blockCount(int *total, int *inUse);
+
+
+
+#endif /* _POOL_H_ */
+
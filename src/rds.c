@@ -0,0 +1,603 @@
+/**
+ * RDS decoder
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rds.h"
+#include "private.h"
+
+
+#define RDS_CARRIER    57000.0
+#define CHIP_RATE      2375.0
+#define CUTOFF         2800.0  //of the decimating lowpass.  RDS is +-2.4 kHz
+#define FILTER_SPAN    8       //decimating filter size, in output samples
+#define LOOP_FREQ      20.0    //natural frequency of the Costas loop, Hz
+#define LOOP_DAMPING   0.707
+#define LOOP_RANGE     20.0    //Hz the carrier may be from 57 kHz
+#define TIMING_GAIN    0.01f
+#define MAX_BAD_BLOCKS 12      //in a row, before sync is given up
+
+/**
+ * The checkword generator, x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1
+ */
+#define POLY 0x5b9
+
+/**
+ * Offset words of blocks A, B, C and D, and of C', which takes the
+ * place of C in version B groups
+ */
+static uint32_t offsetWords[4] = { 0x0fc, 0x198, 0x168, 0x1b4 };
+#define OFFSET_CP 0x350
+
+
+
+/*############################################################################
+## B L O C K    C O D E
+############################################################################*/
+
+/**
+ * @return the checkword of 16 bits of data, before the offset is added
+ */
+static uint32_t rdsCheck(uint32_t data)
+{
+    uint32_t reg = data << 10;
+    for (int i = 25 ; i >= 10 ; i--)
+        if (reg & (1u << i))
+            reg ^= POLY << (i - 10);
+    return reg & 0x3ff;
+}
+
+
+/**
+ * @return the offset word of a good 26 bit block.  The code is linear,
+ *     so for a block with errors, the offset plus the syndrome of the errors.
+ */
+static uint32_t rdsSyndrome(uint32_t block)
+{
+    return rdsCheck(block >> 10) ^ (block & 0x3ff);
+}
+
+
+/**
+ * @return 0-3 for a block A-D, or -1 if the syndrome is none of them
+ */
+static int rdsBlockType(uint32_t syndrome)
+{
+    if (syndrome == OFFSET_CP)
+        return 2;
+    for (int i = 0 ; i < 4 ; i++)
+        if (syndrome == offsetWords[i])
+            return i;
+    return -1;
+}
+
+
+/**
+ * Corrections for bursts of 1 and 2 bits, by syndrome.  The code can
+ * correct longer ones, but then it also "corrects" many blocks that
+ * are merely noise.
+ */
+static void rdsMakeCorrections(Rds *obj)
+{
+    memset(obj->corrections, 0, sizeof(obj->corrections));
+    for (int len = 1 ; len <= 2 ; len++)
+        {
+        uint32_t burst = (1u << len) - 1;
+        for (int shift = 0 ; shift <= 26 - len ; shift++)
+            {
+            uint32_t err = burst << shift;
+            uint32_t syn = rdsSyndrome(err);
+            if (!obj->corrections[syn])
+                obj->corrections[syn] = err;
+            }
+        }
+}
+
+
+
+/*############################################################################
+## L I F E C Y C L E
+############################################################################*/
+
+
+Rds *rdsCreate(float inRate)
+{
+    Rds *obj = (Rds *)smalloc(sizeof(Rds));
+    if (!obj)
+        return NULL;
+    memset(obj, 0, sizeof(Rds));
+    rdsMakeCorrections(obj);
+    rdsSetInRate(obj, inRate);
+    if (!obj->lowpass || !obj->delayLine)
+        {
+        rdsDelete(obj);
+        return NULL;
+        }
+    return obj;
+}
+
+
+void rdsDelete(Rds *obj)
+{
+    if (!obj)
+        return;
+    if (obj->lowpass)
+        firDelete(obj->lowpass);
+    free(obj->delayLine);
+    free(obj);
+}
+
+
+void rdsSetInRate(Rds *obj, float inRate)
+{
+    if (inRate <= 0.0 || inRate == obj->inRate)
+        return;
+    obj->inRate = inRate;
+    int decimation = (int)(inRate / (CHIP_RATE * RDS_CHIP_SAMPLES));
+    if (decimation < 1)
+        decimation = 1;
+    obj->decimation = decimation;
+    obj->outRate    = inRate / (float)decimation;
+    float w = TWOPI * RDS_CARRIER / inRate;
+    obj->oscStep = cos(w) - sin(w) * I;
+
+    if (obj->lowpass)
+        firDelete(obj->lowpass);
+    free(obj->delayLine);
+    obj->delayLine = NULL;
+    obj->lowpass = firLP(FILTER_SPAN * decimation + 1, CUTOFF, inRate, W_HAMMING);
+    if (obj->lowpass)
+        obj->delayLine = (float complex *)smalloc(2 * obj->lowpass->size * sizeof(float complex));
+
+    int chipLen = (int)(obj->outRate / CHIP_RATE + 0.5);
+    obj->chipLen  = (chipLen < 1) ? 1 : (chipLen > RDS_MAX_CHIP) ? RDS_MAX_CHIP : chipLen;
+    obj->tickStep = 2.0 * CHIP_RATE / obj->outRate;
+    float wnT = TWOPI * LOOP_FREQ / obj->outRate;
+    obj->alpha = 2.0 * LOOP_DAMPING * wnT;
+    obj->beta  = wnT * wnT;
+    rdsReset(obj);
+    rdsClear(obj);
+}
+
+
+void rdsReset(Rds *obj)
+{
+    obj->osc        = 1.0;
+    obj->delayIndex = 0;
+    obj->phase      = 0;
+    if (obj->delayLine)
+        memset(obj->delayLine, 0, 2 * obj->lowpass->size * sizeof(float complex));
+    obj->carrierPhase = 0.0;
+    obj->carrierFreq  = 0.0;
+    obj->amp          = 0.0;
+    memset(obj->chipBuf, 0, sizeof(obj->chipBuf));
+    obj->chipPtr   = 0;
+    obj->chipSum   = 0.0;
+    obj->chipPrev  = 0.0;
+    obj->tick      = 0.0;
+    obj->onTime    = TRUE;
+    obj->mid       = 0.0;
+    obj->chip      = 0.0;
+    obj->chipAmp   = 0.0;
+    obj->pairEnergy[0] = 0.0;
+    obj->pairEnergy[1] = 0.0;
+    obj->chipCount  = 0;
+    obj->lastSymbol = 0;
+    obj->reg        = 0;
+    obj->synced     = FALSE;
+    obj->bitCount   = 0;
+    obj->bitPos     = 0;
+    obj->lastFoundPos  = -1000;
+    obj->lastFoundType = -1;
+    obj->blockIndex = 0;
+    obj->badBlocks  = 0;
+    memset(obj->blockOk, 0, sizeof(obj->blockOk));
+}
+
+
+void rdsClear(Rds *obj)
+{
+    obj->info.pi    = -1;
+    obj->info.ps[0] = '\0';
+    obj->info.rt[0] = '\0';
+    obj->piCandidate = -1;
+    memset(obj->ps, ' ', sizeof(obj->ps));
+    obj->psMask = 0;
+    memset(obj->rt, ' ', sizeof(obj->rt));
+    obj->rtMask = 0;
+    obj->rtEnd  = -1;
+    obj->rtAb   = -1;
+    obj->groups    = 0;
+    obj->badGroups = 0;
+}
+
+
+void rdsGetInfo(Rds *obj, RdsInfo *info)
+{
+    *info = obj->info;
+}
+
+
+
+/*############################################################################
+## G R O U P S
+############################################################################*/
+
+
+static char rdsChar(int c)
+{
+    return (c >= 0x20 && c < 0x7f) ? (char)c : ' ';
+}
+
+
+/**
+ * Put radiotext characters in place, noting where a carriage return ends it
+ */
+static void rdsPutText(Rds *obj, int pos, uint16_t word)
+{
+    int c[2] = { word >> 8, word & 0xff };
+    for (int i = 0 ; i < 2 ; i++)
+        {
+        if (c[i] == 0x0d && (obj->rtEnd < 0 || pos + i < obj->rtEnd))
+            obj->rtEnd = pos + i;
+        obj->rt[pos + i] = rdsChar(c[i]);
+        }
+}
+
+
+/**
+ * @return RDS_RT if a whole radiotext, different from the last, has arrived
+ */
+static int rdsTextDone(Rds *obj, int maxLen, int segLen)
+{
+    int len = (obj->rtEnd >= 0 && obj->rtEnd < maxLen) ? obj->rtEnd : maxLen;
+    int segs = (len + segLen - 1) / segLen;
+    int needed = (1 << segs) - 1;
+    if ((obj->rtMask & needed) != needed)
+        return 0;
+    obj->rtMask = 0;
+    while (len > 0 && obj->rt[len-1] == ' ')
+        len--;
+    char rt[65];
+    memcpy(rt, obj->rt, len);
+    rt[len] = '\0';
+    if (strcmp(rt, obj->info.rt) == 0)
+        return 0;
+    strcpy(obj->info.rt, rt);
+    return RDS_RT;
+}
+
+
+static void rdsGroup(Rds *obj, RdsOutputFunc *func, void *context)
+{
+    uint16_t *blocks = obj->blocks;
+    int *ok = obj->blockOk;
+    int changed = 0;
+    if (!ok[0] || !ok[1])
+        {
+        obj->badGroups++;
+        return;
+        }
+    obj->groups++;
+
+    //a PI code is taken once two groups in a row agree on it
+    int pi = blocks[0];
+    if (pi == obj->piCandidate && pi != obj->info.pi)
+        {
+        obj->info.pi = pi;
+        changed |= RDS_PI;
+        }
+    obj->piCandidate = pi;
+
+    int type    = blocks[1] >> 12;
+    int version = (blocks[1] >> 11) & 1;
+    if (type == 0 && ok[3])
+        {
+        //program service name, two characters per group
+        int seg = blocks[1] & 3;
+        obj->ps[2 * seg]     = rdsChar(blocks[3] >> 8);
+        obj->ps[2 * seg + 1] = rdsChar(blocks[3] & 0xff);
+        obj->psMask |= 1 << seg;
+        if (obj->psMask == 0xf)
+            {
+            obj->psMask = 0;
+            if (memcmp(obj->ps, obj->info.ps, 8) != 0)
+                {
+                memcpy(obj->info.ps, obj->ps, 8);
+                obj->info.ps[8] = '\0';
+                changed |= RDS_PS;
+                }
+            }
+        }
+    else if (type == 2)
+        {
+        //radiotext, four characters per group in version A, two in B.
+        //a change of the A/B flag starts a new text
+        int seg = blocks[1] & 0xf;
+        int ab  = (blocks[1] >> 4) & 1;
+        if (ab != obj->rtAb)
+            {
+            obj->rtAb = ab;
+            memset(obj->rt, ' ', sizeof(obj->rt));
+            obj->rtMask = 0;
+            obj->rtEnd  = -1;
+            }
+        if (version == 0 && ok[2] && ok[3])
+            {
+            rdsPutText(obj, 4 * seg, blocks[2]);
+            rdsPutText(obj, 4 * seg + 2, blocks[3]);
+            obj->rtMask |= 1 << seg;
+            changed |= rdsTextDone(obj, 64, 4);
+            }
+        else if (version == 1 && ok[3])
+            {
+            rdsPutText(obj, 2 * seg, blocks[3]);
+            obj->rtMask |= 1 << seg;
+            changed |= rdsTextDone(obj, 32, 2);
+            }
+        }
+
+    if (changed && func)
+        func(&(obj->info), changed, context);
+}
+
+
+/**
+ * Check the block just received, correcting it if we can
+ */
+static void rdsBlock(Rds *obj, RdsOutputFunc *func, void *context)
+{
+    int index = obj->blockIndex;
+    uint32_t block = obj->reg;
+    uint32_t syn = rdsSyndrome(block);
+    int ok = (syn == offsetWords[index]) || (index == 2 && syn == OFFSET_CP);
+    if (!ok)
+        {
+        uint32_t err = obj->corrections[syn ^ offsetWords[index]];
+        if (!err && index == 2)
+            err = obj->corrections[syn ^ OFFSET_CP];
+        if (err)
+            {
+            block ^= err;
+            ok = TRUE;
+            }
+        }
+    obj->blocks[index]  = block >> 10;
+    obj->blockOk[index] = ok;
+    if (ok)
+        obj->badBlocks = 0;
+    else if (++obj->badBlocks >= MAX_BAD_BLOCKS)
+        {
+        obj->synced        = FALSE;
+        obj->bitPos        = 0;
+        obj->lastFoundPos  = -1000;
+        obj->lastFoundType = -1;
+        }
+    if (index == 3)
+        {
+        rdsGroup(obj, func, context);
+        memset(obj->blockOk, 0, sizeof(obj->blockOk));
+        }
+}
+
+
+/**
+ * Until synced, look for two offset words a whole number of blocks
+ * apart, in the right order.  After that, take a block every 26 bits.
+ */
+static void rdsBit(Rds *obj, int bit, RdsOutputFunc *func, void *context)
+{
+    obj->reg = ((obj->reg << 1) | bit) & 0x3ffffff;
+    if (obj->synced)
+        {
+        if (++obj->bitCount < 26)
+            return;
+        obj->bitCount = 0;
+        obj->blockIndex = (obj->blockIndex + 1) & 3;
+        rdsBlock(obj, func, context);
+        return;
+        }
+
+    obj->bitPos++;
+    int type = rdsBlockType(rdsSyndrome(obj->reg));
+    if (type < 0)
+        return;
+    long long dist = obj->bitPos - obj->lastFoundPos;
+    if (obj->lastFoundType >= 0 && dist % 26 == 0 && dist <= 4 * 26 &&
+        (obj->lastFoundType + dist / 26) % 4 == type)
+        {
+        obj->synced     = TRUE;
+        obj->bitCount   = 0;
+        obj->badBlocks  = 0;
+        obj->blockIndex = type;
+        memset(obj->blockOk, 0, sizeof(obj->blockOk));
+        rdsBlock(obj, func, context);
+        }
+    obj->lastFoundPos  = obj->bitPos;
+    obj->lastFoundType = type;
+}
+
+
+
+/*############################################################################
+## D E M O D U L A T I O N
+############################################################################*/
+
+
+/**
+ * A chip has been received.  'diff' is the last chip less this one.
+ * The two chips of a symbol always differ, while those either side of
+ * the boundary between symbols differ only half the time, which is
+ * how we know which pairs are symbols.
+ */
+static void rdsChip(Rds *obj, float diff, RdsOutputFunc *func, void *context)
+{
+    int k = obj->chipCount++ & 1;
+    obj->pairEnergy[k] += 0.02f * (fabsf(diff) - obj->pairEnergy[k]);
+    int second = (obj->pairEnergy[0] > obj->pairEnergy[1]) ? 0 : 1;
+    if (k != second)
+        return;
+    //the sign of the carrier is unknown, so the bits are differential
+    int symbol = (diff > 0.0f);
+    int bit = symbol ^ obj->lastSymbol;
+    obj->lastSymbol = symbol;
+    rdsBit(obj, bit, func, context);
+}
+
+
+/**
+ * One sample of the decimated subcarrier
+ */
+static void rdsBaseband(Rds *obj, float complex y, RdsOutputFunc *func, void *context)
+{
+    //Costas loop.  re * im is the phase error, whichever the symbol
+    float c  = cosf(obj->carrierPhase);
+    float s  = sinf(obj->carrierPhase);
+    float re = crealf(y) * c + cimagf(y) * s;
+    float im = cimagf(y) * c - crealf(y) * s;
+    obj->amp += 0.001f * ((re * re + im * im) - obj->amp);
+    float err = (obj->amp > 0.0f) ? re * im / obj->amp : 0.0f;
+    err = (err < -1.0f) ? -1.0f : (err > 1.0f) ? 1.0f : err;
+    float limit = TWOPI * LOOP_RANGE / obj->outRate;
+    float freq = obj->carrierFreq + obj->beta * err;
+    obj->carrierFreq = (freq < -limit) ? -limit : (freq > limit) ? limit : freq;
+    float phase = obj->carrierPhase + obj->carrierFreq + obj->alpha * err;
+    if (phase > PI)
+        phase -= TWOPI;
+    else if (phase < -PI)
+        phase += TWOPI;
+    obj->carrierPhase = phase;
+
+    //integrate over a chip, resumming now and then so that the
+    //rounding does not build up
+    int chipPtr = obj->chipPtr;
+    obj->chipSum += re - obj->chipBuf[chipPtr];
+    obj->chipBuf[chipPtr] = re;
+    if (++chipPtr >= obj->chipLen)
+        {
+        chipPtr = 0;
+        float sum = 0.0f;
+        for (int i = 0 ; i < obj->chipLen ; i++)
+            sum += obj->chipBuf[i];
+        obj->chipSum = sum;
+        }
+    obj->chipPtr = chipPtr;
+    float mf = obj->chipSum;
+
+    //strobe at chip centers and between them.  Gardner's detector: the
+    //value between two chips that differ tells which way we are off
+    obj->tick += obj->tickStep;
+    if (obj->tick >= 1.0f)
+        {
+        obj->tick -= 1.0f;
+        float frac = obj->tick / obj->tickStep;
+        float x = mf - frac * (mf - obj->chipPrev);
+        if (obj->onTime)
+            {
+            float diff = obj->chip - x;
+            obj->chipAmp += 0.01f * (x * x - obj->chipAmp);
+            if (obj->chipAmp > 0.0f)
+                {
+                float e = obj->mid * diff / obj->chipAmp;
+                e = (e < -1.0f) ? -1.0f : (e > 1.0f) ? 1.0f : e;
+                obj->tick -= TIMING_GAIN * e;
+                }
+            obj->chip = x;
+            rdsChip(obj, diff, func, context);
+            }
+        else
+            obj->mid = x;
+        obj->onTime = !obj->onTime;
+        }
+    obj->chipPrev = mf;
+}
+
+
+void rdsUpdate(Rds *obj, float *data, int size, RdsOutputFunc *func, void *context)
+{
+    if (obj->inRate < RDS_MIN_RATE)
+        return;
+    int filterSize = obj->lowpass->size;
+    float *coeffs  = obj->lowpass->coeffs;
+    float complex *delayLine = obj->delayLine;
+    int delayIndex = obj->delayIndex;
+    int decimation = obj->decimation;
+    int phase      = obj->phase;
+    float sr = crealf(obj->oscStep);
+    float si = cimagf(obj->oscStep);
+    float mixRe[RDS_STEP];
+    float mixIm[RDS_STEP];
+
+    while (size > 0)
+        {
+        int n = (size < RDS_STEP) ? size : RDS_STEP;
+
+        //mix the subcarrier down, rotating in real arithmetic
+        float zr = crealf(obj->osc);
+        float zi = cimagf(obj->osc);
+        for (int i = 0 ; i < n ; i++)
+            {
+            mixRe[i] = data[i] * zr;
+            mixIm[i] = data[i] * zi;
+            float r = zr * sr - zi * si;
+            zi = zr * si + zi * sr;
+            zr = r;
+            }
+        float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+        obj->osc = (zr * g) + (zi * g) * I;
+
+        //the lowpass is only worked out for the samples we keep.  The
+        //delay line is written twice, so the window is always in one piece
+        for (int i = 0 ; i < n ; i++)
+            {
+            float complex v = mixRe[i] + mixIm[i] * I;
+            delayLine[delayIndex] = v;
+            delayLine[delayIndex + filterSize] = v;
+            if (++delayIndex >= filterSize)
+                delayIndex = 0;
+            if (++phase >= decimation)
+                {
+                phase = 0;
+                float complex *window = delayLine + delayIndex;
+                float sumRe = 0.0f;
+                float sumIm = 0.0f;
+                for (int k = 0 ; k < filterSize ; k++)
+                    {
+                    sumRe += crealf(window[k]) * coeffs[k];
+                    sumIm += cimagf(window[k]) * coeffs[k];
+                    }
+                rdsBaseband(obj, sumRe + sumIm * I, func, context);
+                }
+            }
+        data += n;
+        size -= n;
+        }
+    obj->delayIndex = delayIndex;
+    obj->phase      = phase;
+}
+
+
@@ -0,0 +1,174 @@
+#ifndef _RDS_H_
+#define _RDS_H_
+
+/**
+ * RDS decoder.  Takes the FM composite, as does the stereo decoder, and
+ * finds the station's PI code, its name (PS) and its radiotext (RT):
+ *
+ *   57 kHz     subcarrier, three times the pilot.  BPSK, suppressed carrier
+ *   1187.5 Hz  bit rate.  Bits are differentially coded, then sent as
+ *              biphase symbols of two chips, at 2375 chips/second
+ *   blocks     26 bits: 16 of data and a 10 bit checkword, added to an
+ *              offset word which marks the block's place in a group
+ *   groups     4 blocks, A B C D.  A holds the PI, B the group type
+ *
+ * The composite is mixed down and decimated to RDS_CHIP_SAMPLES samples
+ * per chip as it comes in, which is the only work done at the
+ * composite rate.  Everything else runs at the decimated rate.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+#include <stdint.h>
+
+
+#include "sdrlib.h"
+#include "filter.h"
+
+
+/**
+ * Samples per chip after decimation, roughly.  The decimation is a
+ * whole number, so it is a little more.
+ */
+#define RDS_CHIP_SAMPLES 8
+
+/**
+ * Slowest composite rate that carries the subcarrier, up to 59.4 kHz
+ */
+#define RDS_MIN_RATE 120000.0
+
+/**
+ * Most samples in the chip matched filter
+ */
+#define RDS_MAX_CHIP 32
+
+/**
+ * Composite samples mixed down at a time
+ */
+#define RDS_STEP 64
+
+
+struct Rds
+{
+    float  inRate;
+    int    decimation;
+    float  outRate;
+    //mixing down and decimating
+    float complex osc;     //57 kHz, as a unit phasor
+    float complex oscStep;
+    Fir    *lowpass;       //for its coefficients.  Run at the decimated rate
+    float complex *delayLine; //twice the filter size, so a window is never split
+    int    delayIndex;
+    int    phase;          //input samples since the last output
+    //carrier recovery: a Costas loop
+    float  carrierPhase;
+    float  carrierFreq;
+    float  alpha;
+    float  beta;
+    float  amp;            //average magnitude of the baseband, for the loop
+    //chip timing: a boxcar matched filter and a Gardner loop
+    float  chipBuf[RDS_MAX_CHIP];
+    int    chipLen;
+    int    chipPtr;
+    float  chipSum;
+    float  chipPrev;       //matched filter output on the last sample
+    float  tick;           //half-chip clock
+    float  tickStep;
+    int    onTime;         //true if the next strobe is at a chip's center
+    float  mid;            //last strobe between chips
+    float  chip;           //last chip
+    float  chipAmp;
+    //chips to bits
+    float  pairEnergy[2];  //of the two ways of pairing up chips
+    int    chipCount;
+    int    lastSymbol;
+    //block sync
+    uint32_t reg;          //last 26 bits
+    int    synced;
+    int    bitCount;       //since the last block was found
+    long long bitPos;      //bits since reset, while looking for sync
+    long long lastFoundPos;
+    int    lastFoundType;
+    int    blockIndex;     //0-3 for A-D, of the block being received
+    int    badBlocks;      //in a row
+    uint16_t blocks[4];
+    int    blockOk[4];
+    uint32_t corrections[1024]; //error pattern for each syndrome, or 0
+    //what has been received
+    RdsInfo info;
+    int    piCandidate;
+    char   ps[8];
+    int    psMask;
+    char   rt[64];
+    int    rtMask;
+    int    rtEnd;          //length, once a carriage return has been seen
+    int    rtAb;
+    unsigned long long groups;    //good groups decoded
+    unsigned long long badGroups;
+};
+
+
+/**
+ * @param inRate the rate of the composite, which should be at least
+ *     RDS_MIN_RATE
+ */
+Rds *rdsCreate(float inRate);
+
+/**
+ *
+ */
+void rdsDelete(Rds *obj);
+
+/**
+ * Change the composite rate.  Forgets the station, as it is usually a
+ * change of tuning.  Does nothing if the rate is the same.  Not to be
+ * called while rdsUpdate() may be running.
+ */
+void rdsSetInRate(Rds *obj, float inRate);
+
+/**
+ * Start over, after a gap in the input, keeping what has been received
+ */
+void rdsReset(Rds *obj);
+
+/**
+ * Forget the station, as after tuning to another
+ */
+void rdsClear(Rds *obj);
+
+/**
+ * Copy what has been received so far
+ */
+void rdsGetInfo(Rds *obj, RdsInfo *info);
+
+/**
+ * Decode 'size' samples of composite, in radians/sample as they come
+ * from the FM demodulator.  func is called when the PI, PS or RT
+ * changes.  It may be NULL.
+ */
+void rdsUpdate(Rds *obj, float *data, int size, RdsOutputFunc *func, void *context);
+
+
+
+#endif /* _RDS_H_ */
+
@@ -58,6 +58,22 @@ static void firBPCoeffs(int size, float *coeffs, float loCutoffFreq, float hiCut
         }
 }
 
+/**
+ * Make sure a stage has a pool block to fill.  The block is given up
+ * to the output function when full, and a new one taken then.
+ * @param real true for a block of floats, else of float complex
+ * @return false if out of memory
+ */
+static int outputBlock(void **buf, int *bufPtr, int real)
+{
+    if (!*buf)
+        {
+        *buf = (real) ? blockAllocFloat() : blockAlloc();
+        *bufPtr = 0;
+        }
+    return (*buf != NULL);
+}
+
 //########################################################################
 //#  D E C I M A T O R
 //########################################################################
@@ -75,6 +91,7 @@ Decimator *decimatorCreate(int size, float highRate, float lowRate)
     memset(dec->delayLine, 0, delayLineSize);
     dec->delayIndex = 0;
     dec->acc = 0.0;
+    dec->buf = NULL;
     dec->bufPtr = 0;
     return dec;
 }
@@ -91,6 +108,7 @@ void decimatorDelete(Decimator *dec)
 {
     if (dec)
         {
+        blockRelease(dec->buf);
         free(dec->delayLine);
         free(dec->coeffs);
         free(dec);
@@ -106,6 +124,8 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
     int   delayIndex   = dec->delayIndex;
     float ratio        = dec->ratio;
     float acc          = dec->acc;
+    if (!outputBlock((void **)&(dec->buf), &(dec->bufPtr), FALSE))
+        return;
     float complex *buf = dec->buf;
     int   bufPtr       = dec->bufPtr;
     
@@ -133,7 +153,10 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
             if (bufPtr >= DECIMATOR_BUFSIZE)
                 {
                 func(buf, bufPtr, context);
+                buf = dec->buf = (float complex *)blockRenew(buf);
                 bufPtr = 0;
+                if (!buf)
+                    return;
                 }
             }
         delayIndex = (delayIndex + size1) % size;
@@ -205,7 +228,9 @@ Ddc *ddcCreate(int size, float vfoFreq, float pbLoOff, float pbHiOff, float samp
     obj->inRate = sampleRate;
     ddcSetFreqs(obj, vfoFreq, pbLoOff, pbHiOff);
     obj->acc      = -1.0;
+    obj->buf      = NULL;
     obj->bufPtr   = 0;
+    obj->blockSize = DDC_BUFSIZE;
     obj->vfoPhase = 0.0 + 1.0 * I;
     return obj;
 }
@@ -214,6 +239,7 @@ void ddcDelete(Ddc *obj)
 {
     if (obj)
         {
+        blockRelease(obj->buf);
         delayDelete(obj->delayLine);
         free(obj->coeffs);
         free(obj);
@@ -241,12 +267,39 @@ void ddcSetFreqs(Ddc *obj, float vfo, float pbLo, float pbHi)
 }
 
 
+void ddcSetInRate(Ddc *obj, float inRate)
+{
+    obj->inRate = inRate;
+    ddcSetFreqs(obj, obj->vfo, obj->pbLo, obj->pbHi);
+}
+
+
+void ddcReset(Ddc *obj)
+{
+    DelayVal *v = obj->head;
+    int c = obj->size;
+    while (c--)
+        {
+        v->f = 0.0;
+        v->c = 0.0;
+        v = v->next;
+        }
+    obj->acc = -1.0;
+}
+
+
 float ddcGetOutRate(Ddc *obj)
 {
     return obj->outRate;
 }
 
 
+void ddcSetBlockSize(Ddc *obj, int samples)
+{
+    obj->blockSize = (samples <= 0 || samples > DDC_BUFSIZE) ? DDC_BUFSIZE : samples;
+}
+
+
 
 /**
  * Downmix, downsample, and bandpass the input stream of sample, all in one go.
@@ -262,8 +315,8 @@ float ddcGetOutRate(Ddc *obj)
  * 3.  Process the sample with the FIR bandbass coefficients,  with  the coefficients
  *     first to last, and the samples in the delay line in reverse going from most recent.
  * 4.  Add the sample to the output buffer
- * 5.  When the output buffer is full, call the output function, clear the buffer, and
- *     continue the loop.
+ * 5.  When the output buffer has the block size, call the output function, clear the
+ *     buffer, and continue the loop.
  *
  * Re: the VFO
  * 
@@ -321,8 +374,11 @@ void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *fu
     DelayVal *head     = obj->head;
     float ratio        = obj->ratio;
     float acc          = obj->acc;
+    if (!outputBlock((void **)&(obj->buf), &(obj->bufPtr), FALSE))
+        return;
     float complex *buf = obj->buf;
     int   bufPtr       = obj->bufPtr;
+    int   blockSize    = obj->blockSize;
     float complex vfoPhase = obj->vfoPhase;
     
     while (dataLen--)
@@ -348,11 +404,14 @@ void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *fu
                 }
             //trace("sum:%f", sum * 1000.0);
             buf[bufPtr++] = sum;
-            if (bufPtr >= DDC_BUFSIZE)
+            if (bufPtr >= blockSize)
                 {
-                func(buf, DDC_BUFSIZE, context);
+                func(buf, bufPtr, context);
+                buf = obj->buf = (float complex *)blockRenew(buf);
                 bufPtr = 0;
                 vfoPhase /= cabsf(vfoPhase); //heal
+                if (!buf)
+                    break;
                 }
             }
         head = head->next;
@@ -452,6 +511,30 @@ void cicUpdate(Cic *obj, float complex *data, int datalen, ComplexFunc func, voi
 
 
 
+/**
+ * The lowpass runs at the input rate, so that is what its cutoff is
+ * worked out against.  It is at half the lower rate, which keeps
+ * aliases out going down.  Going up, that is the input's own Nyquist
+ * frequency, so the filter passes everything: the output repeats the
+ * latest filtered input, and nothing here removes the images that
+ * leaves.  The coefficients are scaled to a DC gain of 1, so that the
+ * level does not depend on the rates.
+ */
+static void resamplerSetCoeffs(Resampler *obj)
+{
+    float inRate  = obj->inRate;
+    float outRate = obj->outRate;
+    float cutoff  = 0.5 * ((inRate < outRate) ? inRate : outRate);
+    firLPCoeffs(obj->size, obj->coeffs, cutoff, inRate);
+    float sum = 0.0;
+    for (int i = 0 ; i < obj->size ; i++)
+        sum += obj->coeffs[i];
+    if (sum != 0.0)
+        for (int i = 0 ; i < obj->size ; i++)
+            obj->coeffs[i] /= sum;
+}
+
+
 Resampler *resamplerCreate(int size, float inRate, float outRate)
 {
     Resampler *obj = (Resampler *)malloc(sizeof(Resampler));
@@ -461,7 +544,6 @@ Resampler *resamplerCreate(int size, float inRate, float outRate)
     size |= 1;
     obj->size = size;
     obj->coeffs = (float *)malloc(size * sizeof(float));
-    firLPCoeffs(size, obj->coeffs, outRate, inRate);
     obj->delayLine  = (float *)malloc(size * sizeof(float));
     obj->delayLineC = (float complex *)malloc(size * sizeof(float complex));
     int i = 0;
@@ -473,10 +555,13 @@ Resampler *resamplerCreate(int size, float inRate, float outRate)
     obj->delayIndex = 0;
     obj->inRate = inRate;
     obj->outRate = outRate;
+    resamplerSetCoeffs(obj);
     obj->updown = (outRate > inRate);
     obj->ratio = (obj->updown) ? inRate/outRate : outRate/inRate;
     obj->acc = 0.0;
+    obj->buf = NULL;
     obj->bufPtr = 0;
+    obj->blockSize = RESAMPLER_BUFSIZE;
     return obj;
 }
 
@@ -485,6 +570,7 @@ void resamplerDelete(Resampler *obj)
 {
     if (obj)
         {
+        blockRelease(obj->buf);
         free(obj->delayLine);
         free(obj->delayLineC);
         free(obj->coeffs);
@@ -497,7 +583,7 @@ void resamplerSetInRate(Resampler *obj, float inRate)
 {
     float outRate = obj->outRate;
     obj->inRate = inRate;
-    firLPCoeffs(obj->size, obj->coeffs, outRate, inRate);
+    resamplerSetCoeffs(obj);
     obj->updown = (outRate > inRate);
     obj->ratio  = (obj->updown) ? inRate/outRate : outRate/inRate;
     trace("in:%f out:%f ud:%d, ratio:%f", inRate, outRate, obj->updown, obj->ratio);
@@ -507,12 +593,18 @@ void resamplerSetOutRate(Resampler *obj, float outRate)
 {
     float inRate = obj->inRate;
     obj->outRate = outRate;
-    firLPCoeffs(obj->size, obj->coeffs, outRate, inRate);
+    resamplerSetCoeffs(obj);
     obj->updown = (outRate > inRate);
     obj->ratio  = (obj->updown) ? inRate/outRate : outRate/inRate;
 }
 
 
+void resamplerSetBlockSize(Resampler *obj, int samples)
+{
+    obj->blockSize = (samples <= 0 || samples > RESAMPLER_BUFSIZE) ? RESAMPLER_BUFSIZE : samples;
+}
+
+
 
 
 void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *func, void *context)
@@ -524,8 +616,11 @@ void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *
     int   delayIndex = obj->delayIndex;
     float ratio      = obj->ratio;
     float acc        = obj->acc;
-    float *buf       = obj->buf;
+    if (!outputBlock(&(obj->buf), &(obj->bufPtr), TRUE))
+        return;
+    float *buf       = (float *)obj->buf;
     int   bufPtr     = obj->bufPtr;
+    int   blockSize  = obj->blockSize;
     
     if (obj->updown)
         {
@@ -547,10 +642,13 @@ void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *
                     idx %= size;
                     }
                 buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
+                if (bufPtr >= blockSize)
                     {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
+                    (*func)(buf, bufPtr, context);
+                    buf = obj->buf = (float *)blockRenewFloat(buf);
                     bufPtr = 0;
+                    if (!buf)
+                        return;
                     }
                 }
             delayIndex = (delayIndex + size1) % size;
@@ -576,10 +674,13 @@ void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *
                     idx %= size;
                     }
                 buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
+                if (bufPtr >= blockSize)
                     {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
+                    (*func)(buf, bufPtr, context);
+                    buf = obj->buf = (float *)blockRenewFloat(buf);
                     bufPtr = 0;
+                    if (!buf)
+                        return;
                     }
                 }
             delayIndex = (delayIndex + size1) % size;
@@ -600,8 +701,11 @@ void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexO
     int   delayIndex   = obj->delayIndex;
     float ratio        = obj->ratio;
     float acc          = obj->acc;
-    float complex *buf = obj->bufC;
+    if (!outputBlock(&(obj->buf), &(obj->bufPtr), FALSE))
+        return;
+    float complex *buf = (float complex *)obj->buf;
     int   bufPtr       = obj->bufPtr;
+    int   blockSize    = obj->blockSize;
     
     if (obj->updown)
         {
@@ -623,10 +727,13 @@ void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexO
                     idx %= size;
                     }
                 buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
+                if (bufPtr >= blockSize)
                     {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
+                    (*func)(buf, bufPtr, context);
+                    buf = obj->buf = (float complex *)blockRenew(buf);
                     bufPtr = 0;
+                    if (!buf)
+                        return;
                     }
                 }
             delayIndex = (delayIndex + size1) % size;
@@ -652,10 +759,13 @@ void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexO
                     idx %= size;
                     }
                 buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
+                if (bufPtr >= blockSize)
                     {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
+                    (*func)(buf, bufPtr, context);
+                    buf = obj->buf = (float complex *)blockRenew(buf);
                     bufPtr = 0;
+                    if (!buf)
+                        return;
                     }
                 }
             delayIndex = (delayIndex + size1) % size;
@@ -667,3 +777,67 @@ void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexO
 }
 
 
+
+
+/**
+ * Count what 'dataLen' input samples would make, without filtering
+ * them, and clear the delay lines, since what follows is silence
+ */
+static int resamplerSkipCount(Resampler *obj, int dataLen)
+{
+    float ratio = obj->ratio;
+    float acc   = obj->acc;
+    int   count = 0;
+    if (obj->updown)
+        {
+        while (dataLen--)
+            {
+            acc -= 1.0;
+            while (acc < 0.0)
+                {
+                acc += ratio;
+                count++;
+                }
+            }
+        }
+    else
+        {
+        while (dataLen--)
+            {
+            acc += ratio;
+            if (acc >= 0.0)
+                {
+                acc -= 1.0;
+                count++;
+                }
+            }
+        }
+    obj->acc = acc;
+    memset(obj->delayLine, 0, obj->size * sizeof(float));
+    memset(obj->delayLineC, 0, obj->size * sizeof(float complex));
+    return count;
+}
+
+
+int resamplerSkip(Resampler *obj, int dataLen, FloatOutputFunc *func, void *context)
+{
+    if (obj->buf && obj->bufPtr > 0)
+        {
+        (*func)((float *)obj->buf, obj->bufPtr, context);
+        obj->buf = blockRenewFloat(obj->buf);
+        obj->bufPtr = 0;
+        }
+    return resamplerSkipCount(obj, dataLen);
+}
+
+
+int resamplerSkipC(Resampler *obj, int dataLen, ComplexOutputFunc *func, void *context)
+{
+    if (obj->buf && obj->bufPtr > 0)
+        {
+        (*func)((float complex *)obj->buf, obj->bufPtr, context);
+        obj->buf = blockRenew(obj->buf);
+        obj->bufPtr = 0;
+        }
+    return resamplerSkipCount(obj, dataLen);
+}
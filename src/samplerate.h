@@ -29,6 +29,7 @@
 
 
 #include "sdrlib.h"
+#include "pool.h"
 
 
 
@@ -41,7 +42,7 @@
 /**
  *
  */
-#define DECIMATOR_BUFSIZE (16384)
+#define DECIMATOR_BUFSIZE (POOL_BLOCK_SAMPLES)
 
 /**
  *
@@ -54,7 +55,7 @@ struct Decimator
     int delayIndex;
     float ratio;
     float acc;
-    float complex buf[DECIMATOR_BUFSIZE];
+    float complex *buf; //pool block being filled
     int bufPtr;
 };
 
@@ -87,7 +88,7 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
 /**
  *
  */
-#define DDC_BUFSIZE (16384)
+#define DDC_BUFSIZE (POOL_BLOCK_SAMPLES)
 
 
 typedef struct DelayVal DelayVal;
@@ -125,8 +126,9 @@ struct Ddc
     float complex vfoPhase;
     float complex vfoFreq;
     float acc;
-    float complex buf[DECIMATOR_BUFSIZE];
+    float complex *buf; //pool block being filled
     int   bufPtr;
+    int   blockSize; //samples per output block, up to DDC_BUFSIZE
 };
 
 /**
@@ -149,6 +151,22 @@ float ddcGetOutRate(Ddc *obj);
  */
 void ddcSetFreqs(Ddc *obj, float vfoFreq, float pbLoOff, float pbHiOff);
 
+/**
+ * Change the input sample rate, keeping the current frequencies
+ */
+void ddcSetInRate(Ddc *obj, float inRate);
+
+/**
+ * Output blocks of at most 'samples', for lower latency.  0 for
+ * DDC_BUFSIZE, the default.
+ */
+void ddcSetBlockSize(Ddc *obj, int samples);
+
+/**
+ * Forget the samples in the delay line, after a gap in the input
+ */
+void ddcReset(Ddc *obj);
+
 /**
  *
  */
@@ -164,7 +182,7 @@ void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *fu
 /**
  *
  */
-#define RESAMPLER_BUFSIZE (16384)
+#define RESAMPLER_BUFSIZE (POOL_BLOCK_SAMPLES)
 
 
 
@@ -183,9 +201,9 @@ struct Resampler
     float ratio;
     int updown;
     float acc;
-    float buf[RESAMPLER_BUFSIZE];
-    float complex bufC[RESAMPLER_BUFSIZE];
+    void *buf; //pool block being filled: floats by resamplerUpdate(), float complex by resamplerUpdateC()
     int bufPtr;
+    int blockSize; //samples per output block, up to RESAMPLER_BUFSIZE
 };
 
 /**
@@ -208,6 +226,12 @@ void resamplerSetInRate(Resampler *obj, float inRate);
  */
 void resamplerSetOutRate(Resampler *obj, float outRate);
 
+/**
+ * Output blocks of at most 'samples', for lower latency.  0 for
+ * RESAMPLER_BUFSIZE, the default.
+ */
+void resamplerSetBlockSize(Resampler *obj, int samples);
+
 /**
  *
  */
@@ -218,6 +242,18 @@ void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *
  */
 void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context);
 
+/**
+ * Skip 'dataLen' input samples of silence, as from a closed squelch.
+ * The samples already made are output first, in a short block.
+ * @return the number of output samples the silence takes up
+ */
+int resamplerSkip(Resampler *obj, int dataLen, FloatOutputFunc *func, void *context);
+
+/**
+ * As resamplerSkip(), for the complex resampler
+ */
+int resamplerSkipC(Resampler *obj, int dataLen, ComplexOutputFunc *func, void *context);
+
 
 
 
@@ -23,25 +23,143 @@
  *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE //for pthread_setaffinity_np()
+#endif
+
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
 
 
 #include "sdrlib.h"
 
+#include "agc.h"
 #include "audio.h"
 #include "codec.h"
 #include "demod.h"
 #include "device.h"
 #include "fft.h"
 #include "filter.h"
+#include "frontend.h"
+#include "graph.h"
+#include "histogram.h"
+#include "pool.h"
+#include "rds.h"
 #include "samplerate.h"
+#include "squelch.h"
+#include "stereo.h"
+#include "sweep.h"
 #include "vfo.h"
 
 #include "private.h"
 
 
+typedef struct Receiver Receiver;
+
 static void *sdrReaderThread(void *ctx);
+static void sdrInRateChanged(Receiver *rx);
+static void sdrResetChain(Receiver *rx);
+static unsigned long long sdrSweepTune(double freq, unsigned long long *time, void *ctx);
+static void sdrUpdateOutputs(SdrLib *sdr);
+
+/**
+ * Everything needed to capture and process the samples from one device.
+ * Each runs in its own reader thread.  The processing chain is a graph:
+ *
+ *   fft, fftBytes ---------------------------------------> ps
+ *   frontend -> ddc -> demod -> squelch -+-> agc -> resampler -------+-> audio
+ *                                        |                           +-> audioOut
+ *                                        |                           +-> codec ------+-> codecOut
+ *                                        |                                           |
+ *                                        +-> stereo -> agcStereo -> resamplerStereo -+-> audioStereo
+ *                                        |                                           +-> audioOutStereo
+ *                                        |                                           +-> codecStereo
+ *                                        +-> rds
+ *
+ * The reader feeds fft and ddc with float samples, or fftBytes and
+ * frontend with raw ones.  MODE_WFM uses the stereo branch and rds, and
+ * the other modes the mono branch.
+ */
+struct Receiver
+{
+    SdrLib         *sdr;
+    int            index;   //of the device in sdr->devices
+    Device         *device; //set while started
+    pthread_t      thread;
+    int            running; //true from starting the reader thread until it ends
+    int            stopRequested; //asks the reader thread to end
+    int            cpu;     //core the reader thread is pinned to, or -1
+    unsigned long long nextSeq; //seq of the sample we expect next from the device
+    unsigned long long gaps;    //discontinuities seen in the device's data
+    Fft            *fft;
+    Frontend       *frontend; //for devices delivering raw bytes
+    int            rawMode;   //true if the device delivers SAMPLE_U8
+    void           *context;  //outputs for this receiver only.  See sdrSetDeviceOutput()
+    UintOutputFunc *psFunc;
+    ByteOutputFunc *codecFunc;
+    Ddc            *ddc;
+    Mode           mode;
+    Demodulator    *demod;   //of demodMode.  Only the one in use is kept
+    Mode           demodMode;
+    int            demodPending; //set up the demod again before the next block
+    Sideband       samSideband;
+    float          cwBfo;
+    float          cwWidth;
+    float          fskShift;
+    float          fskBaud;
+    KeyOutputFunc  *keyFunc;  //set by sdrUpdateOutputs()
+    void           *keyContext;
+    Squelch        *squelch;
+    int            squelchEnabled;
+    Agc            *agc;
+    Agc            *agcStereo;
+    int            agcEnabled;
+    float          agcLookahead; //seconds, set by sdrUpdateStages()
+    Resampler      *resampler;
+    Codec          *codec;
+    Stereo         *stereo;
+    Resampler      *resamplerStereo;
+    Codec          *codecStereo;
+    Rds            *rds;
+    Graph          *graph;
+    Node           *fftNode;
+    Node           *fftBytesNode;
+    Node           *frontendNode;
+    Node           *ddcNode;
+    Node           *demodNode;
+    Node           *squelchNode;
+    Node           *agcNode;
+    Node           *agcStereoNode;
+    Node           *resamplerNode;
+    Node           *audioNode;
+    Node           *audioOutNode; //set by sdrUpdateOutputs()
+    Node           *codecNode;
+    Node           *stereoNode;
+    Node           *resamplerStereoNode;
+    Node           *audioStereoNode;
+    Node           *audioOutStereoNode;
+    Node           *codecStereoNode;
+    Node           *rdsNode;      //set by sdrUpdateOutputs()
+    Node           *psNode;       //outputs, set by sdrUpdateOutputs()
+    Node           *codecOutNode;
+    Sweep          *sweep;
+    int            sweeping;     //true while the sweep has the device
+    double         sweepCenter;  //frequency to go back to after sweeping
+    double         sweepStarted; //time, for the line rate
+    int            resetPending; //reset the chain before the next block
+    int            stagesPending; //give the stages after the ddc the IF rate before the next block
+    int            inRatePending; //and the ddc and frontend the device's rate and frontendStages
+    int            frontendStages; //wanted.  Given to the frontend by sdrUpdateStages()
+    float          rdsVfo;       //vfo the station rds has been decoding was tuned at
+    float          latency;      //longest block out of each stage, in seconds.  0 for whole blocks
+    double         statsStarted; //time the stage counters were last zeroed
+    int            statsResetPending; //zero them before the next block
+};
+
 
 /**
  * Our main context
@@ -50,28 +168,319 @@ struct SdrLib
 {
     int            deviceCount;
     Device         *devices[SDR_MAX_DEVICES];
-    Device         *device;
-    pthread_t      thread;
-    int            running; //state of the reader thread
-    Fft            *fft;
+    Receiver       *receivers[SDR_MAX_DEVICES]; //created as needed
+    Receiver       *rx;      //the selected receiver, which the sdrSet/Get calls act on
     void           *context; //context for any client code calling me
     UintOutputFunc *psFunc; //for outputting the power spectrum
     ByteOutputFunc *codecFunc;
-    Ddc            *ddc;
-    Mode           mode;
-    Demodulator    *demod;
-    Demodulator    *demodNull;
-    Demodulator    *demodAm;
-    Demodulator    *demodFm;
-    Demodulator    *demodLsb;
-    Demodulator    *demodUsb;
-    Resampler      *resampler;
+    FloatOutputFunc *audioFunc; //demodulated audio.  See sdrSetAudioOutput()
+    void           *audioContext;
+    RdsOutputFunc  *rdsFunc;
+    void           *rdsContext;
+    KeyOutputFunc  *keyFunc;
+    void           *keyContext;
     int            audioEnabled;
-    Audio          *audio;
-    Codec          *codec;
+    Audio          *audio;   //NULL if there is no sound card
 };
 
 
+
+/*############################################################################
+## R E C E I V E R S
+############################################################################*/
+
+
+static double sdrNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+/**
+ * The same clock as the capture times of device blocks
+ */
+static unsigned long long sdrNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * Samples in a block of the latency target, at the rate
+ */
+static int sdrBlockSamples(Receiver *rx, float rate)
+{
+    if (rx->latency <= 0.0)
+        return 0;
+    int samples = (int)(rx->latency * rate);
+    return (samples < 1) ? 1 : samples;
+}
+
+
+/**
+ * Give the stages blocks of no more than the latency target, each at
+ * its own output rate.  Those from the ddc to the resampler are at the
+ * IF rate, and the resamplers at the audio rate.  The demodulator is
+ * given its block size by sdrUpdateDemod().
+ */
+static void sdrUpdateBlockSizes(Receiver *rx)
+{
+    int ifBlock = sdrBlockSamples(rx, ddcGetOutRate(rx->ddc));
+    ddcSetBlockSize(rx->ddc, ifBlock);
+    agcSetBlockSize(rx->agc, ifBlock);
+    agcSetBlockSize(rx->agcStereo, ifBlock);
+    stereoSetBlockSize(rx->stereo, ifBlock);
+    int audioBlock = sdrBlockSamples(rx, rx->resampler->outRate);
+    resamplerSetBlockSize(rx->resampler, audioBlock);
+    resamplerSetBlockSize(rx->resamplerStereo, audioBlock);
+}
+
+
+/**
+ * Make the demodulator for the mode, if it has changed, and give it the
+ * receiver's settings.  Only the one in use is kept, and it is made
+ * afresh when the mode changes, so a receiver holds the state and pool
+ * block of one mode rather than of every mode it has been in.
+ */
+static void sdrUpdateDemod(Receiver *rx)
+{
+    rx->demodPending = FALSE;
+    if (rx->mode != rx->demodMode || !rx->demod)
+        {
+        Demodulator *dem = demodCreate(rx->mode);
+        if (!dem)
+            {
+            error("Could not create the demodulator for mode %d", rx->mode);
+            return;
+            }
+        demodDelete(rx->demod);
+        rx->demod     = dem;
+        rx->demodMode = rx->mode;
+        rx->demodNode->obj = dem;
+        }
+    Demodulator *dem = rx->demod;
+    demodSetPassband(dem, ddcGetOutRate(rx->ddc), rx->ddc->pbLo, rx->ddc->pbHi);
+    demodSamSetSideband(dem, rx->samSideband);
+    demodCwSet(dem, rx->cwBfo, rx->cwWidth);
+    demodFskSet(dem, rx->fskShift, rx->fskBaud);
+    demodCwSetKeyOutput(dem, rx->keyFunc, rx->keyContext);
+    demodSetBlockSize(dem, sdrBlockSamples(rx, ddcGetOutRate(rx->ddc)));
+}
+
+
+/**
+ * The mode or a setting of the demodulator has changed.  While the
+ * reader is running, the demodulator is its own, so it is set up on
+ * the reader's thread before the next block, and never deleted while
+ * in use.
+ */
+static void sdrDemodChanged(Receiver *rx)
+{
+    if (rx->running)
+        rx->demodPending = TRUE;
+    else
+        sdrUpdateDemod(rx);
+}
+
+
+/**
+ * Give the frontend its stages, and the ddc the rate they leave of the
+ * device's.  The samples that follow are at another rate, so the chain
+ * starts over.
+ */
+static void sdrUpdateInRate(Receiver *rx)
+{
+    rx->inRatePending = FALSE;
+    frontendSetStages(rx->frontend, rx->frontendStages);
+    Device *d = rx->device;
+    float rate = (d) ? d->getSampleRate(d->ctx) : 0.0;
+    if (rate > 0.0)
+        {
+        if (rx->rawMode)
+            rate /= (float)frontendGetFactor(rx->frontend);
+        ddcSetInRate(rx->ddc, rate);
+        }
+    sdrResetChain(rx);
+}
+
+
+/**
+ * Give the stages after the ddc the IF rate, the squelch what to
+ * measure for the mode, the agc its lookahead, all of them their block
+ * sizes, and the ddc its input rate if that has changed.  Those that
+ * rebuild their filters or start over for these do nothing if they
+ * have not changed.  Rds forgets the station when the vfo moves.
+ */
+static void sdrUpdateStages(Receiver *rx)
+{
+    rx->stagesPending = FALSE;
+    if (rx->inRatePending)
+        sdrUpdateInRate(rx);
+    float rate = ddcGetOutRate(rx->ddc);
+    resamplerSetInRate(rx->resampler, rate);
+    resamplerSetInRate(rx->resamplerStereo, rate);
+    stereoSetInRate(rx->stereo, rate);
+    rdsSetInRate(rx->rds, rate);
+    int fm = (rx->mode == MODE_FM || rx->mode == MODE_WFM);
+    squelchSetInRate(rx->squelch, rate);
+    squelchSetType(rx->squelch, fm ? SQUELCH_NOISE : SQUELCH_POWER);
+    agcSetInRate(rx->agc, rate);
+    agcSetInRate(rx->agcStereo, rate);
+    agcSetLookahead(rx->agc, rx->agcLookahead);
+    agcSetLookahead(rx->agcStereo, rx->agcLookahead);
+    sdrUpdateBlockSizes(rx);
+    if (rx->ddc->vfo != rx->rdsVfo)
+        {
+        rdsClear(rx->rds);
+        rx->rdsVfo = rx->ddc->vfo;
+        }
+}
+
+
+/**
+ * The IF rate, the mode, the agc lookahead or the latency target may
+ * have changed.  As with the demodulator, the stages are the reader's
+ * while it runs, so they are set up on its thread before the next
+ * block, never under it.  Call sdrDemodChanged() after this, so the
+ * demodulator is given the rate the stages end up with.
+ */
+static void sdrStagesChanged(Receiver *rx)
+{
+    if (rx->running)
+        rx->stagesPending = TRUE;
+    else
+        sdrUpdateStages(rx);
+}
+
+
+static Receiver *receiverCreate(SdrLib *sdr, int index)
+{
+    Receiver *rx = (Receiver *) malloc(sizeof(Receiver));
+    if (!rx)
+        return NULL;
+    memset(rx, 0, sizeof(Receiver));
+    rx->sdr       = sdr;
+    rx->index     = index;
+    rx->cpu       = -1;
+    rx->fft       = fftCreate(16384);
+    rx->frontend  = frontendCreate(0);
+    rx->ddc       = ddcCreate(21, 0.0, -5000.0, 5000.0, 2048000.0);
+    rx->demod     = demodCreate(MODE_FM);
+    rx->demodMode = MODE_FM;
+    rx->mode      = MODE_FM;
+    rx->samSideband = SIDEBAND_BOTH;
+    rx->cwBfo     = 700.0;
+    rx->cwWidth   = 500.0;
+    rx->fskShift  = 170.0;
+    rx->fskBaud   = 45.45;
+    rx->squelch   = squelchCreate(ddcGetOutRate(rx->ddc));
+    squelchSetType(rx->squelch, SQUELCH_NOISE);
+    rx->squelchEnabled = FALSE;
+    rx->agc       = agcCreate(ddcGetOutRate(rx->ddc));
+    rx->agcStereo = agcCreateChannels(ddcGetOutRate(rx->ddc), 2);
+    rx->agcEnabled = TRUE;
+    rx->codec     = codecCreate();
+    rx->codecStereo = codecCreateChannels(2);
+    float audioRate = (sdr->audio) ? sdr->audio->sampleRate : SDR_AUDIO_RATE;
+    rx->resampler = resamplerCreate(21, audioRate, audioRate);
+    rx->resamplerStereo = resamplerCreate(21, audioRate, audioRate);
+    rx->stereo    = stereoCreate(audioRate);
+    rx->rds       = rdsCreate(audioRate);
+    rx->sweep     = sweepCreate(sdrSweepTune, rx);
+
+    Graph *g = rx->graph = graphCreate();
+    rx->fftNode      = graphAdd(g, fftNodeCreate("fft", rx->fft));
+    rx->fftBytesNode = graphAdd(g, fftBytesNodeCreate("fftBytes", rx->fft));
+    rx->frontendNode = graphAdd(g, frontendNodeCreate("frontend", rx->frontend));
+    rx->ddcNode      = graphAdd(g, ddcNodeCreate("ddc", rx->ddc));
+    rx->demodNode    = graphAdd(g, demodNodeCreate("demod", rx->demod));
+    rx->squelchNode  = graphAdd(g, squelchNodeCreate("squelch", rx->squelch));
+    rx->agcNode      = graphAdd(g, agcNodeCreate("agc", rx->agc));
+    Node *resampler  = graphAdd(g, resamplerNodeCreate("resampler", rx->resampler));
+    rx->audioNode    = graphAdd(g, audioNodeCreate("audio", sdr->audio));
+    rx->audioOutNode = graphAdd(g, callbackNodeCreate("audioOut", PORT_FLOAT, NULL, NULL));
+    rx->codecNode    = graphAdd(g, codecNodeCreate("codec", rx->codec));
+    rx->stereoNode   = graphAdd(g, stereoNodeCreate("stereo", rx->stereo));
+    rx->agcStereoNode = graphAdd(g, agcNodeCreate("agcStereo", rx->agcStereo));
+    Node *resamplerStereo = graphAdd(g, resamplerStereoNodeCreate("resamplerStereo", rx->resamplerStereo));
+    rx->audioStereoNode    = graphAdd(g, audioStereoNodeCreate("audioStereo", sdr->audio));
+    rx->audioOutStereoNode = graphAdd(g, callbackNodeCreate("audioOutStereo", PORT_STEREO, NULL, NULL));
+    rx->codecStereoNode    = graphAdd(g, codecNodeCreate("codecStereo", rx->codecStereo));
+    rx->rdsNode      = graphAdd(g, rdsNodeCreate("rds", rx->rds));
+    rx->resamplerNode       = resampler;
+    rx->resamplerStereoNode = resamplerStereo;
+    rx->psNode       = graphAdd(g, callbackNodeCreate("ps", PORT_UINT, NULL, NULL));
+    rx->codecOutNode = graphAdd(g, callbackNodeCreate("codecOut", PORT_BYTE, NULL, NULL));
+    nodeConnect(rx->fftNode, rx->psNode);
+    nodeConnect(rx->fftBytesNode, rx->psNode);
+    nodeConnect(rx->frontendNode, rx->ddcNode);
+    nodeConnect(rx->ddcNode, rx->demodNode);
+    nodeConnect(rx->demodNode, rx->squelchNode);
+    nodeConnect(rx->squelchNode, rx->agcNode);
+    nodeConnect(rx->agcNode, resampler);
+    nodeConnect(resampler, rx->audioNode);
+    nodeConnect(resampler, rx->audioOutNode);
+    nodeConnect(resampler, rx->codecNode);
+    nodeConnect(rx->codecNode, rx->codecOutNode);
+    nodeConnect(rx->squelchNode, rx->stereoNode);
+    nodeConnect(rx->stereoNode, rx->agcStereoNode);
+    nodeConnect(rx->agcStereoNode, resamplerStereo);
+    nodeConnect(resamplerStereo, rx->audioStereoNode);
+    nodeConnect(resamplerStereo, rx->audioOutStereoNode);
+    nodeConnect(resamplerStereo, rx->codecStereoNode);
+    nodeConnect(rx->codecStereoNode, rx->codecOutNode);
+    nodeConnect(rx->squelchNode, rx->rdsNode);
+    nodeTrackLatency(rx->audioNode);
+    nodeTrackLatency(rx->audioStereoNode);
+    nodeTrackLatency(rx->codecOutNode);
+    return rx;
+}
+
+
+static void receiverDelete(Receiver *rx)
+{
+    graphDelete(rx->graph);
+    codecDelete(rx->codec);
+    codecDelete(rx->codecStereo);
+    fftDelete(rx->fft);
+    frontendDelete(rx->frontend);
+    ddcDelete(rx->ddc);
+    demodDelete(rx->demod);
+    squelchDelete(rx->squelch);
+    agcDelete(rx->agc);
+    agcDelete(rx->agcStereo);
+    resamplerDelete(rx->resampler);
+    resamplerDelete(rx->resamplerStereo);
+    stereoDelete(rx->stereo);
+    rdsDelete(rx->rds);
+    sweepDelete(rx->sweep);
+    free(rx);
+}
+
+
+/**
+ * Get the receiver for a device, creating it the first time
+ */
+static Receiver *sdrGetReceiver(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= SDR_MAX_DEVICES)
+        {
+        error("Device index %d out of range", index);
+        return NULL;
+        }
+    if (!sdr->receivers[index])
+        {
+        sdr->receivers[index] = receiverCreate(sdr, index);
+        sdrUpdateOutputs(sdr);
+        }
+    return sdr->receivers[index];
+}
+
+
 /**
  */  
 SdrLib *sdrCreate(void *context, UintOutputFunc *psFunc, ByteOutputFunc *codecFunc)
@@ -87,18 +496,8 @@ SdrLib *sdrCreate(void *context, UintOutputFunc *psFunc, ByteOutputFunc *codecFu
     sdr->context   = context;
     sdr->psFunc    = psFunc;
     sdr->codecFunc = codecFunc;
-    sdr->fft       = fftCreate(16384);
-    sdr->ddc       = ddcCreate(21, 0.0, -5000.0, 5000.0, 2048000.0);
-    sdr->demodNull = demodNullCreate();
-    sdr->demodFm   = demodFmCreate();
-    sdr->demodAm   = demodAmCreate();
-    sdr->demodLsb  = demodLsbCreate();
-    sdr->demodUsb  = demodUsbCreate();
-    sdr->demod     = sdr->demodFm;
-    sdr->mode      = MODE_FM;
     sdr->audio     = audioCreate();
-    sdr->codec     = codecCreate();
-    sdr->resampler = resamplerCreate(21, sdr->audio->sampleRate, sdr->audio->sampleRate);
+    sdr->rx        = sdrGetReceiver(sdr, 0);
     
     sdrSetAfGain(sdr, 0.0);
     
@@ -111,90 +510,218 @@ SdrLib *sdrCreate(void *context, UintOutputFunc *psFunc, ByteOutputFunc *codecFu
  */   
 int sdrDelete(SdrLib *sdr)
 {
+    sdrStop(sdr);
     for (int i = 0 ; i < sdr->deviceCount ; i++)
         {
         Device *d = sdr->devices[i];
         d->delete(d->ctx);
         }
+    for (int i = 0 ; i < SDR_MAX_DEVICES ; i++)
+        {
+        if (sdr->receivers[i])
+            receiverDelete(sdr->receivers[i]);
+        }
     audioDelete(sdr->audio);
-    codecDelete(sdr->codec);
-    fftDelete(sdr->fft);
-    //vfoDelete(sdr->vfo);
-    //firDelete(sdr->bpf);
-    ddcDelete(sdr->ddc);
-    demodDelete(sdr->demodFm);
-    demodDelete(sdr->demodAm);
-    demodDelete(sdr->demodLsb);
-    demodDelete(sdr->demodUsb);
-    resamplerDelete(sdr->resampler);
     free(sdr);
     return TRUE;
 }
 
 
 
+/**
+ * Keep a reader thread on one core, so that its DSP state stays in that
+ * core's cache and it does not compete with the other receivers.
+ */
+static void sdrPinThread(Receiver *rx)
+{
+    if (rx->cpu < 0)
+        return;
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(rx->cpu, &cpus);
+    int rc = pthread_setaffinity_np(rx->thread, sizeof(cpu_set_t), &cpus);
+    if (rc)
+        error("Could not pin device %d to cpu %d: %d", rx->index, rx->cpu, rc);
+    else
+        trace("device %d pinned to cpu %d", rx->index, rx->cpu);
+#else
+    trace("Thread pinning is not supported on this platform");
+#endif
+}
+
 
 /**
  */   
-int sdrStart(SdrLib *sdr)
+int sdrStartDevice(SdrLib *sdr, int index, int cpu)
 {
     pthread_t thread;
-    if (sdr->running || sdr->device)
+    if (index < 0 || index >= sdr->deviceCount)
         {
-        error("Device already started");
+        error("No device %d.  %d devices found", index, sdr->deviceCount);
         return FALSE;
         }
-    if (!sdr->deviceCount)
+    Receiver *rx = sdrGetReceiver(sdr, index);
+    if (!rx)
+        return FALSE;
+    if (rx->running || rx->device)
         {
-        error("No devices found");
+        error("Device already started");
         return FALSE;
         }
-    Device *d = sdr->devices[0];
+    Device *d = sdr->devices[index];
+    //prefer raw bytes, if we can borrow them from the device
+    rx->rawMode = (d->readPeek && d->setFormat && d->setFormat(d->ctx, SAMPLE_U8));
+    rx->nextSeq = 0;
+    rx->gaps    = 0;
+    rx->cpu     = cpu;
     if (!d->open(d->ctx))
         {
         error("Could not start device");
         return FALSE;
         }
-    sdr->device = d;
+    rx->device = d;
+    rx->statsStarted = sdrNow();
+    rx->statsResetPending = FALSE;
+    graphResetStats(rx->graph);
     d->setGain(d->ctx, 1.0);
     d->setCenterFrequency(d->ctx, 88700000.0);
-    trace("starting");
-    int rc = pthread_create(&thread, NULL, sdrReaderThread, (void *)sdr);
+    sdrInRateChanged(rx);
+    trace("starting device %d: %s", index, d->name);
+    //from here on, changes are the reader's to make
+    rx->stopRequested = FALSE;
+    rx->running = 1;
+    int rc = pthread_create(&thread, NULL, sdrReaderThread, (void *)rx);
     if (rc)
         {
         error("ERROR; return code from pthread_create() is %d", rc);
+        rx->running = 0;
+        d->close(d->ctx);
+        rx->device = NULL;
         return FALSE;
         }
     trace("started");
-    sdr->thread = thread;
-    sdr->running = 1;
+    rx->thread = thread;
+    sdrPinThread(rx);
     return TRUE;
 }
 
 
 /**
  */   
-int sdrStop(SdrLib *sdr)
+int sdrStopDevice(SdrLib *sdr, int index)
 {
-    if (!sdr->running)
+    if (index < 0 || index >= SDR_MAX_DEVICES)
+        return FALSE;
+    Receiver *rx = sdr->receivers[index];
+    if (!rx || !rx->device)
         return TRUE;
+    sweepStop(rx->sweep);
+    if (rx->sweeping && rx->device->setBlockSize)
+        rx->device->setBlockSize(rx->device->ctx, 0);
+    rx->sweeping = FALSE;
+    rx->stopRequested = TRUE;
     void *status;
-    pthread_join(sdr->thread, &status);
-    Device *d = sdr->device;
-    if (d)
+    pthread_join(rx->thread, &status);
+    rx->running = 0;
+    Device *d = rx->device;
+    d->close(d->ctx);
+    rx->device = NULL;
+    //anything asked for after the reader's last block
+    if (rx->stagesPending)
+        sdrUpdateStages(rx);
+    if (rx->demodPending)
+        sdrUpdateDemod(rx);
+    //the reader's cached blocks went to the shared list when it ended
+    poolTrim();
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrStart(SdrLib *sdr)
+{
+    return sdrStartDevice(sdr, sdr->rx->index, -1);
+}
+
+
+/**
+ */   
+int sdrStop(SdrLib *sdr)
+{
+    for (int i = 0 ; i < SDR_MAX_DEVICES ; i++)
+        sdrStopDevice(sdr, i);
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrGetDeviceCount(SdrLib *sdr)
+{
+    return sdr->deviceCount;
+}
+
+
+/**
+ */   
+char *sdrGetDeviceName(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= sdr->deviceCount)
+        return NULL;
+    return sdr->devices[index]->name;
+}
+
+
+/**
+ */   
+int sdrSelectDevice(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= SDR_MAX_DEVICES ||
+        (index >= sdr->deviceCount && index > 0))
         {
-        d->close(d->ctx);
-        sdr->device = NULL;
+        error("No device %d.  %d devices found", index, sdr->deviceCount);
+        return FALSE;
         }
-    sdr->running = 0;
+    Receiver *rx = sdrGetReceiver(sdr, index);
+    if (!rx)
+        return FALSE;
+    sdr->rx = rx;
+    sdrUpdateOutputs(sdr);
     return TRUE;
 }
 
+
+/**
+ */   
+int sdrGetSelectedDevice(SdrLib *sdr)
+{
+    return sdr->rx->index;
+}
+
+
+/**
+ */   
+int sdrSetDeviceOutput(SdrLib *sdr, int index, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc)
+{
+    Receiver *rx = sdrGetReceiver(sdr, index);
+    if (!rx)
+        return FALSE;
+    rx->context   = context;
+    rx->psFunc    = psFunc;
+    rx->codecFunc = codecFunc;
+    sdrUpdateOutputs(sdr);
+    return TRUE;
+}
+
+
 /**
  */   
 double sdrGetCenterFrequency(SdrLib *sdr)
 {
-    Device *d = sdr->device;
+    Device *d = sdr->rx->device;
     return (d) ? d->getCenterFrequency(d->ctx) : 0.0;
 }
 
@@ -203,7 +730,7 @@ double sdrGetCenterFrequency(SdrLib *sdr)
  */   
 int sdrSetCenterFrequency(SdrLib *sdr, double freq)
 {
-    Device *d = sdr->device;
+    Device *d = sdr->rx->device;
     return (d) ? d->setCenterFrequency(d->ctx, freq) : 0;
 }
 
@@ -211,11 +738,11 @@ int sdrSetCenterFrequency(SdrLib *sdr, double freq)
  */   
 void sdrSetDdcFreqs(SdrLib *sdr, float vfo, float pbLo, float pbHi)
 {
-    Ddc *ddc = sdr->ddc;
-    ddcSetFreqs(ddc, vfo, ddc->pbLo, ddc->pbHi);
-    float rate = ddcGetOutRate(ddc);
-    trace("if rate: %f", rate);
-    resamplerSetInRate(sdr->resampler, rate);
+    Ddc *ddc = sdr->rx->ddc;
+    ddcSetFreqs(ddc, vfo, pbLo, pbHi);
+    trace("if rate: %f", ddcGetOutRate(ddc));
+    sdrStagesChanged(sdr->rx);
+    sdrDemodChanged(sdr->rx);
 }
 
 
@@ -223,7 +750,7 @@ void sdrSetDdcFreqs(SdrLib *sdr, float vfo, float pbLo, float pbHi)
  */   
 void sdrSetVfo(SdrLib *sdr, float vfo)
 {
-    Ddc *ddc = sdr->ddc;
+    Ddc *ddc = sdr->rx->ddc;
     sdrSetDdcFreqs(sdr, vfo, ddc->pbLo, ddc->pbHi);
 }
 
@@ -232,14 +759,14 @@ void sdrSetVfo(SdrLib *sdr, float vfo)
  */   
 float sdrGetVfo(SdrLib *sdr)
 {
-    return sdr->ddc->vfo;
+    return sdr->rx->ddc->vfo;
 }
 
 /**
  */   
 void sdrSetPbLo(SdrLib *sdr, float pbLo)
 {
-    Ddc *ddc = sdr->ddc;
+    Ddc *ddc = sdr->rx->ddc;
     sdrSetDdcFreqs(sdr, ddc->vfo, pbLo, ddc->pbHi);
 }
 
@@ -248,14 +775,14 @@ void sdrSetPbLo(SdrLib *sdr, float pbLo)
  */   
 float sdrGetPbLo(SdrLib *sdr)
 {
-    return sdr->ddc->pbLo;
+    return sdr->rx->ddc->pbLo;
 }
 
 /**
  */   
 void sdrSetPbHi(SdrLib *sdr, float pbHi)
 {
-    Ddc *ddc = sdr->ddc;
+    Ddc *ddc = sdr->rx->ddc;
     sdrSetDdcFreqs(sdr, ddc->vfo, ddc->pbLo, pbHi);
 }
 
@@ -264,14 +791,14 @@ void sdrSetPbHi(SdrLib *sdr, float pbHi)
  */   
 float sdrGetPbHi(SdrLib *sdr)
 {
-    return sdr->ddc->pbHi;
+    return sdr->rx->ddc->pbHi;
 }
 
 /**
  */   
 float sdrGetSampleRate(SdrLib *sdr)
 {
-    Device *d = sdr->device;
+    Device *d = sdr->rx->device;
     return (d) ? d->getSampleRate(d->ctx) : 0.0;
 }
 
@@ -281,8 +808,11 @@ float sdrGetSampleRate(SdrLib *sdr)
  */   
 int sdrSetSampleRate(SdrLib *sdr, float rate)
 {
-    Device *d = sdr->device;
-    return (d) ? d->setSampleRate(d->ctx, rate) : 0;
+    Device *d = sdr->rx->device;
+    if (!d || !d->setSampleRate(d->ctx, rate))
+        return FALSE;
+    sdrInRateChanged(sdr->rx);
+    return TRUE;
 }
 
 
@@ -291,7 +821,7 @@ int sdrSetSampleRate(SdrLib *sdr, float rate)
  */   
 float sdrGetRfGain(SdrLib *sdr)
 {
-    Device *d = sdr->device;
+    Device *d = sdr->rx->device;
     return (d) ? d->getGain(d->ctx) : 0.0;
 }
 
@@ -301,7 +831,7 @@ float sdrGetRfGain(SdrLib *sdr)
  */   
 int sdrSetRfGain(SdrLib *sdr, float gain)
 {
-    Device *d = sdr->device;
+    Device *d = sdr->rx->device;
     return (d) ? d->setGain(d->ctx, gain) : 0;
 }
 
@@ -331,7 +861,7 @@ int sdrSetAfGain(SdrLib *sdr, float gain)
  */   
 int sdrGetMode(SdrLib *sdr)
 {
-    return sdr->mode;
+    return sdr->rx->mode;
 }
 
 
@@ -342,29 +872,392 @@ int sdrGetMode(SdrLib *sdr)
  */   
 int sdrSetMode(SdrLib *sdr, Mode mode)
 {
-    int ret = TRUE;
-    switch (mode)
+    Receiver *rx = sdr->rx;
+    if (mode < MODE_NULL || mode > MODE_FSK)
+        {
+        error("Unhandled mode: %d", mode);
+        return FALSE;
+        }
+    rx->mode = mode;
+    sdrDemodChanged(rx);
+    sdrStagesChanged(rx);
+    sdrUpdateOutputs(sdr);
+    return TRUE;
+}
+
+
+/**
+ */   
+void sdrSetDeemphasis(SdrLib *sdr, float seconds)
+{
+    stereoSetDeemphasis(sdr->rx->stereo, seconds);
+}
+
+
+/**
+ */   
+void sdrSetSamSideband(SdrLib *sdr, Sideband sideband)
+{
+    sdr->rx->samSideband = sideband;
+    sdrDemodChanged(sdr->rx);
+}
+
+
+/**
+ */   
+void sdrSetCw(SdrLib *sdr, float bfo, float width)
+{
+    sdr->rx->cwBfo   = bfo;
+    sdr->rx->cwWidth = width;
+    sdrDemodChanged(sdr->rx);
+}
+
+
+/**
+ */   
+void sdrSetFsk(SdrLib *sdr, float shift, float baud)
+{
+    sdr->rx->fskShift = shift;
+    sdr->rx->fskBaud  = baud;
+    sdrDemodChanged(sdr->rx);
+}
+
+
+/**
+ */   
+void sdrSetSquelch(SdrLib *sdr, int enabled)
+{
+    sdr->rx->squelchEnabled = enabled;
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+void sdrSetSquelchLevels(SdrLib *sdr, float powerLevel, float quieting)
+{
+    squelchSetLevels(sdr->rx->squelch, powerLevel, quieting);
+}
+
+
+/**
+ */   
+int sdrGetSquelchOpen(SdrLib *sdr)
+{
+    Receiver *rx = sdr->rx;
+    return !rx->squelchEnabled || squelchIsOpen(rx->squelch);
+}
+
+
+/**
+ */   
+void sdrSetAgc(SdrLib *sdr, int enabled)
+{
+    sdr->rx->agcEnabled = enabled;
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+void sdrSetAgcTimes(SdrLib *sdr, float attack, float hang, float decay)
+{
+    agcSetTimes(sdr->rx->agc, attack, hang, decay);
+    agcSetTimes(sdr->rx->agcStereo, attack, hang, decay);
+}
+
+
+/**
+ */   
+void sdrSetAgcLookahead(SdrLib *sdr, float seconds)
+{
+    sdr->rx->agcLookahead = (seconds > 0.0) ? seconds : 0.0;
+    sdrStagesChanged(sdr->rx);
+}
+
+
+/**
+ */   
+void sdrSetLatency(SdrLib *sdr, float seconds)
+{
+    sdr->rx->latency = (seconds > 0.0) ? seconds : 0.0;
+    sdrStagesChanged(sdr->rx);
+    sdrDemodChanged(sdr->rx);
+}
+
+
+/**
+ */   
+float sdrGetLatency(SdrLib *sdr)
+{
+    return sdr->rx->latency;
+}
+
+
+/**
+ */   
+int sdrGetAudioChannels(SdrLib *sdr)
+{
+    return (sdr->rx->mode == MODE_WFM) ? 2 : 1;
+}
+
+
+/**
+ */   
+int sdrGetStereo(SdrLib *sdr)
+{
+    Receiver *rx = sdr->rx;
+    return rx->mode == MODE_WFM && stereoIsLocked(rx->stereo);
+}
+
+
+/**
+ * The device's rate, or the frontend's stages, have changed.  The chain
+ * is told on the reader's thread, as for any other change of rate.
+ */
+static void sdrInRateChanged(Receiver *rx)
+{
+    rx->inRatePending = TRUE;
+    sdrStagesChanged(rx);
+    sdrDemodChanged(rx);
+}
+
+
+/**
+ * Set the number of fixed-point decimation stages for raw devices
+ * @param sdrlib an SDRLib instance.
+ * @param stages 0 - 4.  0 means no decimation
+ */   
+int sdrSetFrontendStages(SdrLib *sdr, int stages)
+{
+    if (stages < 0 || stages > FRONTEND_MAX_STAGES)
+        {
+        error("Front end stages must be 0 - %d", FRONTEND_MAX_STAGES);
+        return FALSE;
+        }
+    sdr->rx->frontendStages = stages;
+    sdrInRateChanged(sdr->rx);
+    return TRUE;
+}
+
+
+/**
+ * Get the counters of the open device
+ * @param sdrlib an SDRLib instance.
+ * @param stats filled in with the current values
+ */   
+int sdrGetDeviceStats(SdrLib *sdr, DeviceStats *stats)
+{
+    memset(stats, 0, sizeof(DeviceStats));
+    Device *d = sdr->rx->device;
+    if (!d)
+        return FALSE;
+    if (d->getStats)
+        d->getStats(d->ctx, stats);
+    stats->gaps = sdr->rx->gaps;
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrGetStats(SdrLib *sdr, SdrStats *stats)
+{
+    Receiver *rx = sdr->rx;
+    memset(stats, 0, sizeof(SdrStats));
+    stats->device  = rx->index;
+    stats->running = rx->running;
+    if (rx->device)
+        stats->elapsed = sdrNow() - rx->statsStarted;
+    sdrGetDeviceStats(sdr, &(stats->deviceStats));
+    Audio *audio = sdr->audio;
+    if (audio)
+        {
+        audioGetQueue(audio, &(stats->audioQueued), &(stats->audioQueueSize));
+        stats->audioOverflows  = audio->overflows;
+        stats->audioUnderflows = audio->underflows;
+        }
+    blockCount(&(stats->blocksTotal), &(stats->blocksInUse));
+    Node *audioNode = (rx->mode == MODE_WFM) ? rx->audioStereoNode : rx->audioNode;
+    if (audioNode->latency)
+        histogramGetStats(audioNode->latency, &(stats->audioLatency));
+    if (rx->codecOutNode->latency)
+        histogramGetStats(rx->codecOutNode->latency, &(stats->codecLatency));
+    stats->stageCount = graphGetStats(rx->graph, stats->stages, SDR_MAX_STAGES);
+    return TRUE;
+}
+
+
+/**
+ * Append to a string being built in buf
+ * @return the new length, or -1 if it does not fit.  -1 is passed on.
+ */
+static int sdrAppend(char *buf, int len, int pos, char *fmt, ...)
+{
+    if (pos < 0)
+        return -1;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + pos, len - pos, fmt, args);
+    va_end(args);
+    return (n < 0 || n >= len - pos) ? -1 : pos + n;
+}
+
+
+static int sdrAppendLatency(char *buf, int len, int pos, char *name, LatencyStats *lat)
+{
+    return sdrAppend(buf, len, pos,
+        "\"%s\":{\"count\":%llu,\"min\":%.3f,\"mean\":%.3f,\"p50\":%.3f,"
+        "\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+        name, lat->count, lat->min, lat->mean, lat->p50, lat->p90, lat->p99, lat->max);
+}
+
+
+/**
+ * Times are also given per input sample, and as the fraction of real
+ * time the stage takes, which is the figure to watch for a bottleneck.
+ * Latencies are in ms.
+ */   
+int sdrGetStatsJson(SdrLib *sdr, char *buf, int len)
+{
+    SdrStats st;
+    sdrGetStats(sdr, &st);
+    DeviceStats *d = &(st.deviceStats);
+    int pos = sdrAppend(buf, len, 0,
+        "{\"device\":%d,\"running\":%s,\"elapsed\":%.3f,"
+        "\"transfers\":%llu,\"samples\":%llu,\"drops\":%llu,\"droppedSamples\":%llu,"
+        "\"ringSize\":%d,\"ringMaxFill\":%d,\"gaps\":%llu,"
+        "\"audioQueued\":%d,\"audioQueueSize\":%d,"
+        "\"audioOverflows\":%llu,\"audioUnderflows\":%llu,"
+        "\"blocksTotal\":%d,\"blocksInUse\":%d,",
+        st.device, st.running ? "true" : "false", st.elapsed,
+        d->transfers, d->samples, d->drops, d->droppedSamples,
+        d->ringSize, d->maxFill, d->gaps,
+        st.audioQueued, st.audioQueueSize, st.audioOverflows, st.audioUnderflows,
+        st.blocksTotal, st.blocksInUse);
+    pos = sdrAppendLatency(buf, len, pos, "audioLatency", &(st.audioLatency));
+    pos = sdrAppendLatency(buf, len, pos, "codecLatency", &(st.codecLatency));
+    pos = sdrAppend(buf, len, pos, "\"stages\":[");
+    for (int i = 0 ; i < st.stageCount ; i++)
+        {
+        StageStats *s = &(st.stages[i]);
+        double perSample = (s->samplesIn) ? (double)s->nanos / (double)s->samplesIn : 0.0;
+        double load = (st.elapsed > 0.0) ? (double)s->nanos * 1.0e-9 / st.elapsed : 0.0;
+        pos = sdrAppend(buf, len, pos,
+            "%s{\"name\":\"%s\",\"calls\":%llu,\"samplesIn\":%llu,\"samplesOut\":%llu,"
+            "\"dropped\":%llu,\"nanos\":%llu,\"nanosPerSample\":%.3f,\"load\":%.5f}",
+            (i > 0) ? "," : "", s->name, s->calls, s->samplesIn, s->samplesOut,
+            s->dropped, s->nanos, perSample, load);
+        }
+    return sdrAppend(buf, len, pos, "]}");
+}
+
+
+/**
+ */   
+void sdrResetStats(SdrLib *sdr)
+{
+    Receiver *rx = sdr->rx;
+    //the reader updates the counters as it goes, so it zeroes them
+    if (rx->running)
         {
-        case MODE_NULL:
-            sdr->demod = sdr->demodNull;
-            break;
-        case MODE_AM:
-            sdr->demod = sdr->demodAm;
-            break;
-        case MODE_FM:
-            sdr->demod = sdr->demodFm;
-            break;
-        case MODE_LSB:
-            sdr->demod = sdr->demodLsb;
-            break;
-        case MODE_USB:
-            sdr->demod = sdr->demodUsb;
-            break;
-        default:
-            error("Unhandled mode: %d", mode);
-            ret = FALSE;
+        rx->statsResetPending = TRUE;
+        return;
         }
-    return ret;
+    graphResetStats(rx->graph);
+    rx->statsStarted = sdrNow();
+}
+
+
+/**
+ * Retune for the sweep.  The device's count of samples delivered
+ * tells which samples were taken before the change.
+ */
+static unsigned long long sdrSweepTune(double freq, unsigned long long *time, void *ctx)
+{
+    Receiver *rx = (Receiver *)ctx;
+    Device *d = rx->device;
+    if (!d)
+        return rx->nextSeq;
+    d->setCenterFrequency(d->ctx, freq);
+    *time = sdrNanos();
+    DeviceStats stats;
+    if (d->getStats && d->getStats(d->ctx, &stats))
+        return stats.samples;
+    return rx->nextSeq;
+}
+
+
+/**
+ * Sweep the selected device across a range of frequencies
+ * @param sdrlib an SDRLib instance.
+ * @param loFreq start of the range, in Hz
+ * @param hiFreq end of the range, in Hz
+ */   
+int sdrStartSweep(SdrLib *sdr, double loFreq, double hiFreq)
+{
+    Receiver *rx = sdr->rx;
+    Device *d = rx->device;
+    if (!d)
+        {
+        error("Device not started");
+        return FALSE;
+        }
+    if (!rx->sweeping)
+        rx->sweepCenter = d->getCenterFrequency(d->ctx);
+    float rate = d->getSampleRate(d->ctx);
+    int size = sweepStart(rx->sweep, loFreq, hiFreq, rate);
+    if (!size)
+        {
+        error("Invalid sweep range: %f - %f", loFreq, hiFreq);
+        return FALSE;
+        }
+    if (!rx->sweeping && d->setBlockSize)
+        d->setBlockSize(d->ctx, SWEEP_BLOCK_SIZE);
+    rx->sweeping     = TRUE;
+    rx->sweepStarted = sdrNow();
+    trace("sweep %f - %f: %d steps, %d bins per line, %f Hz per bin",
+        loFreq, hiFreq, rx->sweep->steps, size, rate / SWEEP_FFT_SIZE);
+    return TRUE;
+}
+
+
+/**
+ * Stop sweeping, and go back to the frequency tuned before
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrStopSweep(SdrLib *sdr)
+{
+    Receiver *rx = sdr->rx;
+    if (!rx->sweeping)
+        return TRUE;
+    sweepStop(rx->sweep);
+    rx->sweeping = FALSE;
+    double elapsed = sdrNow() - rx->sweepStarted;
+    trace("sweep: %llu lines in %.3f s, %.3f lines/s", rx->sweep->lines,
+        elapsed, (elapsed > 0.0) ? (double)rx->sweep->lines / elapsed : 0.0);
+    Device *d = rx->device;
+    if (d)
+        {
+        if (d->setBlockSize)
+            d->setBlockSize(d->ctx, 0);
+        d->setCenterFrequency(d->ctx, rx->sweepCenter);
+        }
+    //the filters last saw some other frequency
+    rx->resetPending = TRUE;
+    return TRUE;
+}
+
+
+/**
+ * Set how long the sweep stays at each step
+ * @param sdrlib an SDRLib instance.
+ * @param average number of ffts averaged at each step
+ * @param settleTime seconds to wait for the tuner after retuning
+ */   
+void sdrSetSweepDwell(SdrLib *sdr, int average, float settleTime)
+{
+    sweepSetDwell(sdr->rx->sweep, average, settleTime);
 }
 
 
@@ -376,6 +1269,47 @@ int sdrSetMode(SdrLib *sdr, Mode mode)
 void sdrEnableAudio(SdrLib *sdr, int enabled)
 {
     sdr->audioEnabled = enabled;   
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+void sdrSetAudioOutput(SdrLib *sdr, void *context, FloatOutputFunc *func)
+{
+    sdr->audioContext = context;
+    sdr->audioFunc    = func;
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+void sdrSetRdsOutput(SdrLib *sdr, void *context, RdsOutputFunc *func)
+{
+    sdr->rdsContext = context;
+    sdr->rdsFunc    = func;
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+void sdrSetKeyOutput(SdrLib *sdr, void *context, KeyOutputFunc *func)
+{
+    sdr->keyContext = context;
+    sdr->keyFunc    = func;
+    sdrUpdateOutputs(sdr);
+}
+
+
+/**
+ */   
+int sdrGetRds(SdrLib *sdr, RdsInfo *info)
+{
+    Receiver *rx = sdr->rx;
+    rdsGetInfo(rx->rds, info);
+    return rx->mode == MODE_WFM;
 }
 
 
@@ -389,66 +1323,229 @@ void sdrEnableAudio(SdrLib *sdr, int enabled)
 
 #define READSIZE (8 * 16384)
 
-static void fftOutput(unsigned int *vals, int size, void *ctx)
+/**
+ * How long the reader sleeps in readWait() before checking
+ * whether it has been asked to stop
+ */
+#define READ_TIMEOUT_MS 100
+
+/**
+ * A receiver's own outputs always get its data.  The outputs given
+ * to sdrCreate(), and the speaker, get the data of the selected receiver.
+ * Stages with nobody to take their output are disabled, as is whichever
+ * of the mono and stereo branches the mode does not use.
+ */
+static void sdrUpdateOutputs(SdrLib *sdr)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    UintOutputFunc *psFunc = sdr->psFunc;
-    if (psFunc)
-        (*psFunc)(vals, size, sdr->context);
+    for (int i = 0 ; i < SDR_MAX_DEVICES ; i++)
+        {
+        Receiver *rx = sdr->receivers[i];
+        if (!rx)
+            continue;
+        int selected = (rx == sdr->rx);
+        UintOutputFunc *psFunc = rx->psFunc;
+        ByteOutputFunc *codecFunc = rx->codecFunc;
+        void *psContext = rx->context;
+        void *codecContext = rx->context;
+        if (!psFunc && selected)
+            {
+            psFunc    = sdr->psFunc;
+            psContext = sdr->context;
+            }
+        if (!codecFunc && selected)
+            {
+            codecFunc    = sdr->codecFunc;
+            codecContext = sdr->context;
+            }
+        callbackNodeSet(rx->psNode, psFunc, psContext);
+        callbackNodeSet(rx->codecOutNode, codecFunc, codecContext);
+        FloatOutputFunc *audioFunc = selected ? sdr->audioFunc : NULL;
+        callbackNodeSet(rx->audioOutNode, audioFunc, sdr->audioContext);
+        callbackNodeSet(rx->audioOutStereoNode, audioFunc, sdr->audioContext);
+        callbackNodeSet(rx->rdsNode, selected ? sdr->rdsFunc : NULL, sdr->rdsContext);
+        KeyOutputFunc *keyFunc = selected ? sdr->keyFunc : NULL;
+        if (keyFunc != rx->keyFunc || sdr->keyContext != rx->keyContext)
+            {
+            rx->keyFunc    = keyFunc;
+            rx->keyContext = sdr->keyContext;
+            sdrDemodChanged(rx);
+            }
+        int speaker = selected && sdr->audioEnabled && sdr->audio;
+        int stereo  = (rx->mode == MODE_WFM);
+        int agc     = rx->agcEnabled;
+        nodeSetEnabled(rx->fftNode, psFunc != NULL);
+        nodeSetEnabled(rx->fftBytesNode, psFunc != NULL);
+        nodeSetEnabled(rx->squelchNode, rx->squelchEnabled);
+        nodeSetEnabled(rx->agcNode, !stereo && agc);
+        nodeSetEnabled(rx->resamplerNode, !stereo);
+        nodeSetEnabled(rx->codecNode, !stereo && codecFunc != NULL);
+        nodeSetEnabled(rx->audioNode, !stereo && speaker);
+        nodeSetEnabled(rx->audioOutNode, !stereo && audioFunc);
+        nodeSetEnabled(rx->stereoNode, stereo);
+        nodeSetEnabled(rx->agcStereoNode, stereo && agc);
+        nodeSetEnabled(rx->resamplerStereoNode, stereo);
+        nodeSetEnabled(rx->codecStereoNode, stereo && codecFunc != NULL);
+        nodeSetEnabled(rx->audioStereoNode, stereo && speaker);
+        nodeSetEnabled(rx->audioOutStereoNode, stereo && audioFunc);
+        nodeSetEnabled(rx->rdsNode, stereo);
+        }
 }
 
+/**
+ * Start the chain over, since the next samples do not follow
+ * on from the last ones
+ */
+static void sdrResetChain(Receiver *rx)
+{
+    frontendReset(rx->frontend);
+    ddcReset(rx->ddc);
+    demodReset(rx->demod);
+    squelchReset(rx->squelch);
+    agcReset(rx->agc);
+    agcReset(rx->agcStereo);
+    stereoReset(rx->stereo);
+    rdsReset(rx->rds);
+}
 
-static void resamplerOutput(float *buf, int size, void *ctx)
+/**
+ * While sweeping, the sweep gets all the samples.  'stamp' is the
+ * capture time of the first sample, or 0 if the device does not tell.
+ */
+static void sdrProcess(Receiver *rx, float complex *data, int size,
+                       unsigned long long seq, unsigned long long stamp)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Push audio:%d", size);
-    if (sdr->audioEnabled)
-        audioPlay(sdr->audio, buf, size);
-    if (sdr->codecFunc)
-        codecEncode(sdr->codec, buf, size, sdr->codecFunc, sdr->context);
+    if (rx->sweeping && sweepUpdate(rx->sweep, data, size, seq, stamp, nodeUintInput, rx->psNode))
+        return;
+    //the best we can tell of when these were captured
+    if (!stamp)
+        stamp = sdrNanos();
+    nodeInputTimed(rx->fftNode, data, size, stamp);
+    nodeInputTimed(rx->ddcNode, data, size, stamp);
 }
 
+/**
+ * Raw bytes are only expanded to float for the samples the fft
+ * uses, and after the front end has reduced the rate for the ddc
+ */
+static void sdrProcessBytes(Receiver *rx, unsigned char *data, int size,
+                            unsigned long long seq, unsigned long long stamp)
+{
+    if (rx->sweeping && sweepUpdateBytes(rx->sweep, data, size, seq, stamp, nodeUintInput, rx->psNode))
+        return;
+    if (!stamp)
+        stamp = sdrNanos();
+    nodeInputTimed(rx->fftBytesNode, data, size, stamp);
+    nodeInputTimed(rx->frontendNode, data, size, stamp);
+}
 
-static void demodOutput(float *buf, int size, void *ctx)
+/**
+ * Samples were lost between the last block and this one.  Filters and
+ * demodulators would otherwise run across the discontinuity, so
+ * start them fresh.
+ */
+static void sdrGap(Receiver *rx, DeviceBlock *block)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Demod:%d", size);
-    resamplerUpdate(sdr->resampler, buf, size, resamplerOutput, sdr);
+    rx->gaps++;
+    trace("device %d lost %llu samples", rx->index, block->seq - rx->nextSeq);
+    sdrResetChain(rx);
 }
 
-static void ddcOutput(float complex *data, int size, void *ctx)
+/**
+ * Wait for the device to have more data.  Devices without readWait()
+ * can only be polled.
+ */
+static void sdrWaitForData(Device *dev)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Ddc:%d", size);
-    sdr->demod->update(sdr->demod, data, size, demodOutput, sdr);
+    if (dev->readWait)
+        dev->readWait(dev->ctx, READ_TIMEOUT_MS);
+    else
+        sched_yield();
 }
 
+/**
+ * Devices that support readPeek() let us work on their own
+ * buffers directly.  Others need to copy into ours.
+ */
 static void *sdrReaderThread(void *ctx)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    Device *dev = sdr->device;
-    
-    int bufsize = 1024*1024;
-    float complex *readbuf = (float complex *)malloc(bufsize * sizeof(float complex));
+    Receiver *rx = (Receiver *)ctx;
+    Device *dev = rx->device;
+    double startTime = sdrNow();
+    unsigned long long processed = 0;
     
-    sdr->running = 1;
+    int bufsize = 0;
+    float complex *readbuf = NULL;
+    if (!dev->readPeek)
+        {
+        bufsize = 1024*1024;
+        readbuf = (float complex *)malloc(bufsize * sizeof(float complex));
+        if (!readbuf)
+            {
+            error("device %d reader: could not allocate the read buffer", rx->index);
+            rx->running = 0;
+            return NULL;
+            }
+        }
     
-    while (sdr->running && dev->isOpen(dev->ctx))
+    while (!rx->stopRequested && dev->isOpen(dev->ctx))
         {
-        int readCount = dev->read(dev->ctx, readbuf, bufsize);
-        if (readCount)
+        if (rx->stagesPending)
+            sdrUpdateStages(rx);
+        if (rx->demodPending)
+            sdrUpdateDemod(rx);
+        if (rx->statsResetPending)
+            {
+            rx->statsResetPending = FALSE;
+            graphResetStats(rx->graph);
+            rx->statsStarted = sdrNow();
+            }
+        if (readbuf)
             {
-            fftUpdate(sdr->fft, readbuf, readCount, fftOutput, sdr);
-            ddcUpdate(sdr->ddc, readbuf, readCount, ddcOutput, sdr);
+            int readCount = dev->read(dev->ctx, readbuf, bufsize);
+            if (readCount)
+                {
+                if (rx->resetPending)
+                    {
+                    rx->resetPending = FALSE;
+                    sdrResetChain(rx);
+                    }
+                sdrProcess(rx, readbuf, readCount, rx->nextSeq, 0);
+                rx->nextSeq += readCount;
+                processed += readCount;
+                }
+            else
+                sdrWaitForData(dev);
             }
         else
             {
-            sched_yield();
+            DeviceBlock block;
+            if (dev->readPeek(dev->ctx, &block))
+                {
+                if (block.seq != rx->nextSeq)
+                    sdrGap(rx, &block);
+                else if (rx->resetPending)
+                    sdrResetChain(rx);
+                rx->resetPending = FALSE;
+                rx->nextSeq = block.seq + block.size;
+                if (block.bytes)
+                    sdrProcessBytes(rx, block.bytes, block.size, block.seq, block.time);
+                else
+                    sdrProcess(rx, block.data, block.size, block.seq, block.time);
+                processed += block.size;
+                dev->readRelease(dev->ctx);
+                }
+            else
+                sdrWaitForData(dev);
             }
         }
 
     free(readbuf);
-    sdr->running = 0;
+    //with a file device playing as fast as it can, this is the throughput
+    double elapsed = sdrNow() - startTime;
+    if (elapsed > 0.0)
+        trace("device %d reader: %llu samples in %.3f s, %.3f Msamples/s",
+            rx->index, processed, elapsed, (double)processed / elapsed / 1.0e6);
+    rx->running = 0;
     return NULL;
 }
 
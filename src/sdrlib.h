@@ -47,11 +47,17 @@ typedef void FloatOutputFunc(float *data, int size, void *ctx);
 
 #define SDR_MAX_DEVICES 30
 
+/**
+ * Rate of the demodulated audio, in samples/second
+ */
+#define SDR_AUDIO_RATE 44100.0
+
 
 
 /**
  * Forward declarations, hidden from clients
  */
+typedef struct Agc         Agc;
 typedef struct Audio       Audio; 
 typedef struct Biquad      Biquad;
 typedef struct Codec       Codec; 
@@ -61,22 +67,146 @@ typedef struct Demodulator Demodulator;
 typedef struct Device      Device; 
 typedef struct Fir         Fir; 
 typedef struct Fft         Fft; 
+typedef struct Frontend    Frontend; 
 typedef struct Resampler   Resampler;
+typedef struct Stereo      Stereo;
 typedef struct Queue       Queue; 
+typedef struct Rds         Rds;
+typedef struct Squelch     Squelch;
 typedef struct Vfo         Vfo; 
 
 typedef struct SdrLib      SdrLib;
 
+/**
+ * Counters kept while a device is open.  Most are maintained by the
+ * device itself, and are zero for devices that do not keep them.
+ */
+typedef struct
+{
+    unsigned long long transfers;      //blocks delivered by the hardware
+    unsigned long long samples;        //complex samples delivered, including dropped ones
+    unsigned long long drops;          //blocks dropped because the ring buffer was full
+    unsigned long long droppedSamples; //complex samples in those blocks
+    int                ringSize;       //number of slots in the ring buffer
+    int                maxFill;        //most slots ever in use at once
+    unsigned long long gaps;           //discontinuities seen by the reader.  Kept by sdrlib
+} DeviceStats;
+
+
+/**
+ * Counters kept by each stage of a processing chain.  Each is only written
+ * by the reader thread of its device, so keeping them needs no locking.
+ */
+typedef struct
+{
+    char               name[16];
+    unsigned long long calls;      //times the stage has processed input
+    unsigned long long samplesIn;
+    unsigned long long samplesOut;
+    unsigned long long dropped;    //input samples discarded while the stage was disabled
+    unsigned long long nanos;      //time spent in the stage, not counting the stages after it
+} StageStats;
+
+
+#define SDR_MAX_STAGES 32
+
+
+/**
+ * What has been received by RDS from a broadcast FM station
+ */
+typedef struct
+{
+    int  pi;      //program identification code, or -1 if none yet
+    char ps[9];   //program service name, 8 characters.  Empty if none yet
+    char rt[65];  //radiotext.  Empty if none yet
+} RdsInfo;
+
+/**
+ * Which parts of an RdsInfo have changed
+ */
+typedef enum
+{
+    RDS_PI = 1,
+    RDS_PS = 2,
+    RDS_RT = 4
+} RdsField;
+
+/**
+ * @param changed a mask of RdsField
+ */
+typedef void RdsOutputFunc(RdsInfo *info, int changed, void *ctx);
+
+/**
+ * Called when the Morse key detected in MODE_CW goes down or up
+ * @param down true if the tone has started, false if it has stopped
+ * @param seconds how long the key was in the state it has left
+ */
+typedef void KeyOutputFunc(int down, float seconds, void *ctx);
+
+
+/**
+ * Summary of the latency seen at an output, from the capture of
+ * the samples by the device.  In milliseconds.
+ */
+typedef struct
+{
+    unsigned long long count; //blocks measured
+    double             min;
+    double             mean;
+    double             p50;
+    double             p90;
+    double             p99;
+    double             max;
+} LatencyStats;
+
+
+/**
+ * Everything known about how a device's processing is keeping up
+ */
+typedef struct
+{
+    int                device;         //index of the device
+    int                running;        //true if its reader thread is running
+    double             elapsed;        //seconds the stage counters cover
+    DeviceStats        deviceStats;
+    int                audioQueued;    //blocks waiting for the speaker.  Shared by all devices
+    int                audioQueueSize;
+    unsigned long long audioOverflows; //writes of audio dropped because the speaker was behind
+    unsigned long long audioUnderflows;//times the speaker had nothing to play
+    int                blocksTotal;    //sample blocks in the pool.  Shared by all devices
+    int                blocksInUse;
+    LatencyStats       audioLatency;   //to the speaker, through its queue
+    LatencyStats       codecLatency;   //to the encoded output, such as a websocket
+    int                stageCount;
+    StageStats         stages[SDR_MAX_STAGES];
+} SdrStats;
+
+
 typedef enum
 {
     MODE_NULL=0,
     MODE_AM,
     MODE_FM,
     MODE_LSB,
-    MODE_USB
+    MODE_USB,
+    MODE_WFM,    //broadcast FM, in stereo.  Needs a passband of about +-150 kHz
+    MODE_SAM,    //synchronous AM
+    MODE_CW,     //Morse.  The carrier at the vfo is heard as the BFO tone
+    MODE_FSK     //two tones either side of the vfo, given as a soft bit
 } Mode;
 
 
+/**
+ * Which sidebands of synchronous AM to hear
+ */
+typedef enum
+{
+    SIDEBAND_BOTH=0,
+    SIDEBAND_LOWER,
+    SIDEBAND_UPPER
+} Sideband;
+
+
 
 /**
  * Create a new SdrLib instance.
@@ -103,11 +233,73 @@ int sdrStart(SdrLib *sdrlib);
 
 
 /**
- * Stop sdrlib processing
+ * Stop sdrlib processing, on all devices
  * @param sdrlib an SDRLib instance.
  */   
 int sdrStop(SdrLib *sdrlib);
 
+
+/**
+ * Get the number of devices found
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrGetDeviceCount(SdrLib *sdrlib);
+
+
+/**
+ * Get the name of a device
+ * @param sdrlib an SDRLib instance.
+ * @param index 0 .. sdrGetDeviceCount()-1
+ * @return the name, or NULL if there is no such device
+ */   
+char *sdrGetDeviceName(SdrLib *sdrlib, int index);
+
+
+/**
+ * Start capturing from one device, with its own reader thread and
+ * processing chain.  Several devices can run at once.
+ * @param sdrlib an SDRLib instance.
+ * @param index 0 .. sdrGetDeviceCount()-1
+ * @param cpu the core to pin the reader thread to, or -1 for none.
+ *     Only supported on Linux
+ */   
+int sdrStartDevice(SdrLib *sdrlib, int index, int cpu);
+
+
+/**
+ * Stop capturing from one device
+ * @param sdrlib an SDRLib instance.
+ * @param index 0 .. sdrGetDeviceCount()-1
+ */   
+int sdrStopDevice(SdrLib *sdrlib, int index);
+
+
+/**
+ * Select the device that the other sdrGet/sdrSet calls, and sdrStart(),
+ * apply to.  The outputs given to sdrCreate(), and the speaker, get
+ * the data of the selected device.  Device 0 is selected at first.
+ * @param sdrlib an SDRLib instance.
+ * @param index 0 .. sdrGetDeviceCount()-1
+ */   
+int sdrSelectDevice(SdrLib *sdrlib, int index);
+
+
+/**
+ * Get the index of the selected device
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrGetSelectedDevice(SdrLib *sdrlib);
+
+
+/**
+ * Give a device outputs of its own, which get its data whether it
+ * is selected or not.  Pass NULLs to go back to the shared outputs.
+ * @param sdrlib an SDRLib instance.
+ * @param index 0 .. sdrGetDeviceCount()-1
+ */   
+int sdrSetDeviceOutput(SdrLib *sdrlib, int index, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc);
+
 /**
  * Get the current center frequency
  * @param sdrlib an SDRLib instance.
@@ -208,6 +400,202 @@ int sdrGetMode(SdrLib *sdrlib);
  */   
 int sdrSetMode(SdrLib *sdrlib, Mode mode);
 
+/**
+ * Set the de-emphasis of MODE_WFM
+ * @param sdrlib an SDRLib instance.
+ * @param seconds the time constant: 75e-6 in the Americas, 50e-6 elsewhere.
+ *     0 for none
+ */   
+void sdrSetDeemphasis(SdrLib *sdrlib, float seconds);
+
+/**
+ * Choose the sidebands of MODE_SAM
+ * @param sdrlib an SDRLib instance.
+ * @param sideband one of them, or both
+ */   
+void sdrSetSamSideband(SdrLib *sdrlib, Sideband sideband);
+
+/**
+ * Set the tone of MODE_CW and the width of its filter.  The passband
+ * only sets the rate the filter runs at, so it has to reach past
+ * bfo + width/2 on one side of the vfo, or the tone is lowered to fit.
+ * @param sdrlib an SDRLib instance.
+ * @param bfo the tone heard for the carrier, in Hz.  Default 700
+ * @param width of the filter around the carrier, in Hz.  Default 500
+ */   
+void sdrSetCw(SdrLib *sdrlib, float bfo, float width);
+
+/**
+ * Set the tones and rate of MODE_FSK.  The output is +1 for mark, the
+ * upper tone, and -1 for space, averaged over a symbol.
+ * @param sdrlib an SDRLib instance.
+ * @param shift between the tones, in Hz.  Default 170
+ * @param baud symbols per second.  Default 45.45
+ */   
+void sdrSetFsk(SdrLib *sdrlib, float shift, float baud);
+
+/**
+ * Pass on the audio only while there is a signal.  While it is closed,
+ * the stages after the demodulator do no work, the codec sends small
+ * packets of silence, and nothing is played.  FM and WFM go by the
+ * noise above the audio, the other modes by the level.  Off at first.
+ * @param sdrlib an SDRLib instance.
+ * @param enabled true to squelch
+ */   
+void sdrSetSquelch(SdrLib *sdrlib, int enabled);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @param powerLevel dB against full scale of the demodulated audio,
+ *     above which AM and SSB open.  -50 at first
+ * @param quieting dB below the noise of no signal that the FM noise has
+ *     to fall, to open.  10 at first
+ */   
+void sdrSetSquelchLevels(SdrLib *sdrlib, float powerLevel, float quieting);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @return true if the audio is being passed on, which it always is
+ *     with the squelch off
+ */   
+int sdrGetSquelchOpen(SdrLib *sdrlib);
+
+/**
+ * Level the audio, so that all modes give about the same level.  Both
+ * channels of stereo are given the same gain.  On at first.
+ * @param sdrlib an SDRLib instance.
+ * @param enabled true to level the audio
+ */   
+void sdrSetAgc(SdrLib *sdrlib, int enabled);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @param attack time constant of a rise in level, in seconds
+ * @param hang how long the gain is held after a peak, in seconds
+ * @param decay time constant of a fall in level, once the hang is over
+ */   
+void sdrSetAgcTimes(SdrLib *sdrlib, float attack, float hang, float decay);
+
+/**
+ * Delay the audio behind the AGC, so that the gain is down before a
+ * peak arrives.  This adds the same to the latency.
+ * @param sdrlib an SDRLib instance.
+ * @param seconds 0 for none, which is the default
+ */   
+void sdrSetAgcLookahead(SdrLib *sdrlib, float seconds);
+
+/**
+ * Trade throughput for latency.  Each stage from the ddc to the
+ * resampler passes on a block once it holds this much audio, rather
+ * than once it has filled a pool block, which at an IF of 10 kHz takes
+ * 1.6 seconds.  Smaller blocks cost more per sample.
+ * @param sdrlib an SDRLib instance.
+ * @param seconds the longest block.  0 for whole pool blocks, which is
+ *     the default
+ */   
+void sdrSetLatency(SdrLib *sdrlib, float seconds);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @return the latency target, in seconds.  0 if there is none
+ */   
+float sdrGetLatency(SdrLib *sdrlib);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @return 2 if the selected device's mode gives stereo audio, else 1
+ */   
+int sdrGetAudioChannels(SdrLib *sdrlib);
+
+/**
+ * @param sdrlib an SDRLib instance.
+ * @return true if the selected device is in MODE_WFM and has found a
+ *     stereo pilot
+ */   
+int sdrGetStereo(SdrLib *sdrlib);
+
+
+/**
+ * Set the number of decimate-by-2 stages run in fixed point on raw
+ * 8-bit samples, before they are expanded to float.  This only has
+ * an effect on devices that can deliver raw samples.  Each stage halves
+ * the bandwidth available to the vfo, so only use this when the
+ * channel is close to the center frequency.
+ * @param sdrlib an SDRLib instance.
+ * @param stages 0 - 4.  0 means no decimation
+ */   
+int sdrSetFrontendStages(SdrLib *sdr, int stages);
+
+
+/**
+ * Get the counters of the open device, to check for overruns
+ * @param sdrlib an SDRLib instance.
+ * @param stats filled in with the current values
+ * @return true if a device is open, else false
+ */   
+int sdrGetDeviceStats(SdrLib *sdr, DeviceStats *stats);
+
+
+/**
+ * Get the counters of the selected device, its processing stages,
+ * and the buffers between them.  Stage times divided by samplesIn give
+ * the cost per sample, to find the stage that is the bottleneck.
+ * @param sdrlib an SDRLib instance.
+ * @param stats filled in with the current values
+ * @return true if successful, else false
+ */   
+int sdrGetStats(SdrLib *sdr, SdrStats *stats);
+
+
+/**
+ * Same as sdrGetStats(), formatted as a JSON object
+ * @param sdrlib an SDRLib instance.
+ * @param buf to hold the string
+ * @param len size of buf
+ * @return the length of the string, or -1 if it did not fit
+ */   
+int sdrGetStatsJson(SdrLib *sdr, char *buf, int len);
+
+
+/**
+ * Zero the stage counters and latency histograms of the selected device.
+ * The device's own counters are not affected.
+ * @param sdrlib an SDRLib instance.
+ */   
+void sdrResetStats(SdrLib *sdr);
+
+
+/**
+ * Sweep the selected device across a range wider than its sample rate.
+ * The middle of the spectrum at each step is stitched into one line,
+ * which is output to the power spectrum function instead of the usual
+ * spectrum.  Bin i of the line is at loFreq + i * sampleRate / 1024.
+ * Demodulation stops while sweeping.
+ * @param sdrlib an SDRLib instance.
+ * @param loFreq start of the range, in Hz
+ * @param hiFreq end of the range, in Hz
+ */   
+int sdrStartSweep(SdrLib *sdr, double loFreq, double hiFreq);
+
+
+/**
+ * Stop sweeping, and go back to the frequency tuned before
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrStopSweep(SdrLib *sdr);
+
+
+/**
+ * Set how long the sweep stays at each step.  Lines/second is best with
+ * the fewest ffts that give a steady enough line, and the shortest
+ * settling time that keeps the tuner's transients out.  Samples the
+ * device had already queued when it was retuned are always skipped.
+ * @param sdrlib an SDRLib instance.
+ * @param average number of ffts averaged at each step.  Default 4
+ * @param settleTime seconds to wait for the tuner after retuning.  Default 0.002
+ */   
+void sdrSetSweepDwell(SdrLib *sdr, int average, float settleTime);
+
 
 /**
  * Determine if we want speaker output
@@ -216,6 +604,39 @@ int sdrSetMode(SdrLib *sdrlib, Mode mode);
  */   
 void sdrEnableAudio(SdrLib *sdr, int enabled);
 
+/**
+ * Receive the demodulated audio of the selected device, at SDR_AUDIO_RATE
+ * and before the AF gain, whether or not it goes to the speaker.  In
+ * stereo modes, the data is left,right pairs, and size is in pairs.
+ * See sdrGetAudioChannels().
+ * @param sdrlib an SDRLib instance.
+ * @param func called from the reader thread.  NULL to stop
+ */   
+void sdrSetAudioOutput(SdrLib *sdr, void *context, FloatOutputFunc *func);
+
+/**
+ * Receive the RDS of the selected device, in MODE_WFM, as it changes
+ * @param sdrlib an SDRLib instance.
+ * @param func called from the reader thread.  NULL to stop
+ */   
+void sdrSetRdsOutput(SdrLib *sdr, void *context, RdsOutputFunc *func);
+
+/**
+ * Follow the Morse key of the selected device, in MODE_CW
+ * @param sdrlib an SDRLib instance.
+ * @param func called from the reader thread.  NULL to stop, which also
+ *     stops the detector
+ */   
+void sdrSetKeyOutput(SdrLib *sdr, void *context, KeyOutputFunc *func);
+
+/**
+ * Copy what RDS has received from the selected device.  It is written
+ * by the reader thread, so a field may be caught as it changes.
+ * @param sdrlib an SDRLib instance.
+ * @return true if the device is in MODE_WFM, else false
+ */   
+int sdrGetRds(SdrLib *sdr, RdsInfo *info);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,242 @@
+/**
+ * Squelch
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "squelch.h"
+#include "private.h"
+
+
+/**
+ * Mean square of the highpassed discriminator output with no signal,
+ * in (radians/sample)^2, as measured.  The ddc output is about as wide
+ * as its rate, so with noise alone the phase steps are spread over the
+ * whole circle, and this hardly depends on the passband.
+ */
+#define NOISE_REF 20.0f
+
+
+
+Squelch *squelchCreate(float inRate)
+{
+    Squelch *obj = (Squelch *)smalloc(sizeof(Squelch));
+    if (!obj)
+        return NULL;
+    memset(obj, 0, sizeof(Squelch));
+    obj->type       = SQUELCH_POWER;
+    obj->powerLevel = SQUELCH_POWER_LEVEL;
+    obj->quieting   = SQUELCH_QUIETING;
+    squelchSetInRate(obj, inRate);
+    return obj;
+}
+
+
+void squelchDelete(Squelch *obj)
+{
+    free(obj);
+}
+
+
+/**
+ * Work out the levels of the measure for the type
+ */
+static void squelchUpdateLevels(Squelch *obj)
+{
+    float hyst = pow(10.0, SQUELCH_HYSTERESIS / 10.0);
+    if (obj->type == SQUELCH_NOISE)
+        {
+        //the noise has to fall to open, and rise again to close
+        obj->openLevel  = NOISE_REF * pow(10.0, -obj->quieting / 10.0);
+        obj->closeLevel = obj->openLevel * hyst;
+        }
+    else
+        {
+        obj->openLevel  = pow(10.0, obj->powerLevel / 10.0);
+        obj->closeLevel = obj->openLevel / hyst;
+        }
+}
+
+
+void squelchSetInRate(Squelch *obj, float inRate)
+{
+    if (inRate <= 0.0 || inRate == obj->inRate)
+        return;
+    obj->inRate = inRate;
+    float stepTime   = (float)SQUELCH_STEP / inRate;
+    obj->coeff       = 1.0 - exp(-stepTime / SQUELCH_TIME);
+    obj->tailSamples = (int)(SQUELCH_TAIL / stepTime + 0.5) * SQUELCH_STEP;
+    squelchReset(obj);
+}
+
+
+void squelchSetType(Squelch *obj, SquelchType type)
+{
+    if (type == obj->type)
+        return;
+    obj->type = type;
+    squelchUpdateLevels(obj);
+    squelchReset(obj);
+}
+
+
+void squelchSetLevels(Squelch *obj, float powerLevel, float quieting)
+{
+    obj->powerLevel = powerLevel;
+    obj->quieting   = quieting;
+    squelchUpdateLevels(obj);
+}
+
+
+/**
+ * The average starts at the closing level, so a signal opens it about
+ * as soon as the average has taken it in
+ */
+void squelchReset(Squelch *obj)
+{
+    squelchUpdateLevels(obj);
+    obj->measure   = obj->closeLevel;
+    obj->prev[0]   = 0.0;
+    obj->prev[1]   = 0.0;
+    obj->tailCount = 0;
+    obj->open      = FALSE;
+}
+
+
+int squelchIsOpen(Squelch *obj)
+{
+    return obj->open;
+}
+
+
+/**
+ * Mean square of one step.  For the noise, the highpass is the second
+ * difference, whose gain goes up as the square of the frequency, like
+ * the discriminator's noise, so the audio below it is mostly left out.
+ */
+static float squelchMeasure(Squelch *obj, float *data, int n)
+{
+    float s0 = 0.0f;
+    float s1 = 0.0f;
+    if (obj->type == SQUELCH_NOISE)
+        {
+        float x1 = obj->prev[0];
+        float x2 = obj->prev[1];
+        for (int i = 0 ; i < n ; i++)
+            {
+            float x = data[i];
+            float d = x - 2.0f * x1 + x2;
+            x2 = x1;
+            x1 = x;
+            s0 += d * d;
+            }
+        obj->prev[0] = x1;
+        obj->prev[1] = x2;
+        }
+    else
+        {
+        //two sums, so that it vectorizes
+        for (int i = 0 ; i + 1 < n ; i += 2)
+            {
+            s0 += data[i]   * data[i];
+            s1 += data[i+1] * data[i+1];
+            }
+        if (n & 1)
+            s0 += data[n-1] * data[n-1];
+        }
+    return (s0 + s1) / (float)n;
+}
+
+
+/**
+ * Move open or closed on by one step of n samples.  The last step of a
+ * block may be short, and its weight in the average is scaled down to
+ * match, so that short blocks do not speed it up.
+ */
+static void squelchStep(Squelch *obj, float *data, int n)
+{
+    float coeff = obj->coeff;
+    if (n != SQUELCH_STEP)
+        coeff = 1.0f - powf(1.0f - coeff, (float)n / (float)SQUELCH_STEP);
+    obj->measure += coeff * (squelchMeasure(obj, data, n) - obj->measure);
+    float m = obj->measure;
+    int noise = (obj->type == SQUELCH_NOISE);
+    int signal = (noise) ? (m < obj->openLevel)  : (m > obj->openLevel);
+    int gone   = (noise) ? (m > obj->closeLevel) : (m < obj->closeLevel);
+    if (signal)
+        {
+        obj->open = TRUE;
+        obj->tailCount = obj->tailSamples;
+        }
+    else if (obj->open && gone)
+        {
+        if (obj->tailCount > 0)
+            obj->tailCount -= n;
+        else
+            obj->open = FALSE;
+        }
+    else if (obj->open)
+        obj->tailCount = obj->tailSamples;
+}
+
+
+void squelchUpdate(Squelch *obj, float *data, int size,
+                   FloatOutputFunc *func, SilenceOutputFunc *silence, void *context)
+{
+    //runs of steps that are all open, or all closed, go out together
+    float *run = data;
+    int runLen = 0;
+    int runOpen = obj->open;
+    while (size > 0)
+        {
+        int n = (size < SQUELCH_STEP) ? size : SQUELCH_STEP;
+        squelchStep(obj, data, n);
+        if (obj->open != runOpen)
+            {
+            if (runLen > 0)
+                {
+                if (runOpen)
+                    func(run, runLen, context);
+                else
+                    silence(runLen, context);
+                }
+            run = data;
+            runLen = 0;
+            runOpen = obj->open;
+            }
+        runLen += n;
+        data   += n;
+        size   -= n;
+        }
+    if (runLen > 0)
+        {
+        if (runOpen)
+            func(run, runLen, context);
+        else
+            silence(runLen, context);
+        }
+}
+
@@ -0,0 +1,153 @@
+#ifndef _SQUELCH_H_
+#define _SQUELCH_H_
+
+/**
+ * Squelch.  Takes the demodulated audio and passes it on only while
+ * there is a signal.  While it is closed, the audio is replaced by a
+ * count of silent samples, so that the stages after it can skip their
+ * work rather than process silence.
+ *
+ *   SQUELCH_POWER  for AM and SSB.  Opens when the audio is louder than
+ *                  the power level
+ *   SQUELCH_NOISE  for FM.  The discriminator gives loud noise above the
+ *                  audio band with no signal, which a carrier quiets.
+ *                  Opens when that noise falls far enough below the
+ *                  noise of no signal
+ *
+ * Both measures are averaged over SQUELCH_TIME, and it only closes
+ * once they have stayed below their level for SQUELCH_TAIL, so that
+ * the gaps between words do not chop the audio.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "sdrlib.h"
+
+
+/**
+ * Samples per step.  Open or closed is decided once a step.
+ */
+#define SQUELCH_STEP 64
+
+/**
+ * Time constant of the averaging, in seconds
+ */
+#define SQUELCH_TIME 0.02
+
+/**
+ * How long the signal must be gone before it closes, in seconds
+ */
+#define SQUELCH_TAIL 0.3
+
+/**
+ * How much further below its level the measure has to go before the
+ * squelch closes again, in dB
+ */
+#define SQUELCH_HYSTERESIS 3.0
+
+/**
+ * Defaults.  The power level is in dB against a full scale of 1.0
+ */
+#define SQUELCH_POWER_LEVEL -50.0
+#define SQUELCH_QUIETING    10.0
+
+
+typedef enum
+{
+    SQUELCH_POWER=0,
+    SQUELCH_NOISE
+} SquelchType;
+
+
+/**
+ * Called with the number of silent samples given in place of audio
+ */
+typedef void SilenceOutputFunc(int size, void *ctx);
+
+
+struct Squelch
+{
+    float  inRate;
+    SquelchType type;
+    float  powerLevel;     //dB
+    float  quieting;       //dB
+    float  openLevel;      //of the measure, linear, for the type
+    float  closeLevel;
+    float  coeff;          //of the averaging, per whole step
+    float  measure;        //averaged mean square, of the audio or of its noise
+    float  prev[2];        //last two samples, for the noise highpass
+    int    tailSamples;
+    int    tailCount;      //samples left before it closes
+    int    open;
+};
+
+
+/**
+ * @param inRate the rate of the demodulated audio
+ */
+Squelch *squelchCreate(float inRate);
+
+/**
+ *
+ */
+void squelchDelete(Squelch *obj);
+
+/**
+ * Start over, closed, at a new rate.  Does nothing if the rate is the
+ * same.  Not to be called while squelchUpdate() may be running.
+ */
+void squelchSetInRate(Squelch *obj, float inRate);
+
+/**
+ * Set what is measured, which follows the mode.  A change starts over,
+ * as for squelchSetInRate().
+ */
+void squelchSetType(Squelch *obj, SquelchType type);
+
+/**
+ * @param powerLevel dB against full scale above which SQUELCH_POWER opens
+ * @param quieting dB below the noise of no signal at which SQUELCH_NOISE opens
+ */
+void squelchSetLevels(Squelch *obj, float powerLevel, float quieting);
+
+/**
+ * Close, and forget the average, after a gap in the input or a retune
+ */
+void squelchReset(Squelch *obj);
+
+/**
+ * @return true if the audio is being passed on
+ */
+int squelchIsOpen(Squelch *obj);
+
+/**
+ * Pass on 'size' samples, in place, with func while open.  While closed,
+ * silence is called with the number of samples instead.
+ */
+void squelchUpdate(Squelch *obj, float *data, int size,
+                   FloatOutputFunc *func, SilenceOutputFunc *silence, void *context);
+
+
+
+#endif /* _SQUELCH_H_ */
+
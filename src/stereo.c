@@ -0,0 +1,287 @@
+/**
+ * Broadcast FM stereo decoder
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stereo.h"
+#include "private.h"
+
+
+#define PILOT_FREQ   19000.0
+#define PILOT_RANGE  20.0    //Hz either side of 19 kHz the PLL may be pulled
+#define PILOT_DEV    7500.0  //deviation of a full-strength pilot, 10% of 75 kHz
+#define LOOP_FREQ    20.0    //natural frequency of the PLL, Hz
+#define LOOP_DAMPING 0.707
+#define AUDIO_CUTOFF 15000.0
+
+/**
+ * How much of each step's phase measurement goes into the smoothed one
+ */
+#define PHASE_SMOOTH 0.2f
+
+
+/**
+ * Q of each section of a 6th order Butterworth lowpass
+ */
+static float sectionQ[STEREO_SECTIONS] = { 0.5176, 0.7071, 1.9319 };
+
+
+
+Stereo *stereoCreate(float inRate)
+{
+    Stereo *obj = (Stereo *)smalloc(sizeof(Stereo));
+    if (!obj)
+        return NULL;
+    memset(obj, 0, sizeof(Stereo));
+    obj->deemphasis = STEREO_DEEMPHASIS_US;
+    obj->blockSize  = STEREO_BUFSIZE;
+    stereoSetInRate(obj, inRate);
+    for (int i = 0 ; i < STEREO_SECTIONS ; i++)
+        {
+        if (!obj->lowpass[i])
+            {
+            stereoDelete(obj);
+            return NULL;
+            }
+        }
+    return obj;
+}
+
+
+void stereoDelete(Stereo *obj)
+{
+    if (!obj)
+        return;
+    for (int i = 0 ; i < STEREO_SECTIONS ; i++)
+        biquadDelete(obj->lowpass[i]);
+    blockRelease(obj->buf);
+    free(obj);
+}
+
+
+static void stereoUpdateDeemphasis(Stereo *obj)
+{
+    float tau = obj->deemphasis;
+    obj->deemphCoeff = (tau > 0.0) ? 1.0 - exp(-1.0 / (obj->inRate * tau)) : 1.0;
+}
+
+
+void stereoSetInRate(Stereo *obj, float inRate)
+{
+    if (inRate <= 0.0 || inRate == obj->inRate)
+        return;
+    obj->inRate     = inRate;
+    obj->freqCenter = TWOPI * PILOT_FREQ / inRate;
+    obj->freqLimit  = TWOPI * PILOT_RANGE / inRate;
+    obj->lockLevel  = 0.3 * TWOPI * PILOT_DEV / inRate;
+    float wnT = TWOPI * LOOP_FREQ * (float)STEREO_STEP / inRate;
+    obj->alpha = 2.0 * LOOP_DAMPING * wnT;
+    obj->beta  = wnT * wnT;
+    //L+R and L-R are both band limited to 15 kHz, or less if the rate is low
+    float cutoff = AUDIO_CUTOFF;
+    if (cutoff > 0.45 * inRate)
+        cutoff = 0.45 * inRate;
+    for (int i = 0 ; i < STEREO_SECTIONS ; i++)
+        {
+        biquadDelete(obj->lowpass[i]);
+        obj->lowpass[i] = biquadLP(cutoff, inRate, sectionQ[i]);
+        }
+    stereoUpdateDeemphasis(obj);
+    stereoReset(obj);
+}
+
+
+void stereoSetDeemphasis(Stereo *obj, float seconds)
+{
+    obj->deemphasis = (seconds > 0.0) ? seconds : 0.0;
+    stereoUpdateDeemphasis(obj);
+}
+
+
+void stereoSetBlockSize(Stereo *obj, int frames)
+{
+    obj->blockSize = (frames <= 0 || frames > STEREO_BUFSIZE) ? STEREO_BUFSIZE : frames;
+}
+
+
+void stereoReset(Stereo *obj)
+{
+    obj->pilot       = 1.0;
+    obj->freq        = obj->freqCenter;
+    obj->phaseError  = 0.0;
+    obj->level       = 0.0;
+    obj->locked      = FALSE;
+    obj->deemphState = 0.0;
+    for (int i = 0 ; i < STEREO_SECTIONS ; i++)
+        if (obj->lowpass[i])
+            biquadReset(obj->lowpass[i]);
+}
+
+
+int stereoIsLocked(Stereo *obj)
+{
+    return obj->locked;
+}
+
+
+/**
+ * Move the pilot PLL on by one step.  The reference is made for the
+ * step with the frequency held, and compared with the composite over
+ * the whole step.  The pilot is Acos(p), so against cos(t) and sin(t)
+ * the sums are about A/2 cos(t-p) and A/2 sin(t-p) per sample.  The rest
+ * of the composite averages out, mostly in the step and the rest in
+ * the smoothing and the loop.
+ */
+static void pilotStep(Stereo *obj, float *data, float *ref, float *quad, int n)
+{
+    //rotate the phasor in real arithmetic, since a complex multiply
+    //is a library call unless the compiler may ignore infinities
+    float zr = crealf(obj->pilot);
+    float zi = cimagf(obj->pilot);
+    float sr = cosf(obj->freq);
+    float si = sinf(obj->freq);
+    for (int i = 0 ; i < n ; i++)
+        {
+        ref[i]  = zr;
+        quad[i] = zi;
+        float r = zr * sr - zi * si;
+        zi = zr * si + zi * sr;
+        zr = r;
+        }
+
+    float sumI = 0.0;
+    float sumQ = 0.0;
+    for (int i = 0 ; i < n ; i++)
+        {
+        sumI += data[i] * ref[i];
+        sumQ += data[i] * quad[i];
+        }
+    float complex pd = (sumI + sumQ * I) * (2.0f / (float)n);
+    obj->phaseError += PHASE_SMOOTH * (pd - obj->phaseError);
+    float err = -atan2f(cimagf(obj->phaseError), crealf(obj->phaseError));
+
+    //second order loop: the phase is pulled by alpha, the frequency by beta
+    float freq = obj->freq + obj->beta * err / (float)STEREO_STEP;
+    float lo = obj->freqCenter - obj->freqLimit;
+    float hi = obj->freqCenter + obj->freqLimit;
+    obj->freq = (freq < lo) ? lo : (freq > hi) ? hi : freq;
+    float corr = obj->alpha * err;
+    float cr = cosf(corr);
+    float ci = sinf(corr);
+    float r = zr * cr - zi * ci;
+    zi = zr * ci + zi * cr;
+    zr = r;
+    //keep it on the unit circle
+    float g = 1.5f - 0.5f * (zr * zr + zi * zi);
+    obj->pilot = (zr * g) + (zi * g) * I;
+
+    //lock, with some hysteresis
+    obj->level = crealf(obj->phaseError);
+    if (!obj->locked && obj->level > obj->lockLevel)
+        obj->locked = TRUE;
+    else if (obj->locked && obj->level < 0.5 * obj->lockLevel)
+        obj->locked = FALSE;
+}
+
+
+void stereoUpdate(Stereo *obj, float *data, int size, ComplexOutputFunc *func, void *context)
+{
+    if (!obj->buf)
+        {
+        obj->buf = (float complex *)blockAlloc();
+        obj->bufPtr = 0;
+        if (!obj->buf)
+            return;
+        }
+    float complex *buf = obj->buf;
+    int bufPtr = obj->bufPtr;
+    int blockSize = obj->blockSize;
+    int canStereo = (obj->inRate >= STEREO_MIN_RATE);
+    float coeff = obj->deemphCoeff;
+    float complex deemph = obj->deemphState;
+    Biquad **lowpass = obj->lowpass;
+    float ref[STEREO_STEP];
+    float quad[STEREO_STEP];
+    float complex v[STEREO_STEP];
+
+    while (size > 0)
+        {
+        int n = (size < STEREO_STEP) ? size : STEREO_STEP;
+        pilotStep(obj, data, ref, quad, n);
+
+        //take the pilot out of L+R, and bring L-R down from 38 kHz with
+        //twice the pilot: 2cos(2t) = 2(cos^2 - sin^2)
+        int stereo = canStereo && obj->locked;
+        float pilotAmp = (stereo) ? obj->level : 0.0f;
+        float gain     = (stereo) ? 2.0f : 0.0f;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float sum  = data[i] - pilotAmp * ref[i];
+            float diff = data[i] * gain * (ref[i] * ref[i] - quad[i] * quad[i]);
+            v[i] = sum + diff * I;
+            }
+
+        //filter both at once, then matrix and de-emphasize L and R
+        for (int k = 0 ; k < STEREO_SECTIONS ; k++)
+            biquadUpdateBlockC(lowpass[k], v, n);
+        for (int i = 0 ; i < n ; i++)
+            {
+            float m = crealf(v[i]);
+            float d = cimagf(v[i]);
+            float complex lr = (m + d) + (m - d) * I;
+            deemph += coeff * (lr - deemph);
+            buf[bufPtr++] = deemph;
+            if (bufPtr >= blockSize)
+                {
+                func(buf, bufPtr, context);
+                buf = obj->buf = (float complex *)blockRenew(buf);
+                bufPtr = 0;
+                if (!buf)
+                    {
+                    obj->deemphState = deemph;
+                    return;
+                    }
+                }
+            }
+        data += n;
+        size -= n;
+        }
+    obj->deemphState = deemph;
+    obj->bufPtr = bufPtr;
+}
+
+
+void stereoFlush(Stereo *obj, ComplexOutputFunc *func, void *context)
+{
+    if (obj->buf && obj->bufPtr > 0)
+        {
+        func(obj->buf, obj->bufPtr, context);
+        obj->buf = (float complex *)blockRenew(obj->buf);
+        obj->bufPtr = 0;
+        }
+}
+
@@ -0,0 +1,153 @@
+#ifndef _STEREO_H_
+#define _STEREO_H_
+
+/**
+ * Broadcast FM stereo decoder.  Takes the composite baseband from the FM
+ * discriminator, and gives left and right audio:
+ *
+ *   L+R      0 - 15 kHz
+ *   pilot    19 kHz
+ *   L-R      23 - 53 kHz, DSB on a suppressed 38 kHz carrier, in phase
+ *            with twice the pilot
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+
+
+#include "sdrlib.h"
+#include "filter.h"
+#include "pool.h"
+
+
+/**
+ * Output frames per block.  A frame is a float complex, with the left
+ * channel in the real part and the right in the imaginary, which is
+ * also the layout of interleaved stereo.
+ */
+#define STEREO_BUFSIZE (POOL_BLOCK_SAMPLES)
+
+/**
+ * Samples per step of the pilot PLL.  The pilot reference for each step
+ * is made with the frequency fixed, and the phase error is measured over
+ * the whole step, so everything but the loop update is a plain loop.
+ */
+#define STEREO_STEP 64
+
+/**
+ * Sections of the 15 kHz lowpass for L+R and L-R.  6th order Butterworth.
+ */
+#define STEREO_SECTIONS 3
+
+/**
+ * Slowest composite rate that can carry L-R, up to 53 kHz.  Below
+ * this the decoder gives mono.
+ */
+#define STEREO_MIN_RATE 108000.0
+
+/**
+ * De-emphasis time constants, in seconds
+ */
+#define STEREO_DEEMPHASIS_EU 50.0e-6
+#define STEREO_DEEMPHASIS_US 75.0e-6
+
+
+struct Stereo
+{
+    float  inRate;
+    float  deemphasis;    //time constant in seconds.  0 for none
+    float  deemphCoeff;   //of the one-pole lowpass
+    float complex deemphState; //L, R
+    //pilot PLL
+    float complex pilot;  //phase of the pilot reference, as a unit phasor
+    float  freq;          //of the reference, in radians/sample
+    float  freqCenter;    //19 kHz
+    float  freqLimit;     //most the reference may be pulled from the center
+    float  alpha;         //loop gains, for phase and frequency
+    float  beta;
+    float complex phaseError; //smoothed phase detector output: the pilot against the reference
+    float  level;         //amplitude of the pilot, in phase with the reference
+    float  lockLevel;     //level above which it is locked, in radians/sample
+    int    locked;
+    Biquad *lowpass[STEREO_SECTIONS]; //of L+R in the real part and L-R in the imaginary
+    float complex *buf;   //pool block being filled
+    int    bufPtr;
+    int    blockSize;     //frames per output block, up to STEREO_BUFSIZE
+};
+
+
+/**
+ * @param inRate the rate of the composite, which should be at least
+ *     STEREO_MIN_RATE
+ */
+Stereo *stereoCreate(float inRate);
+
+/**
+ *
+ */
+void stereoDelete(Stereo *obj);
+
+/**
+ * Rebuild the filters and start over for a new rate.  Does nothing if
+ * the rate is the same.  Not to be called while stereoUpdate() may be
+ * running.
+ */
+void stereoSetInRate(Stereo *obj, float inRate);
+
+/**
+ * @param seconds the de-emphasis time constant.  0 for none
+ */
+void stereoSetDeemphasis(Stereo *obj, float seconds);
+
+/**
+ * Output blocks of at most 'frames', for lower latency.  0 for
+ * STEREO_BUFSIZE, the default.
+ */
+void stereoSetBlockSize(Stereo *obj, int frames);
+
+/**
+ * Clear the filters and unlock the PLL, after a gap in the input
+ */
+void stereoReset(Stereo *obj);
+
+/**
+ * @return true if the pilot is locked, and the output is stereo
+ */
+int stereoIsLocked(Stereo *obj);
+
+/**
+ * Decode 'size' samples of composite, in radians/sample as they come
+ * from the FM demodulator, calling func with blocks of stereo frames.
+ * The output is at the input rate.
+ */
+void stereoUpdate(Stereo *obj, float *data, int size, ComplexOutputFunc *func, void *context);
+
+/**
+ * Output the frames made so far, in a short block, as before silence
+ */
+void stereoFlush(Stereo *obj, ComplexOutputFunc *func, void *context);
+
+
+
+#endif /* _STEREO_H_ */
+
@@ -0,0 +1,268 @@
+/**
+ * Wideband spectrum sweep.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "private.h"
+
+
+
+Sweep *sweepCreate(SweepTuneFunc *tuneFunc, void *tuneContext)
+{
+    Sweep *obj = (Sweep *)smalloc(sizeof(Sweep));
+    if (!obj)
+        return NULL;
+    memset(obj, 0, sizeof(Sweep));
+    obj->fft = fftCreate(SWEEP_FFT_SIZE);
+    obj->acc = (unsigned int *)smalloc(SWEEP_FFT_SIZE * sizeof(unsigned int));
+    if (!obj->fft || !obj->acc)
+        {
+        sweepDelete(obj);
+        return NULL;
+        }
+    //every sample after settling is used
+    obj->fft->threshold = 0;
+    obj->average     = SWEEP_AVERAGE;
+    obj->settleTime  = SWEEP_SETTLE;
+    obj->tuneFunc    = tuneFunc;
+    obj->tuneContext = tuneContext;
+    pthread_mutex_init(&(obj->lock), NULL);
+    return obj;
+}
+
+
+void sweepDelete(Sweep *obj)
+{
+    if (!obj)
+        return;
+    pthread_mutex_destroy(&(obj->lock));
+    fftDelete(obj->fft);
+    free(obj->acc);
+    free(obj->line);
+    free(obj);
+}
+
+
+void sweepSetDwell(Sweep *obj, int average, float settleTime)
+{
+    pthread_mutex_lock(&(obj->lock));
+    obj->average    = (average < 1) ? 1 : average;
+    obj->settleTime = (settleTime < 0.0) ? 0.0 : settleTime;
+    pthread_mutex_unlock(&(obj->lock));
+}
+
+
+/**
+ * Tune to the current step.  Samples captured before the tuner has
+ * settled there are discarded.  When the device stamps its blocks, that
+ * is by capture time, so the samples of the block it is filling that
+ * come after the retune are kept.  Otherwise the whole of that block
+ * has to go, since there is no telling where in it the change is.
+ */
+static void sweepTune(Sweep *obj)
+{
+    double stepWidth = (double)obj->binsPerStep * obj->sampleRate / SWEEP_FFT_SIZE;
+    double freq = obj->loFreq + stepWidth * ((double)obj->step + 0.5);
+    unsigned long long time = 0;
+    unsigned long long seq = obj->tuneFunc(freq, &time, obj->tuneContext);
+    obj->discardUntil = seq + obj->blockSize +
+        (unsigned long long)(obj->settleTime * obj->sampleRate);
+    obj->settledAt = time + (unsigned long long)(obj->settleTime * 1.0e9);
+    memset(obj->acc, 0, SWEEP_FFT_SIZE * sizeof(unsigned int));
+    obj->frames = 0;
+    obj->fft->inPtr = 0;
+}
+
+
+int sweepStart(Sweep *obj, double loFreq, double hiFreq, float sampleRate)
+{
+    if (hiFreq <= loFreq || sampleRate <= 0.0)
+        return 0;
+    int N = SWEEP_FFT_SIZE;
+    //even, so the DC bin stays at the same place in every step
+    int binsPerStep = ((int)(N * SWEEP_CROP)) & ~1;
+    double stepWidth = (double)binsPerStep * sampleRate / N;
+    int steps = (int)ceil((hiFreq - loFreq) / stepWidth);
+    int lineSize = steps * binsPerStep;
+    unsigned int *line = (unsigned int *)malloc(lineSize * sizeof(unsigned int));
+    if (!line)
+        return 0;
+    memset(line, 0, lineSize * sizeof(unsigned int));
+
+    pthread_mutex_lock(&(obj->lock));
+    free(obj->line);
+    obj->line        = line;
+    obj->lineSize    = lineSize;
+    obj->loFreq      = loFreq;
+    obj->hiFreq      = hiFreq;
+    obj->sampleRate  = sampleRate;
+    obj->binsPerStep = binsPerStep;
+    obj->steps       = steps;
+    obj->step        = 0;
+    obj->lines       = 0;
+    sweepTune(obj);
+    obj->enabled     = TRUE;
+    pthread_mutex_unlock(&(obj->lock));
+    return lineSize;
+}
+
+
+void sweepStop(Sweep *obj)
+{
+    pthread_mutex_lock(&(obj->lock));
+    obj->enabled = FALSE;
+    pthread_mutex_unlock(&(obj->lock));
+}
+
+
+/**
+ * Keep the middle of the averaged spectrum, then move on
+ */
+static void sweepNextStep(Sweep *obj)
+{
+    int bins  = obj->binsPerStep;
+    int first = (SWEEP_FFT_SIZE - bins) / 2;
+    int avg   = obj->average;
+    unsigned int *acc = obj->acc + first;
+    unsigned int *out = obj->line + obj->step * bins;
+    for (int i = 0 ; i < bins ; i++)
+        out[i] = acc[i] / avg;
+    //the DC bin has the tuner's LO leakage.  Fill it in from its neighbors
+    int dc = SWEEP_FFT_SIZE / 2 - first;
+    out[dc] = (out[dc - 1] + out[dc + 1]) / 2;
+
+    if (++obj->step >= obj->steps)
+        {
+        obj->step = 0;
+        obj->lines++;
+        obj->func(obj->line, obj->lineSize, obj->context);
+        }
+    sweepTune(obj);
+}
+
+
+static void sweepFftOutput(unsigned int *vals, int size, void *context)
+{
+    Sweep *obj = (Sweep *)context;
+    unsigned int *acc = obj->acc;
+    for (int i = 0 ; i < size ; i++)
+        acc[i] += vals[i];
+    if (++obj->frames >= obj->average)
+        sweepNextStep(obj);
+}
+
+
+/**
+ * Find the part of a block that is usable at this step.  Nothing past
+ * the samples needed is used, since the device is retuned then.
+ * @return the number of samples to use, starting at *offset
+ */
+static int sweepWindow(Sweep *obj, int size, unsigned long long seq,
+                       unsigned long long time, int *offset)
+{
+    if (size > obj->blockSize)
+        obj->blockSize = size;
+    int off = 0;
+    if (time)
+        {
+        if (time < obj->settledAt)
+            {
+            double skip = (double)(obj->settledAt - time) * 1.0e-9 * obj->sampleRate;
+            if (skip >= (double)size)
+                return 0;
+            off = (int)ceil(skip);
+            }
+        }
+    else
+        {
+        unsigned long long end = seq + size;
+        if (end <= obj->discardUntil)
+            return 0;
+        off = (seq < obj->discardUntil) ? (int)(obj->discardUntil - seq) : 0;
+        }
+    if (off >= size)
+        return 0;
+    int needed = (obj->average - obj->frames) * SWEEP_FFT_SIZE - obj->fft->inPtr;
+    int count = size - off;
+    *offset = off;
+    return (count < needed) ? count : needed;
+}
+
+
+int sweepUpdate(Sweep *obj, float complex *data, int size,
+                unsigned long long seq, unsigned long long time,
+                FftOutputFunc *func, void *context)
+{
+    pthread_mutex_lock(&(obj->lock));
+    int enabled = obj->enabled;
+    obj->func    = func;
+    obj->context = context;
+    while (enabled && size > 0)
+        {
+        int off = 0;
+        int count = sweepWindow(obj, size, seq, time, &off);
+        if (!count)
+            break;
+        fftUpdate(obj->fft, data + off, count, sweepFftOutput, obj);
+        //if a step finished, the rest of the block is before it settled
+        data += off + count;
+        seq  += off + count;
+        size -= off + count;
+        if (time)
+            time += (unsigned long long)((double)(off + count) * 1.0e9 / obj->sampleRate);
+        }
+    pthread_mutex_unlock(&(obj->lock));
+    return enabled;
+}
+
+
+int sweepUpdateBytes(Sweep *obj, unsigned char *data, int size,
+                unsigned long long seq, unsigned long long time,
+                FftOutputFunc *func, void *context)
+{
+    pthread_mutex_lock(&(obj->lock));
+    int enabled = obj->enabled;
+    obj->func    = func;
+    obj->context = context;
+    while (enabled && size > 0)
+        {
+        int off = 0;
+        int count = sweepWindow(obj, size, seq, time, &off);
+        if (!count)
+            break;
+        fftUpdateBytes(obj->fft, data + 2 * off, count, sweepFftOutput, obj);
+        data += 2 * (off + count);
+        seq  += off + count;
+        size -= off + count;
+        if (time)
+            time += (unsigned long long)((double)(off + count) * 1.0e9 / obj->sampleRate);
+        }
+    pthread_mutex_unlock(&(obj->lock));
+    return enabled;
+}
+
@@ -0,0 +1,156 @@
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+/**
+ * Wideband spectrum sweep.  Steps the center frequency of a device
+ * across a range wider than its sample rate, and stitches the middle
+ * of the spectrum seen at each step into one power-spectrum line.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+#include <pthread.h>
+
+#include "sdrlib.h"
+#include "fft.h"
+
+
+/**
+ * Size of the fft at each step.  Small, so that few samples are needed
+ * per step.  Bins are still only 2 kHz wide at 2 Msps.
+ */
+#define SWEEP_FFT_SIZE (1024)
+
+/**
+ * Default number of ffts averaged at each step
+ */
+#define SWEEP_AVERAGE (4)
+
+/**
+ * Default time to wait for the tuner to settle after each step, in seconds
+ */
+#define SWEEP_SETTLE (0.002)
+
+/**
+ * Fraction of the bins kept from each step.  The edges are dropped,
+ * where the device's anti-alias filter rolls off.
+ */
+#define SWEEP_CROP (0.75)
+
+/**
+ * Block size asked of the device while sweeping, in samples.  The rest
+ * of the block being filled when a step is done was taken at the old
+ * frequency, so each step lasts at least one block.  4 ms at 2 Msps,
+ * and the smallest transfer rtl-sdr makes.
+ */
+#define SWEEP_BLOCK_SIZE (8192)
+
+
+/**
+ * Retune the device.
+ * @param time set to when the device was retuned, in ns of
+ *     CLOCK_MONOTONIC, the clock of DeviceBlock.time
+ * @return the seq of the first sample the device will deliver at the
+ *     new frequency, as near as it can tell
+ */
+typedef unsigned long long SweepTuneFunc(double freq, unsigned long long *time,
+                                         void *context);
+
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int           enabled;
+    double        loFreq;
+    double        hiFreq;
+    float         sampleRate;
+    int           average;      //ffts per step
+    float         settleTime;
+    int           binsPerStep;  //bins kept from each step
+    int           steps;
+    int           step;         //the current one
+    int           frames;       //ffts done at this step so far
+    int           blockSize;    //largest block seen from the device
+    unsigned long long discardUntil; //seq of the first sample to use at this step
+    unsigned long long settledAt;    //capture time of the first sample to use, in ns
+    Fft           *fft;
+    unsigned int  *acc;         //sum of the ffts at this step
+    unsigned int  *line;        //the stitched line
+    int           lineSize;
+    unsigned long long lines;   //completed
+    SweepTuneFunc *tuneFunc;
+    void          *tuneContext;
+    FftOutputFunc *func;        //while in sweepUpdate()
+    void          *context;
+} Sweep;
+
+
+/**
+ *
+ */
+Sweep *sweepCreate(SweepTuneFunc *tuneFunc, void *tuneContext);
+
+/**
+ *
+ */
+void sweepDelete(Sweep *obj);
+
+/**
+ * Set the dwell at each step
+ * @param average number of ffts averaged
+ * @param settleTime seconds to wait for the tuner after each step
+ */
+void sweepSetDwell(Sweep *obj, int average, float settleTime);
+
+/**
+ * Start sweeping.  Each line covers loFreq to loFreq + lineSize * binWidth,
+ * binWidth being sampleRate / SWEEP_FFT_SIZE, which is at least up to hiFreq.
+ * @return the number of bins in each line, or 0 on error
+ */
+int sweepStart(Sweep *obj, double loFreq, double hiFreq, float sampleRate);
+
+/**
+ * Stop sweeping.  Does not retune the device.
+ */
+void sweepStop(Sweep *obj);
+
+/**
+ * Feed samples from the device.  'seq' is that of the first sample,
+ * and 'time' when it was captured, or 0 if the device does not say.
+ * Completed lines are output to func.
+ * @return false if not sweeping, and the data was not used
+ */
+int sweepUpdate(Sweep *obj, float complex *data, int size,
+                unsigned long long seq, unsigned long long time,
+                FftOutputFunc *func, void *context);
+
+/**
+ * Same as sweepUpdate(), for raw interleaved unsigned 8-bit I/Q
+ */
+int sweepUpdateBytes(Sweep *obj, unsigned char *data, int size,
+                unsigned long long seq, unsigned long long time,
+                FftOutputFunc *func, void *context);
+
+
+
+#endif /* _SWEEP_H_ */
+
@@ -34,13 +34,13 @@ List *listAppend(List *list, void *data)
         return NULL;
     node->next = NULL;
     node->data = data;
-    if (list)
-        {
-        while (list->next)
-            list = list->next;
-        list->next = node;
-        }
-    return node;
+    if (!list)
+        return node;
+    List *tail = list;
+    while (tail->next)
+        tail = tail->next;
+    tail->next = node;
+    return list;
 }
 
 List *listRemove(List *list, void *data)
@@ -51,7 +51,7 @@ List *listRemove(List *list, void *data)
     while (curr)
         {
         next = curr->next;
-        if (list->data == data)
+        if (curr->data == data)
             {
             free(curr);
             if (prev)
@@ -59,7 +59,8 @@ List *listRemove(List *list, void *data)
             else
                 list = next;
             }
-        prev = curr;
+        else
+            prev = curr;
         curr = next;
         }
     return list;
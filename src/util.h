@@ -39,6 +39,9 @@ struct List
 
 typedef void ListFunc(void *data);
 
+/**
+ * @return the head of the list, which is the new element if list was NULL
+ */
 List *listAppend(List *list, void *data);
 
 /**
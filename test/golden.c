@@ -0,0 +1,473 @@
+/**
+ * Golden-signal tests.  A deterministic scene from the synthetic device
+ * is run through the whole receiver chain for each mode, and the
+ * demodulated audio and the first power spectrum are compared with
+ * vectors stored in golden/.  Audio must match to within an SNR, spectra
+ * to within a few units, so that rewrites of the DSP which change the
+ * rounding, but not the signal, still pass.
+ *
+ * Run with -w to write new vectors after a deliberate change of output.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sdrlib.h>
+
+#include "private.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define setenv(name, value, overwrite) _putenv_s(name, value)
+static void sleepMs(int ms) { Sleep(ms); }
+#else
+#include <unistd.h>
+static void sleepMs(int ms) { usleep(ms * 1000); }
+#endif
+
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "golden"
+#endif
+
+/**
+ * Audio samples compared.  About 0.37 seconds, or half that in stereo,
+ * where the samples are left,right pairs
+ */
+#define GOLDEN_AUDIO 16384
+
+/**
+ * Bins in the receiver's fft
+ */
+#define GOLDEN_PS 16384
+
+/**
+ * Minimum SNR of the audio against its golden vector, in dB
+ */
+#define GOLDEN_AUDIO_SNR 40.0
+
+/**
+ * Most a spectrum may differ from its golden vector, in the
+ * units of the power spectrum: 20 * log2(1 + |X|)
+ */
+#define GOLDEN_PS_MAX 4
+#define GOLDEN_PS_RMS 1.0
+
+/**
+ * Give up on a case after this long
+ */
+#define GOLDEN_TIMEOUT_MS 60000
+
+
+typedef struct
+{
+    char  *name;
+    char  *scene;
+    Mode  mode;
+    float vfo;
+    float pbLo;
+    float pbHi;
+} Case;
+
+
+static Case cases[] =
+{
+    { "fm",  "fm:freq=100e3,level=-20,dev=3000,tone=1000;noise:level=-70",
+        MODE_FM,  100000.0, -5000.0, 5000.0 },
+    { "am",  "am:freq=-200e3,level=-20,depth=0.5,tone=800;noise:level=-70",
+        MODE_AM, -200000.0, -5000.0, 5000.0 },
+    { "usb", "usb:freq=300e3,level=-20,tone=1200;noise:level=-70",
+        MODE_USB, 300000.0,     0.0, 3000.0 },
+    { "lsb", "lsb:freq=-50e3,level=-20,tone=700;noise:level=-70",
+        MODE_LSB, -50000.0, -3000.0,    0.0 },
+    { "wfm", "wfm:freq=500e3,level=-20,tone=1000,tone2=400;noise:level=-70",
+        MODE_WFM, 500000.0, -150000.0, 150000.0 },
+    { "sam", "am:freq=150e3,level=-20,depth=0.8,tone=600;noise:level=-70",
+        MODE_SAM, 150100.0, -5000.0, 5000.0 },
+    { "cw",  "tone:freq=-300e3,level=-20;noise:level=-70",
+        MODE_CW, -300020.0, -1500.0, 1500.0 },
+    { "fsk", "fsk:freq=250e3,level=-20,shift=170,baud=45.45;noise:level=-70",
+        MODE_FSK, 250000.0, -1000.0, 1000.0 },
+    { NULL,  NULL, MODE_NULL, 0.0, 0.0, 0.0 }
+};
+
+
+/**
+ * What the chain put out, filled in by the reader thread
+ */
+typedef struct
+{
+    float        audio[GOLDEN_AUDIO];
+    volatile int audioLen;
+    int          channels;
+    unsigned int ps[GOLDEN_PS];
+    volatile int psLen;
+} Capture;
+
+
+
+/*############################################################################
+## F I L E S
+############################################################################*/
+
+/**
+ * Vectors are kept little-endian, whatever the machine: audio as
+ * 32-bit floats, spectra as 16-bit unsigned values.
+ */
+
+static char *goldenPath(char *buf, int len, char *dir, char *name, char *ext)
+{
+    snprintf(buf, len, "%s/%s.%s", dir, name, ext);
+    return buf;
+}
+
+
+static int writeAudio(char *fname, float *data, int size)
+{
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+        {
+        error("cannot write '%s'", fname);
+        return FALSE;
+        }
+    for (int i = 0 ; i < size ; i++)
+        {
+        unsigned int v;
+        memcpy(&v, &data[i], 4);
+        unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+        fwrite(b, 1, 4, f);
+        }
+    fclose(f);
+    return TRUE;
+}
+
+
+static int readAudio(char *fname, float *data, int size)
+{
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        {
+        error("cannot read '%s'", fname);
+        return FALSE;
+        }
+    int count = 0;
+    unsigned char b[4];
+    while (count < size && fread(b, 1, 4, f) == 4)
+        {
+        unsigned int v = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+        memcpy(&data[count++], &v, 4);
+        }
+    fclose(f);
+    if (count != size)
+        {
+        error("'%s' has %d samples, expected %d", fname, count, size);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+static int writePs(char *fname, unsigned int *data, int size)
+{
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+        {
+        error("cannot write '%s'", fname);
+        return FALSE;
+        }
+    for (int i = 0 ; i < size ; i++)
+        {
+        unsigned int v = (data[i] > 0xffff) ? 0xffff : data[i];
+        unsigned char b[2] = { v, v >> 8 };
+        fwrite(b, 1, 2, f);
+        }
+    fclose(f);
+    return TRUE;
+}
+
+
+static int readPs(char *fname, unsigned int *data, int size)
+{
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        {
+        error("cannot read '%s'", fname);
+        return FALSE;
+        }
+    int count = 0;
+    unsigned char b[2];
+    while (count < size && fread(b, 1, 2, f) == 2)
+        data[count++] = b[0] | (b[1] << 8);
+    fclose(f);
+    if (count != size)
+        {
+        error("'%s' has %d bins, expected %d", fname, count, size);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+
+/*############################################################################
+## M E T R I C S
+############################################################################*/
+
+/**
+ * @return the ratio of the golden signal to its difference from the
+ *     output, in dB.  1000 if they are identical.
+ */
+static double audioSnr(float *golden, float *out, int size)
+{
+    double sig = 0.0;
+    double err = 0.0;
+    for (int i = 0 ; i < size ; i++)
+        {
+        double d = (double)out[i] - (double)golden[i];
+        sig += (double)golden[i] * (double)golden[i];
+        err += d * d;
+        }
+    if (err <= 0.0)
+        return 1000.0;
+    if (sig <= 0.0)
+        return -1000.0;
+    return 10.0 * log10(sig / err);
+}
+
+
+static void psDiff(unsigned int *golden, unsigned int *out, int size, int *maxDiff, double *rms)
+{
+    double sum = 0.0;
+    int mx = 0;
+    for (int i = 0 ; i < size ; i++)
+        {
+        int d = abs((int)out[i] - (int)golden[i]);
+        if (d > mx)
+            mx = d;
+        sum += (double)d * (double)d;
+        }
+    *maxDiff = mx;
+    *rms     = sqrt(sum / (double)size);
+}
+
+
+
+/*############################################################################
+## R U N
+############################################################################*/
+
+
+static void audioFunc(float *data, int size, void *ctx)
+{
+    Capture *cap = (Capture *)ctx;
+    int len = cap->audioLen;
+    int n = GOLDEN_AUDIO - len;
+    size *= cap->channels;
+    if (n > size)
+        n = size;
+    if (n <= 0)
+        return;
+    memcpy(cap->audio + len, data, n * sizeof(float));
+    cap->audioLen = len + n;
+}
+
+
+static void psFunc(unsigned int *data, int size, void *ctx)
+{
+    Capture *cap = (Capture *)ctx;
+    if (cap->psLen || size != GOLDEN_PS)
+        return;
+    memcpy(cap->ps, data, size * sizeof(unsigned int));
+    cap->psLen = size;
+}
+
+
+/**
+ * Play the case's scene through a new SdrLib until the audio and
+ * spectrum have been captured
+ */
+static int capture(Case *c, Capture *cap)
+{
+    setenv("SDRLIB_SYNTH", c->scene, 1);
+    setenv("SDRLIB_SYNTH_RATE", "2048000", 1);
+    setenv("SDRLIB_SYNTH_REALTIME", "0", 1);
+    setenv("SDRLIB_SYNTH_DURATION", "10", 1);
+    setenv("SDRLIB_SYNTH_CACHE", "0", 1);
+
+    cap->audioLen = 0;
+    cap->psLen    = 0;
+    SdrLib *sdr = sdrCreate(cap, psFunc, NULL);
+    if (!sdr)
+        return FALSE;
+    int index = -1;
+    for (int i = 0 ; i < sdrGetDeviceCount(sdr) ; i++)
+        {
+        if (strstr(sdrGetDeviceName(sdr, i), "Synthetic"))
+            {
+            index = i;
+            break;
+            }
+        }
+    if (index < 0)
+        {
+        error("%s: the synthetic device was not found", c->name);
+        sdrDelete(sdr);
+        return FALSE;
+        }
+
+    sdrSelectDevice(sdr, index);
+    sdrSetAudioOutput(sdr, cap, audioFunc);
+    sdrSetMode(sdr, c->mode);
+    cap->channels = sdrGetAudioChannels(sdr);
+    sdrSetDdcFreqs(sdr, c->vfo, c->pbLo, c->pbHi);
+    int ret = sdrStartDevice(sdr, index, -1);
+    for (int ms = 0 ; ret && ms < GOLDEN_TIMEOUT_MS ; ms += 10)
+        {
+        if (cap->audioLen >= GOLDEN_AUDIO && cap->psLen)
+            break;
+        sleepMs(10);
+        }
+    sdrStop(sdr);
+    sdrDelete(sdr);
+
+    if (!ret || cap->audioLen < GOLDEN_AUDIO || !cap->psLen)
+        {
+        error("%s: got %d audio samples and %d spectra", c->name,
+            cap->audioLen, cap->psLen ? 1 : 0);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+static int runCase(Case *c, char *dir, int write, double minSnr)
+{
+    static Capture cap;
+    static float goldenAudio[GOLDEN_AUDIO];
+    static unsigned int goldenPs[GOLDEN_PS];
+    char audioName[1024];
+    char psName[1024];
+    goldenPath(audioName, sizeof(audioName), dir, c->name, "f32");
+    goldenPath(psName, sizeof(psName), dir, c->name, "ps");
+
+    if (!capture(c, &cap))
+        return FALSE;
+
+    if (write)
+        {
+        int ret = writeAudio(audioName, cap.audio, GOLDEN_AUDIO) &&
+                  writePs(psName, cap.ps, GOLDEN_PS);
+        printf("%-6s written\n", c->name);
+        return ret;
+        }
+
+    if (!readAudio(audioName, goldenAudio, GOLDEN_AUDIO) ||
+        !readPs(psName, goldenPs, GOLDEN_PS))
+        return FALSE;
+    double snr = audioSnr(goldenAudio, cap.audio, GOLDEN_AUDIO);
+    int psMax;
+    double psRms;
+    psDiff(goldenPs, cap.ps, GOLDEN_PS, &psMax, &psRms);
+    int ret = (snr >= minSnr && psMax <= GOLDEN_PS_MAX && psRms <= GOLDEN_PS_RMS);
+    printf("%-6s audio snr %7.1f dB   spectrum max %3d rms %5.2f   %s\n",
+        c->name, snr, psMax, psRms, ret ? "ok" : "FAIL");
+    return ret;
+}
+
+
+
+/*############################################################################
+## M A I N
+############################################################################*/
+
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-w] [-d dir] [-s snr] [case ...]\n", prog);
+    fprintf(stderr, "    -w      write the golden vectors instead of comparing\n");
+    fprintf(stderr, "    -d dir  where the vectors are (%s)\n", GOLDEN_DIR);
+    fprintf(stderr, "    -s snr  minimum audio SNR in dB (%g)\n", GOLDEN_AUDIO_SNR);
+    fprintf(stderr, "    cases:");
+    for (Case *c = cases ; c->name ; c++)
+        fprintf(stderr, " %s", c->name);
+    fprintf(stderr, "\n");
+}
+
+
+static int selected(char *name, char **names, int count)
+{
+    if (!count)
+        return TRUE;
+    for (int i = 0 ; i < count ; i++)
+        if (strcmp(names[i], name) == 0)
+            return TRUE;
+    return FALSE;
+}
+
+
+int main(int argc, char **argv)
+{
+    char *dir = GOLDEN_DIR;
+    int write = FALSE;
+    double minSnr = GOLDEN_AUDIO_SNR;
+    char **names = argv + argc;
+    int count = 0;
+    for (int i = 1 ; i < argc ; i++)
+        {
+        char *arg = argv[i];
+        if (strcmp(arg, "-w") == 0)
+            write = TRUE;
+        else if (strcmp(arg, "-d") == 0 && i + 1 < argc)
+            dir = argv[++i];
+        else if (strcmp(arg, "-s") == 0 && i + 1 < argc)
+            minSnr = atof(argv[++i]);
+        else if (arg[0] == '-')
+            {
+            usage(argv[0]);
+            return 1;
+            }
+        else
+            {
+            names = argv + i;
+            count = argc - i;
+            break;
+            }
+        }
+
+    int failures = 0;
+    for (Case *c = cases ; c->name ; c++)
+        {
+        if (!selected(c->name, names, count))
+            continue;
+        if (!runCase(c, dir, write, minSnr))
+            failures++;
+        }
+    if (failures)
+        printf("%d case(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
+